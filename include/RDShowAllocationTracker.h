@@ -0,0 +1,97 @@
+/*
+   The MIT License (MIT) (http://opensource.org/licenses/MIT)
+   
+   Copyright (c) 2015 Jacques Menuet
+   
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+   
+   The above copyright notice and this permission notice shall be included in all
+   copies or substantial portions of the Software.
+   
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+*/
+#pragma once
+
+#include <cstddef>
+
+namespace RDShow
+{
+
+/*
+	AllocationTracker
+
+	A debug facility to check that, once warmed up, the capture and delivery paths never 
+	touch the heap.
+
+	The code of these paths is wrapped in AllocationTracker::Scope objects that carry the 
+	number of the frame being processed. When the library is built with RDSHOW_TRACK_ALLOCATIONS 
+	defined (CMake option RAPADIRECTSHOW_TRACK_ALLOCATIONS), the global operator new and delete 
+	are replaced by versions that look at the current thread: an allocation made inside a Scope 
+	whose frame number is past the warm-up frames is a hot path allocation. Depending on the mode, 
+	hot path allocations are counted or abort the program on the spot (which makes it easy to 
+	find the culprit in a debugger).
+
+	Without RDSHOW_TRACK_ALLOCATIONS, Scope is an empty object and nothing is replaced: 
+	there's no cost at all. The application must be compiled with the same setting as the library.
+
+	Note: only the allocations going through operator new are seen. Direct calls to malloc, 
+	calloc, realloc (and to what uses them, such as strdup or some C libraries) aren't counted: 
+	replacing them would fight with the sanitizers and debug heaps that hook them too.
+*/
+class AllocationTracker
+{
+public:
+	enum Mode
+	{
+		Disabled,
+		Count,		// Count hot path allocations (see getNumHotPathAllocations())
+		Fail		// Abort on the first hot path allocation
+	};
+
+	static bool					isAvailable();		// Whether the library was built with RDSHOW_TRACK_ALLOCATIONS
+
+	static void					setMode( Mode mode );
+	static Mode					getMode();
+	static void					setNumWarmUpFrames( unsigned int numFrames );
+	static unsigned int			getNumWarmUpFrames();
+
+	static unsigned long long	getNumHotPathAllocations();
+	static unsigned long long	getNumHotPathAllocatedBytes();
+	static void					resetCounters();
+
+	class Scope
+	{
+	public:
+#ifdef RDSHOW_TRACK_ALLOCATIONS
+		Scope( unsigned int frameNumber )		: mIsHot( enterScope( frameNumber ) ) {}
+		~Scope()								{ leaveScope( mIsHot ); }
+#else
+		Scope( unsigned int /*frameNumber*/ )	{}
+#endif
+	private:
+		Scope( const Scope& other );				// Not implemented on purpose
+		Scope& operator=( const Scope& other );		// Not implemented on purpose
+#ifdef RDSHOW_TRACK_ALLOCATIONS
+		bool	mIsHot;
+#endif
+	};
+
+	static void					onAllocation( std::size_t sizeInBytes );
+
+private:
+	static bool					enterScope( unsigned int frameNumber );
+	static void					leaveScope( bool isHot );
+};
+
+}
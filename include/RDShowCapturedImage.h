@@ -28,23 +28,42 @@
 namespace RDShow
 {
 
+/*
+	CapturedImage
+
+	An Image coming from a Device, with:
+	- its sequence number, incremented for each image the backend delivers (dropped ones included),
+	- its timestamp, the sample time given by the backend (relative to the start of the capture),
+	- its arrival time, read on the host Clock as soon as the backend delivers it,
+	- its publish time, read on the host Clock when it's handed over to the Device (0 for the 
+	  images given to the RealTimeListeners as they aren't published yet).
+	Times are in nanoseconds.
+*/
 class CapturedImage
 {
 public:
 	CapturedImage( ImageFormat imageFormat );
+	CapturedImage( ImageFormat imageFormat, const unsigned char* externalBytes );		// Borrows the bytes, see Image
 
 	const Image&	getImage() const			{ return mImage; }
 	unsigned int	getSequenceNumber() const	{ return mSequenceNumber; }
-	float			getTimestampInSec()	const	{ return mTimestampInSec; }
+	long long		getTimestampInNs() const	{ return mTimestampInNs; }
+	double			getTimestampInSec()	const	{ return static_cast<double>(mTimestampInNs) / 1e9; }
+	long long		getArrivalTimeInNs() const	{ return mArrivalTimeInNs; }
+	long long		getPublishTimeInNs() const	{ return mPublishTimeInNs; }
 
 	Image&			getImage()					{ return mImage; }
 	void			setSequenceNumber( unsigned int	sequenceNumber )	{ mSequenceNumber = sequenceNumber; }
-	void			setTimestampInSec( float timestamp )				{ mTimestampInSec = timestamp; }
+	void			setTimestampInNs( long long timestamp )				{ mTimestampInNs = timestamp; }
+	void			setArrivalTimeInNs( long long arrivalTime )			{ mArrivalTimeInNs = arrivalTime; }
+	void			setPublishTimeInNs( long long publishTime )			{ mPublishTimeInNs = publishTime; }
 
 private:
 	Image			mImage;
 	unsigned int	mSequenceNumber;
-	float			mTimestampInSec;
+	long long		mTimestampInNs;
+	long long		mArrivalTimeInNs;
+	long long		mPublishTimeInNs;
 };
 
 }
\ No newline at end of file
@@ -23,33 +23,21 @@
 */
 #pragma once
 
-#define WIN32_LEAN_AND_MEAN 
-#define NOMINMAX 
-#include <windows.h>
-
 namespace RDShow
 {
 
 /*
-	CriticalSectionEnterer
-
-	A RAII-style object (Resource Acquisition Is Initialization) that facilitates
-	the use of CriticalSections
+	Clock
 
-	Information about Windows CriticalSection can be found here:
-	http://msdn.microsoft.com/en-us/library/windows/desktop/ms682530(v=vs.85).aspx
+	The monotonic host clock used to timestamp the arrival of the images. It's 
+	std::chrono::steady_clock: QueryPerformanceCounter on Windows, CLOCK_MONOTONIC on Linux. 
+	Its origin is arbitrary (usually the boot time) but it's the same for the whole system, 
+	so it can be used to align images with other sources timestamped with the same clock.
 */
-class CriticalSectionEnterer
+class Clock
 {
 public:
-	CriticalSectionEnterer( CRITICAL_SECTION& criticalSection );
-	~CriticalSectionEnterer();
-
-private:
-	CriticalSectionEnterer( CriticalSectionEnterer& other );
-	CriticalSectionEnterer& operator=( CriticalSectionEnterer& other );
-	
-	CRITICAL_SECTION& mCriticalSection;
+	static long long	getTimeInNs();
 };
 
-}
\ No newline at end of file
+}
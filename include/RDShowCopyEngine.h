@@ -0,0 +1,74 @@
+/*
+   The MIT License (MIT) (http://opensource.org/licenses/MIT)
+   
+   Copyright (c) 2015 Jacques Menuet
+   
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+   
+   The above copyright notice and this permission notice shall be included in all
+   copies or substantial portions of the Software.
+   
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+*/
+#pragma once
+
+#include <cstddef>
+
+namespace RDShow
+{
+
+/*
+	CopyEngine
+
+	Copies large blocks of memory such as image data. 
+
+	A plain memcpy of a big frame (an 8K BGRX32 image is more than 25MB) goes through the 
+	cache hierarchy and evicts everything else from the last level cache, including the data
+	the analysis threads are working on. Above a size threshold, the CopyEngine uses streaming 
+	(non-temporal) stores that write to memory without polluting the caches. Below it, 
+	memcpy is faster as the destination is likely to be read again soon.
+
+	Very large copies can optionally be split in chunks copied in parallel by the TaskScheduler
+	threads, which helps saturate the memory bandwidth on multi-channel systems.
+
+	The thresholds depend on the machine (cache sizes, number of memory channels). 
+	The RapaDirectShowCopyBenchmark sample measures the crossover points.
+	The settings are global and meant to be configured once at startup.
+*/
+class CopyEngine
+{
+public:
+	static void				copy( void* destination, const void* source, std::size_t numBytes );
+	
+	static void				copyNonTemporal( void* destination, const void* source, std::size_t numBytes );
+	static void				copyParallel( void* destination, const void* source, std::size_t numBytes, unsigned int numThreads, bool nonTemporal );
+
+	static bool				isNonTemporalSupported();
+	
+	static std::size_t		getNonTemporalThreshold()							{ return mNonTemporalThreshold; }
+	static void				setNonTemporalThreshold( std::size_t numBytes )		{ mNonTemporalThreshold = numBytes; }
+	static std::size_t		getParallelThreshold()								{ return mParallelThreshold; }
+	static void				setParallelThreshold( std::size_t numBytes )		{ mParallelThreshold = numBytes; }
+	static unsigned int		getMaxNumThreads()									{ return mMaxNumThreads; }
+	static void				setMaxNumThreads( unsigned int numThreads )			{ mMaxNumThreads = numThreads; }
+
+private:
+	static void				copyChunk( void* destination, const void* source, std::size_t numBytes, bool nonTemporal );
+
+	static std::size_t		mNonTemporalThreshold;
+	static std::size_t		mParallelThreshold;
+	static unsigned int		mMaxNumThreads;			// 1 means no parallel copies
+};
+
+}
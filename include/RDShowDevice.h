@@ -25,19 +25,31 @@
 
 #include <string>
 #include <vector>
+#include <deque>
+#include <future>
+#include <condition_variable>
 #include "RDShowImage.h"
 #include "RDShowCaptureSettings.h"
 #include "RDShowCapturedImage.h"
+#include "RDShowLatencyHistogram.h"
+#include "RDShowListenerList.h"
+#include "RDShowFrameSubscription.h"
+#include "RDShowLock.h"
+#include "RDShowThread.h"
 
 namespace RDShow
 {
 
 class DeviceManager;
 class DeviceInternals;	
+class DeviceWorker;
 
 /*
 	Device
 
+	A capture device. What's specific to the backend (DirectShow, synthetic test patterns...)
+	is handled by the DeviceInternals object the Device owns.
+
 	Strings are UTF-8 encoded.
 */
 class Device
@@ -46,16 +58,190 @@ public:
 	DeviceManager*					getParentDeviceManager() const			{ return mParentDeviceManager; }
 	const std::string&				getName() const							{ return mName; }
 	const std::string&				getPath() const							{ return mPath; }
-	const CaptureSettingsList&		getSupportedCaptureSettingsList() const	{ return mSupportedCaptureSettingsList; }
+	const CaptureSettingsList&		getSupportedCaptureSettingsList() const;
 
 	bool							isCapturing() const;
 	bool							startCapture( std::size_t captureSettingsIndex );
 	bool							getStartedCaptureSettingsIndex( unsigned int& index ) const;
-	const CapturedImage*			getCapturedImage() const				{ return mCapturedImage; }
+	const CapturedImage*			getCapturedImage() const;
 	void							stopCapture();
 
+	// Start or stop the capture from another thread, as building and tearing down the capture 
+	// graph can take a while with some drivers. The device must not be used meanwhile, except 
+	// through the methods that can be called from any thread, until the future is ready.
+	// The calls are run in order by a TaskScheduler worker (see TaskScheduler::post()): 
+	// overlapping calls on a device never run concurrently, a stop queued after a start 
+	// stops what it started. Without workers, they run on the calling thread. Deleting the 
+	// device waits for the pending ones
+	std::future<bool>				startCaptureAsync( std::size_t captureSettingsIndex );
+	std::future<void>				stopCaptureAsync();
+
+	// By default, only the latest image is kept until the next update. With a depth of N, 
+	// up to N images are queued and the update notifies the listeners of each of them in order.
+	// Can't be changed while capturing
+	bool							setFrameQueueDepth( unsigned int depth );
+	unsigned int					getFrameQueueDepth() const;
+
 	void							update();
 
+	// Threaded mode: the device gets its own worker thread (see DeviceWorker) that updates it 
+	// as soon as an image arrives, from the start of the capture to its stop. The Listeners 
+	// are then called from that thread and nobody else should update the device: the 
+	// DeviceManager update skips it and it shouldn't be waited for with waitForAnyImage().
+	// Can't be changed while capturing
+	bool							setWorkerThreadEnabled( bool enabled );
+	bool							isWorkerThreadEnabled() const			{ return mWorker!=NULL; }
+
+	// Batch mode, for offline and throughput-oriented consumers that want every image: the 
+	// application takes all the images queued since its previous call at once with takeImages(), 
+	// instead of an update going through them one by one. The Listeners aren't called: the 
+	// update only gives back the claim of waitForAnyImage(), and the worker thread of the 
+	// threaded mode isn't started. The frame queue depth is then how many images can queue 
+	// while the application processes the previous batch: the queue holds twice that, and at 
+	// least 2 images. Can't be changed while capturing
+	bool							setBatchModeEnabled( bool enabled );
+	bool							isBatchModeEnabled() const;
+
+	/*
+		Device::ImageBatch
+
+		The images taken by takeImages(), oldest first. It's a view on the frame queue: 
+		nothing is copied. As the queue is a ring, the images are in up to two ranges of 
+		contiguous CapturedImages, the second one being only used when the batch wraps around 
+		the end of the ring.
+	*/
+	class ImageBatch
+	{
+	public:
+		ImageBatch()
+			: mFirstImages(NULL),
+			  mNumFirstImages(0),
+			  mSecondImages(NULL),
+			  mNumSecondImages(0)
+		{
+		}
+
+		std::size_t				size() const			{ return mNumFirstImages + mNumSecondImages; }
+		bool					empty() const			{ return size()==0; }
+		const CapturedImage&	operator[]( std::size_t index ) const	
+		{ 
+			return index<mNumFirstImages ? mFirstImages[index] : mSecondImages[index-mNumFirstImages]; 
+		}
+		const CapturedImage&	front() const			{ return (*this)[0]; }
+		const CapturedImage&	back() const			{ return (*this)[size()-1]; }
+
+		// The two ranges, for loops that want plain pointers
+		const CapturedImage*	getFirstImages( std::size_t& numImages ) const	{ numImages = mNumFirstImages; return mFirstImages; }
+		const CapturedImage*	getSecondImages( std::size_t& numImages ) const	{ numImages = mNumSecondImages; return mSecondImages; }
+
+	private:
+		friend class DeviceInternals;
+		const CapturedImage*	mFirstImages;
+		std::size_t				mNumFirstImages;
+		const CapturedImage*	mSecondImages;
+		std::size_t				mNumSecondImages;
+	};
+
+	// Give back the images of the previous batch and take all the images queued since then. 
+	// Taking a batch costs the same whatever its size. Return whether there were new images: 
+	// if not, or if the device isn't in batch mode or isn't capturing, the batch is empty. 
+	// The images stay valid until the next call or the stop of the capture, except for the 
+	// newest one: it's the captured image (see getCapturedImage()) until new images are taken. 
+	// To be called by a single thread, which can wait for the next batch with waitForNextImage() 
+	// or an ImageWaiter
+	bool							takeImages( ImageBatch& batch );
+
+	// The scheduling settings (priority, real-time policy, CPU affinity) of the threads that 
+	// run for the device:
+	// - CaptureThread: the thread the backend delivers the images from (the DirectShow callback 
+	//   thread, the synthetic capture thread...), configured when its first image arrives,
+	// - WorkerThread: the worker of the threaded mode, configured when it starts.
+	// Applied when the capture starts. What the system refuses degrades gracefully (see 
+	// Thread::applyToCurrentThread()) and getEffectiveThreadSettings() tells what the thread 
+	// actually got, once it's configured: it returns false until then
+	enum ThreadRole
+	{
+		CaptureThread,
+		WorkerThread,
+		NumThreadRoles
+	};
+
+	void							setThreadSettings( ThreadRole role, const Thread::Settings& settings );
+	const Thread::Settings&			getThreadSettings( ThreadRole role ) const;
+	bool							getEffectiveThreadSettings( ThreadRole role, Thread::Settings& settings ) const;
+
+	// The CPUs the worker thread may run on (bit 0 for CPU 0), 0 for any. Shortcut for the 
+	// cpuMask of the WorkerThread settings
+	void							setWorkerThreadAffinity( unsigned long long cpuMask )	{ mThreadSettings[WorkerThread].cpuMask = cpuMask; }
+	unsigned long long				getWorkerThreadAffinity() const			{ return mThreadSettings[WorkerThread].cpuMask; }
+
+	// Block until the device has an image newer than the given sequence number, ready to be  
+	// picked up by the next update. Can be called from any thread, the update still has to be  
+	// done by the thread that owns the Device. Return false on timeout, or when the device 
+	// isn't capturing or stops doing so
+	bool							waitForNextImage( unsigned int lastSequenceNumber, unsigned int timeoutInMs );
+
+	// The latest image slot, for threads that want the newest image now without updating the 
+	// device (see LatestImageSlot). It costs one more copy of each image on the capture thread, 
+	// so it's off by default. Can't be changed while capturing
+	bool							setLatestImageSlotEnabled( bool enabled );
+	bool							isLatestImageSlotEnabled() const;
+
+	// Copy the newest image into the destination, which must have the image format of the 
+	// started capture settings. Return false if there's no image newer than lastSequenceNumber, 
+	// or if the slot isn't enabled or the device isn't capturing. Can be called from any thread: 
+	// the readers never hold up the capture thread and don't wait for each other, but a 
+	// capture can't stop while they copy
+	bool							readLatestImage( CapturedImage& destination, unsigned int lastSequenceNumber=0 ) const;
+
+	// The sequence number of the latest image published for the update, 0 when the device 
+	// isn't capturing. Can be called from any thread
+	unsigned int					getPublishedSequenceNumber() const;
+
+	/*
+		Device::ImageWaiter
+
+		The asynchronous version of waitForNextImage(), for event-driven code that shouldn't 
+		dedicate a thread to each device (asio services, coroutines: see RDShowFrameAwaitable.h). 
+		A waiting ImageWaiter is a node in a list of the device: any number of them can wait 
+		at once and nothing is allocated.
+
+		onImageAvailable() is called once per wait, from the capture thread of the backend as 
+		soon as an image newer than the one waited for is published, with its sequence number. 
+		Or with 0 from the thread that stops the capture. It's called on the delivery path: like 
+		a RealTimeListener, it must return quickly and not call the device. Typically it posts 
+		the actual work to an executor. As with waitForNextImage(), the image is then picked up 
+		by the next update, which still has to be done by the thread that owns the device.
+	*/
+	class ImageWaiter
+	{
+	public:
+		ImageWaiter()
+			: mNextWaiter(NULL),
+			  mLastSequenceNumber(0),
+			  mIsWaiting(false)
+		{
+		}
+		virtual ~ImageWaiter() {}
+		virtual void onImageAvailable( Device* device, unsigned int sequenceNumber ) = 0;
+
+	private:
+		friend class DeviceInternals;
+		ImageWaiter*	mNextWaiter;				// The waiter list is guarded by the device
+		unsigned int	mLastSequenceNumber;
+		bool			mIsWaiting;
+	};
+
+	// Return false, without calling the waiter, when there's no need to wait: an image newer 
+	// than lastSequenceNumber is already available or the device isn't capturing (see 
+	// getPublishedSequenceNumber()). A waiter waits for one image at a time. Can be called 
+	// from any thread, even from onImageAvailable() to wait for the next image
+	bool							asyncWaitForNextImage( unsigned int lastSequenceNumber, ImageWaiter* waiter );
+
+	// Return whether the waiter was still waiting. If not, onImageAvailable() may be running: 
+	// the waiter must not be deleted before it returns
+	bool							cancelWaitForNextImage( ImageWaiter* waiter );
+
 	class Listener
 	{
 	public:
@@ -65,12 +251,163 @@ public:
 		virtual void onDeviceStopping( Device* /*device*/ ) {}
 	};
 
+	// Can be called from any thread, even while capturing or from a Listener: the thread that 
+	// calls the Listeners never waits for it (see ListenerList). A removed Listener may still 
+	// get the call in progress on another thread, and must not be deleted before that returns: 
+	// after the next update or once the capture stopped
 	void							addListener( Listener* listener );
 	bool							removeListener( Listener* listener );
 
+	/*
+		Device::FrameCounters
+
+		How many frames went through the device since it was created, to detect consumers 
+		that can't keep up. Every image the driver delivers is, in the end, either consumed 
+		by an update, overwritten by a newer one before the update (without frame queue), 
+		dropped because the frame queue was full, or still waiting for the next update. 
+		The skipped frames are the gaps in the sequence numbers the updates (and so the 
+		Listeners) saw: overwritten and dropped frames, as observed by the consumer.
+	*/
+	class FrameCounters
+	{
+	public:
+		FrameCounters()
+			: numDeliveredFrames(0),
+			  numConsumedFrames(0),
+			  numOverwrittenFrames(0),
+			  numDroppedFrames(0),
+			  numSkippedFrames(0)
+		{
+		}
+
+		unsigned long long			numDeliveredFrames;
+		unsigned long long			numConsumedFrames;
+		unsigned long long			numOverwrittenFrames;
+		unsigned long long			numDroppedFrames;
+		unsigned long long			numSkippedFrames;
+	};
+
+	// Lock-free, can be called from any thread at any time. Each counter is read atomically, 
+	// but a frame in flight can show up in one counter and not yet in another
+	FrameCounters					getFrameCounters() const;
+
+	/*
+		Device::Statistics
+
+		What the device actually does, as opposed to the nominal frame rate of its 
+		CaptureSettings. Measured on the arrival of the images in the backend:
+		- frameRate: exponentially weighted moving average over about the last 16 images,
+		- windowedFrameRate and bytesPerSecond: over the last complete window of one second,
+		- frameIntervalJitterInNs: moving average of how far each interval between two images 
+		  is from the average interval.
+		Measured on the update side:
+		- queueDepth: the images published and not picked up by an update yet,
+		- the time spent in the Listeners and in the conversions (see ConversionStage) since 
+		  the latency histograms were reset.
+		The rates are 0 until enough images arrived and are reset when the capture starts.
+	*/
+	class Statistics
+	{
+	public:
+		Statistics()
+			: frameRate(0),
+			  windowedFrameRate(0),
+			  bytesPerSecond(0),
+			  frameIntervalJitterInNs(0),
+			  queueDepth(0),
+			  numListenerCalls(0),
+			  totalListenerTimeInNs(0),
+			  numConversions(0),
+			  totalConversionTimeInNs(0)
+		{
+		}
+
+		double						getAverageListenerTimeInNs() const		{ return numListenerCalls>0 ? static_cast<double>(totalListenerTimeInNs) / numListenerCalls : 0; }
+		double						getAverageConversionTimeInNs() const	{ return numConversions>0 ? static_cast<double>(totalConversionTimeInNs) / numConversions : 0; }
+
+		double						frameRate;
+		double						windowedFrameRate;
+		double						bytesPerSecond;
+		double						frameIntervalJitterInNs;
+		unsigned int				queueDepth;
+		unsigned long long			numListenerCalls;
+		long long					totalListenerTimeInNs;
+		unsigned long long			numConversions;
+		long long					totalConversionTimeInNs;
+	};
+
+	// Lock-free, can be called from any thread at any time
+	Statistics						getStatistics() const;
+
+	// Where the time goes between the arrival of an image and the end of its processing. 
+	// Each stage has its own LatencyHistogram:
+	// - DeliveryStage: from the arrival to the publication of the image for the update, 
+	//   the RealTimeListeners and the copy of the buffer included,
+	// - QueueingStage: from the publication to the pickup by the update,
+	// - ListenerStage: each call to a Listener's onDeviceCapturedImage(), 
+	// - ConversionStage: each ImageConverter update, when the converter is given the histogram,
+	// - EndToEndStage: from the arrival to the return of the last Listener.
+	// The histograms record from any thread and can be read or reset at any time
+	enum LatencyStage
+	{
+		DeliveryStage,
+		QueueingStage,
+		ListenerStage,
+		ConversionStage,
+		EndToEndStage,
+		NumLatencyStages
+	};
+
+	LatencyHistogram&				getLatencyHistogram( LatencyStage stage );
+	const LatencyHistogram&			getLatencyHistogram( LatencyStage stage ) const;
+	void							resetLatencyHistograms();
+
+	// The frames the Listener missed since it was added. Return false if it isn't a Listener
+	// of this device. Can be called from any thread
+	bool							getListenerSkippedFrameCount( Listener* listener, unsigned long long& count ) const;
+
+	/*
+		Device::RealTimeListener
+
+		Receives each image on the capture thread of the backend, as soon as it arrives, 
+		without waiting for the next update. The image is borrowed: it wraps the buffer of 
+		the driver and is only valid during the call. It is called before the image is 
+		queued for the update (and the regular Listeners), even when the queue is full.
+
+		What a RealTimeListener may do in onDeviceCapturedImage():
+		- read the image, copy the parts it needs and hand them over to another thread, 
+		- nothing that blocks or takes long: the backend can't deliver the next image meanwhile 
+		  and the driver may drop it,
+		- not call the Device or DeviceManager, except for the const getters that don't depend 
+		  on the capture (name, path, supported capture settings). Starting/stopping the capture, 
+		  adding/removing listeners or deleting the device from there deadlocks or crashes,
+		- not keep the image or a pointer to its bytes after returning.
+
+		Real-time listeners can be added and removed from any thread, even while capturing, 
+		without ever holding up the capture thread. A removed RealTimeListener may still get 
+		the call in progress, and must not be deleted before the next image arrives or the 
+		capture stops.
+	*/
+	class RealTimeListener
+	{
+	public:
+		virtual ~RealTimeListener() {}
+		virtual void onDeviceCapturedImage( Device* device, const CapturedImage& image ) = 0;
+	};
+
+	bool							addRealTimeListener( RealTimeListener* listener );
+	bool							removeRealTimeListener( RealTimeListener* listener );
+
+	// Per-consumer queues with their own policy for slow consumers, see FrameSubscription. 
+	// The Device owns them. Can only be created and deleted while the device isn't capturing, 
+	// and the consumer must not use the subscription anymore when it's deleted.
+	// The queue depth is at least 1, the block timeout only matters for the Block policy
+	FrameSubscription*				createFrameSubscription( FrameSubscription::Policy policy, unsigned int queueDepth, unsigned int blockTimeoutInMs=100 );
+	bool							deleteFrameSubscription( FrameSubscription* subscription );
+
 protected:
 	friend class DeviceManager;
-	Device( DeviceManager* parentDeviceManager, void* monikerSharedPtrAsVoidPtr, const std::string& name, const std::string& path );
+	Device( DeviceManager* parentDeviceManager, DeviceInternals* internals, const std::string& name, const std::string& path );
 	virtual ~Device();
 
 private:
@@ -78,16 +415,35 @@ private:
 	std::string						mName;
 	std::string						mPath;
 
-	CaptureSettingsList				mSupportedCaptureSettingsList;
-	std::vector<std::size_t>		mMediaTypeIndices;			// For each CaptureSettings, contains the index of the corresponding MediaType
-
 	DeviceInternals*				mInternals;
+	DeviceWorker*					mWorker;
+	Thread::Settings				mThreadSettings[NumThreadRoles];
 	
 	unsigned int					mStartedCaptureSettingsIndex;
-	CapturedImage*					mCapturedImage;
 	
-	typedef	std::vector<Listener*> Listeners; 
+	struct ListenerEntry
+	{
+		Listener*					listener;
+		unsigned long long			numSkippedFramesWhenAdded;
+	};
+	typedef	ListenerList<ListenerEntry> Listeners;
 	Listeners						mListeners;
+
+	// The pending startCaptureAsync() and stopCaptureAsync(), run by a single task at a time. 
+	// The one running stays at the front of the queue until it's done
+	struct CaptureCommand
+	{
+		bool						isStart;
+		std::size_t					captureSettingsIndex;
+		std::promise<bool>			startPromise;
+		std::promise<void>			stopPromise;
+	};
+	static void						runCaptureCommands( void* context, unsigned int begin, unsigned int end );
+	void							postCaptureCommand( CaptureCommand* command );
+
+	Lock							mCaptureCommandsLock;
+	std::deque<CaptureCommand*>		mCaptureCommands;		// Guarded by mCaptureCommandsLock
+	std::condition_variable_any		mCaptureCommandsDone;	// Notified when the queue empties
 };
 
 typedef std::vector<Device*> Devices;
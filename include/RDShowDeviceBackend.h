@@ -0,0 +1,64 @@
+/*
+   The MIT License (MIT) (http://opensource.org/licenses/MIT)
+   
+   Copyright (c) 2015 Jacques Menuet
+   
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+   
+   The above copyright notice and this permission notice shall be included in all
+   copies or substantial portions of the Software.
+   
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+*/
+#pragma once
+
+#include <string>
+#include <vector>
+
+namespace RDShow
+{
+
+class DeviceInternals;
+
+/*
+	DeviceBackend
+
+	A source of Devices for the DeviceManager: DirectShow on Windows, synthetic test pattern 
+	generators anywhere (see SyntheticDeviceBackend). 
+
+	The backend lists the devices currently available, identified by a unique path, and 
+	creates the DeviceInternals of a given device when the DeviceManager creates the Device.
+	Strings are UTF-8 encoded.
+*/
+class DeviceBackend
+{
+public:
+	virtual ~DeviceBackend() {}
+
+	struct DeviceInfo
+	{
+		std::string name;
+		std::string path;
+	};
+	typedef std::vector<DeviceInfo> DeviceInfos;
+
+	virtual bool				enumerateDevices( DeviceInfos& deviceInfos ) = 0;
+	virtual DeviceInternals*	createDeviceInternals( const std::string& path ) = 0;
+
+	// Return true when devices might have been added or removed since the last call.
+	// The DeviceManager then enumerates the devices again at its next update
+	virtual bool				hasDeviceListChanged() = 0;
+};
+
+}
@@ -24,80 +24,224 @@
 #pragma once
 
 #include <vector>
-#include "RDShowCriticalSectionEnterer.h"
-#include "RDShowCOMObjectSharedPtr.h"
+#include <atomic>
 #include "RDShowCaptureSettings.h"
-#include "RDShowMemoryBuffer.h"
-
-#define WIN32_LEAN_AND_MEAN 
-#define NOMINMAX 
-#include <windows.h>
-#include <dshow.h>
-// See http://social.msdn.microsoft.com/forums/en-US/windowssdk/thread/ed097d2c-3d68-4f48-8448-277eaaf68252/
-#pragma include_alias( "dxtrans.h", "qedit.h" )
-#define __IDxtCompositor_INTERFACE_DEFINED__
-#define __IDxtAlphaSetter_INTERFACE_DEFINED__
-#define __IDxtJpeg_INTERFACE_DEFINED__
-#define __IDxtKey_INTERFACE_DEFINED__
-#include "qedit.h"
+#include "RDShowCapturedImage.h"
+#include "RDShowFrameRing.h"
+#include "RDShowListenerList.h"
+#include "RDShowLatestImageSlot.h"
+#include "RDShowImageNotifier.h"
+#include "RDShowLock.h"
+#include "RDShowThread.h"
+#include "RDShowFrameSubscription.h"
+#include "RDShowDevice.h"
 
 namespace RDShow
 {
 
+/*
+	DeviceInternals
+
+	The backend-specific part of a Device. A backend (DirectShow, synthetic test patterns...) 
+	derives from this class to:
+	- enumerate the capture modes the device supports (filling mSupportedCaptureSettingsList),
+	- start and stop the capture (startBackendCapture() and stopBackendCapture()),
+	- deliver the captured buffers by calling deliverBuffer() from its capture thread.
+
+	The Device, on its own thread, picks up the delivered images with updateCapturedImage().
+	Each buffer is copied once, from the backend thread, and how the images are exchanged 
+	depends on the frame queue depth:
+	- 0 (default): only the latest image matters. Both sides exchange CapturedImages through 
+	  a triple buffer: the backend copies each buffer into the back image, outside of any lock, 
+	  then swaps it with the middle one which holds the latest complete image. The Device swaps 
+	  the middle image with the front one it reads from. The lock is only held for these swaps.
+	- N: up to N images are queued in a lock-free FrameRing and the Device gets every one of 
+	  them, in order. When the queue is full, the backend drops the new images.
+	In batch mode, there's always a FrameRing and takeImages() gets all its images at once.
+	When enabled, the LatestImageSlot gets a copy of every image, even the ones the queue drops.
+
+	The Device::RealTimeListeners are called by deliverBuffer() itself, on the backend thread, 
+	with an image that wraps the delivered buffer. The FrameSubscriptions are then given the 
+	buffer to copy into their own queues.
+
+	Derived classes must stop the capture in their destructor as the base class can't call 
+	stopBackendCapture() from its own.
+*/
 class DeviceInternals 
 {
 public:
-	DeviceInternals( COMObjectSharedPtr<IMoniker> moniker );
+	DeviceInternals();
 	virtual ~DeviceInternals();
 
-	class VideoMediaType
-	{
-	public:
-		VideoMediaType();					
-		LONG				width ;
-		LONG				height;
-		bool				needVerticalFlip;
-		LONGLONG			frameInterval;
-		GUID				subType;
-		
-				
-		std::string			getSubTypeName() const		{ return getSubTypeName(subType); }
-		static std::string	getSubTypeName( const GUID& mediaType );
-		
-		float				getFrameRate() const;
-
-		std::string			toString() const;
-
-		bool				operator==( const VideoMediaType& other ) const;
-		bool				operator!=( const VideoMediaType& other ) const;
-	};
-	typedef std::vector<VideoMediaType> VideoMediaTypes;
-	const VideoMediaTypes&	getSupportedVideoMediaTypes() const { return mSupportedVideoMediaTypes; }
-
-	//void					update();	
-
-	bool					startCapture( std::size_t indexMediaType );
-	bool					stopCapture();
-	bool					isCapturing() const				{ return mIsCapturing; }
-	bool					getCapturedImage( MemoryBuffer& buffer, unsigned int& sequenceNumber, LONGLONG& timestamp ) const;
+	const CaptureSettingsList&	getSupportedCaptureSettingsList() const	{ return mSupportedCaptureSettingsList; }
 
+	bool						startCapture( std::size_t captureSettingsIndex );
+	bool						stopCapture();
+	bool						isCapturing() const				{ return mIsCapturing.load(); }
+	
+	// Can't be changed while capturing
+	bool						setFrameQueueDepth( unsigned int depth );
+	unsigned int				getFrameQueueDepth() const		{ return mFrameQueueDepth; }
+	bool						setBatchModeEnabled( bool enabled );
+	bool						isBatchModeEnabled() const		{ return mIsBatchMode; }
+	bool						setLatestImageSlotEnabled( bool enabled );
+	bool						isLatestImageSlotEnabled() const	{ return mIsLatestImageSlotEnabled; }
 
-private:
-	bool					initialize();
+	// Can be called from any thread, see Device::readLatestImage()
+	bool						readLatestImage( CapturedImage& destination, unsigned int lastSequenceNumber ) const;
+
+	// Move on to the next delivered image, if any. Return whether there was one.
+	// With a frame queue, call it until it returns false to drain the queue
+	bool						updateCapturedImage();
+	const CapturedImage*		getCapturedImage() const		{ return mCapturedImage; }		// NULL when not capturing
+
+	// Batch mode only, see Device::takeImages()
+	bool						takeImages( Device::ImageBatch& batch );
 
-	mutable CRITICAL_SECTION					mCriticalSection;
-	VideoMediaTypes								mSupportedVideoMediaTypes;
+	// Can be called from any thread, see Device::waitForNextImage()
+	bool						waitForNextImage( unsigned int lastSequenceNumber, unsigned int timeoutInMs );
 
-	COMObjectSharedPtr<IMoniker>				mMoniker;
-	COMObjectSharedPtr<IGraphBuilder>			mGraphBuilder;
-	COMObjectSharedPtr<ICaptureGraphBuilder2>	mCaptureGraphBuilder2;
-	COMObjectSharedPtr<ISampleGrabber>			mSampleGrabberFilter;
-	COMObjectSharedPtr<IBaseFilter>				mSourceFilter;
+	// Can be called from any thread, see Device::asyncWaitForNextImage()
+	bool						asyncWaitForNextImage( unsigned int lastSequenceNumber, Device::ImageWaiter* waiter );
+	bool						cancelWaitForNextImage( Device::ImageWaiter* waiter );
+
+	// Whether an image not seen by updateCapturedImage() yet is available. Can be called from any thread
+	bool						hasNewImage() const;
+	unsigned int				getPublishedSequenceNumber() const	{ return mPublishedSequenceNumber; }
+
+	// Notified when an image is published or the capture stops
+	ImageNotifier&				getImageNotifier()				{ return mImageNotifier; }
+
+	// The DeviceManager's notifier, to wait for several devices at once. Set before capturing
+	void						setSharedNotifier( ImageNotifier* notifier )	{ mSharedNotifier = notifier; }
+
+	// Only one thread at a time updates the Device: the one that claimed it. See DeviceManager::waitForAnyImage()
+	bool						tryClaim();
+	void						releaseClaim();
+
+	void						setParentDevice( Device* device );
+
+	// Lock-free, can be called from any thread
+	Device::FrameCounters		getFrameCounters() const;
+	Device::Statistics			getStatistics() const;
+	LatencyHistogram&			getLatencyHistogram( Device::LatencyStage stage );
+	const LatencyHistogram&		getLatencyHistogram( Device::LatencyStage stage ) const;
 	
-	class SampleGrabberCallback;
-	SampleGrabberCallback*						mSampleGrabberCallback;
-	bool										mIsCapturing;
-};
+	// Can be called from any thread, even while capturing
+	bool						addRealTimeListener( Device::RealTimeListener* listener );
+	bool						removeRealTimeListener( Device::RealTimeListener* listener );
+
+	// The settings the capture thread gets on its first image. Applied by the next start
+	void						setCaptureThreadSettings( const Thread::Settings& settings )	{ mCaptureThreadSettings = settings; }
+	bool						getEffectiveCaptureThreadSettings( Thread::Settings& settings ) const;
+
+	// Can't be called while capturing. The DeviceInternals owns the subscriptions
+	FrameSubscription*			createFrameSubscription( FrameSubscription::Policy policy, unsigned int queueDepth, unsigned int blockTimeoutInMs );
+	bool						deleteFrameSubscription( FrameSubscription* subscription );
+
+protected:
+	virtual bool				startBackendCapture( std::size_t captureSettingsIndex ) = 0;
+	virtual bool				stopBackendCapture() = 0;
+
+	// To be called by the backend from its capture thread, between startBackendCapture() and 
+	// the return of stopBackendCapture(). The timestamp is the sample time in nanoseconds
+	void						deliverBuffer( const unsigned char* bytes, unsigned int numBytes, long long timestampInNs );
 
+	CaptureSettingsList			mSupportedCaptureSettingsList;
+
+private:
+	DeviceInternals( const DeviceInternals& other );				// Not implemented on purpose
+	DeviceInternals& operator=( const DeviceInternals& other );		// Not implemented on purpose
+
+	void						deleteImages();
+	void						deleteLatestImageSlot();
+	void						onImagesConsumed( const CapturedImage& oldestImage, const CapturedImage& newestImage, std::size_t numImages );
+	void						updateArrivalStatistics( long long arrivalTimeInNs, unsigned int numBytes );
+	void						resetStatistics();
+	void						notifyImageWaiters();
+
+	// Each counter has a single writer thread, which doesn't need an atomic read-modify-write 
+	static void					incrementCounter( std::atomic<unsigned long long>& counter, unsigned long long value=1 )
+	{
+		counter.store( counter.load( std::memory_order_relaxed ) + value, std::memory_order_relaxed );
+	}
+
+	Device*						mParentDevice;
+	unsigned int				mFrameQueueDepth;
+	bool						mIsBatchMode;
+	ImageFormat					mImageFormat;			// Of the started CaptureSettings
+
+	// The backend thread goes through them without lock
+	typedef ListenerList<Device::RealTimeListener*> RealTimeListeners;
+	RealTimeListeners			mRealTimeListeners;
+
+	// Only changed while not capturing, so the backend thread can go through them without lock
+	typedef std::vector<FrameSubscription*> FrameSubscriptions;
+	FrameSubscriptions			mFrameSubscriptions;
+
+	const CapturedImage*		mCapturedImage;			// The image the Device sees
+
+	// Triple buffer, when there's no frame queue
+	Lock						mLock;
+	CapturedImage*				mBackImage;				// Written by the backend
+	CapturedImage*				mMiddleImage;			// Latest complete image. Guarded by mLock
+	CapturedImage*				mFrontImage;			// Read by the Device. Also the blank image seen before the first one arrives
+	bool						mHasNewImage;			// Whether mMiddleImage wasn't taken yet. Guarded by mLock
+
+	// Latest image slot. The readers count themselves in so it's only deleted once they're done
+	bool						mIsLatestImageSlotEnabled;
+	std::atomic<LatestImageSlot*>	mLatestImageSlot;
+	mutable std::atomic<unsigned int>	mNumLatestImageSlotReaders;
+
+	// Frame queue
+	FrameRing<CapturedImage>*	mFrameRing;
+	std::size_t					mNumHeldRingImages;		// The slots of mFrameRing the Device holds, mCapturedImage being the newest
+
+	unsigned int				mImageSequenceNumber;	// Only used by the backend
+	std::atomic<bool>			mIsCapturing;
+
+	// To wake up the threads waiting for an image
+	std::atomic<unsigned int>	mPublishedSequenceNumber;	// Of the latest image available to updateCapturedImage()
+	std::atomic<unsigned int>	mConsumedSequenceNumber;	// Of mCapturedImage
+	ImageNotifier				mImageNotifier;
+	ImageNotifier*				mSharedNotifier;
+	std::atomic<bool>			mIsClaimed;
+
+	// The Device::ImageWaiters, in a list from the latest to the oldest
+	Lock						mImageWaitersLock;
+	Device::ImageWaiter*		mImageWaiters;			// Guarded by mImageWaitersLock
+	std::atomic<bool>			mHasImageWaiters;
+
+	// See Device::FrameCounters. Never reset
+	std::atomic<unsigned long long>	mNumDeliveredFrames;	// Written by the backend
+	std::atomic<unsigned long long>	mNumOverwrittenFrames;	// Written by the backend
+	std::atomic<unsigned long long>	mNumDroppedFrames;		// Written by the backend
+	std::atomic<unsigned long long>	mNumConsumedFrames;		// Written by the Device
+	std::atomic<unsigned long long>	mNumSkippedFrames;		// Written by the Device
+
+	LatencyHistogram			mLatencyHistograms[Device::NumLatencyStages];
+
+	bool						mIsCaptureThreadNamed;	// In the Tracer. Only used by the backend
+
+	Thread::Settings			mCaptureThreadSettings;
+	bool						mIsCaptureThreadConfigured;			// Only used by the backend
+	mutable Lock				mEffectiveCaptureThreadSettingsLock;
+	Thread::Settings			mEffectiveCaptureThreadSettings;	// Guarded by mEffectiveCaptureThreadSettingsLock
+	bool						mHasEffectiveCaptureThreadSettings;	// Guarded by mEffectiveCaptureThreadSettingsLock
+
+	// See Device::Statistics. The arrival statistics are computed by the backend and published 
+	// in the atomics
+	long long					mLastArrivalTimeInNs;
+	double						mAverageFrameIntervalInNs;
+	double						mAverageFrameIntervalDeviationInNs;
+	long long					mWindowStartTimeInNs;
+	unsigned int				mWindowNumFrames;
+	unsigned long long			mWindowNumBytes;
+	std::atomic<double>			mFrameRate;
+	std::atomic<double>			mWindowedFrameRate;
+	std::atomic<double>			mBytesPerSecond;
+	std::atomic<double>			mFrameIntervalJitterInNs;
+	std::atomic<unsigned int>	mQueueDepth;			// Incremented by the backend, decremented by the Device
+};
 
-}
\ No newline at end of file
+}
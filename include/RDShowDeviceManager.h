@@ -28,6 +28,15 @@
 namespace RDShow
 {
 
+class DeviceBackend;
+
+/*
+	DeviceManager
+
+	Maintains the list of Devices provided by its DeviceBackends. On Windows, the DirectShow
+	backend is added by default. Other backends (see SyntheticDeviceBackend) can be added 
+	with addBackend(). The list is refreshed at the next update.
+*/
 class DeviceManager
 {
 public:
@@ -37,6 +46,31 @@ public:
 	void			update();
 	const Devices&	getDevices() const;
 
+	void			addBackend( DeviceBackend* backend );		// The DeviceManager takes ownership of the backend
+
+	// In threaded mode, each device has its own worker thread that updates it and calls its 
+	// Listeners (see Device::setWorkerThreadEnabled()), and the DeviceManager update only 
+	// maintains the device list. Optionally, the worker of the Nth device is pinned to the 
+	// Nth CPU (modulo their number). Applies to the devices added later and to the current 
+	// ones, except those that are capturing: return false if there were some
+	bool			setThreadedMode( bool enabled, bool pinWorkerThreads=false );
+	bool			isThreadedMode() const;
+
+	// The scheduling settings of the capture or worker threads of all the devices, the current 
+	// ones and those added later (see Device::setThreadSettings()). They replace what was set 
+	// on each device. Pinned worker threads keep their CPU. The TaskScheduler, shared by all 
+	// the devices, has its own (see TaskScheduler::setWorkerThreadSettings())
+	void						setThreadSettings( Device::ThreadRole role, const Thread::Settings& settings );
+	const Thread::Settings&		getThreadSettings( Device::ThreadRole role ) const;
+
+	// Block until at least one of the given devices has a new image, or the timeout expires. 
+	// Return whether some devices are ready, in which case they're listed in readyDevices.
+	// The ready devices are claimed by the calling thread: they aren't returned to any other 
+	// waiting thread and the DeviceManager update skips them, until the caller updates them 
+	// with Device::update(), which it must do. That way a few threads can service many devices.
+	// The device list must not change meanwhile (the backends shouldn't add or remove devices). 
+	bool			waitForAnyImage( const Devices& devices, Devices& readyDevices, unsigned int timeoutInMs );
+
 	class Listener
 	{
 	public:
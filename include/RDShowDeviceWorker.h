@@ -0,0 +1,84 @@
+/*
+   The MIT License (MIT) (http://opensource.org/licenses/MIT)
+   
+   Copyright (c) 2015 Jacques Menuet
+   
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+   
+   The above copyright notice and this permission notice shall be included in all
+   copies or substantial portions of the Software.
+   
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+*/
+#pragma once
+
+#include <thread>
+#include <atomic>
+#include "RDShowLock.h"
+#include "RDShowThread.h"
+
+namespace RDShow
+{
+
+class Device;
+class DeviceInternals;
+
+/*
+	DeviceWorker
+
+	The thread that updates a Device in threaded mode (see Device::setWorkerThreadEnabled()), 
+	as an active object: it sleeps until the device has a new image, then updates the device, 
+	which notifies the Listeners from this thread. Each device has its own worker, so a slow 
+	Listener only delays its own device.
+
+	The Device starts its worker once its capture is started and stops it before stopping 
+	the capture. When a Listener stops the capture from the worker thread itself, the worker 
+	can't be joined there: it leaves its loop and is joined by the next start or stop.
+*/
+class DeviceWorker
+{
+public:
+	DeviceWorker( Device* device, DeviceInternals* deviceInternals );
+	~DeviceWorker();
+
+	// Applied by the next start
+	void				setThreadSettings( const Thread::Settings& settings )	{ mThreadSettings = settings; }
+	const Thread::Settings&	getThreadSettings() const					{ return mThreadSettings; }
+
+	void				start();
+	void				stop();
+	bool				isRunning() const;
+
+	// What the thread got of its settings. Return false until the thread is started
+	bool				getEffectiveThreadSettings( Thread::Settings& settings ) const;
+
+private:
+	DeviceWorker( const DeviceWorker& other );				// Not implemented on purpose
+	DeviceWorker& operator=( const DeviceWorker& other );	// Not implemented on purpose
+
+	void				threadMain();
+	void				join();
+
+	Device*				mDevice;
+	DeviceInternals*	mDeviceInternals;
+	Thread::Settings	mThreadSettings;
+	std::thread			mThread;
+	std::atomic<bool>	mStopRequested;
+
+	mutable Lock		mEffectiveThreadSettingsLock;
+	Thread::Settings	mEffectiveThreadSettings;		// Guarded by mEffectiveThreadSettingsLock
+	bool				mHasEffectiveThreadSettings;	// Guarded by mEffectiveThreadSettingsLock
+};
+
+}
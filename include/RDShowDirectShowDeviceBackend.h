@@ -0,0 +1,79 @@
+/*
+   The MIT License (MIT) (http://opensource.org/licenses/MIT)
+   
+   Copyright (c) 2015 Jacques Menuet
+   
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+   
+   The above copyright notice and this permission notice shall be included in all
+   copies or substantial portions of the Software.
+   
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+*/
+#pragma once
+
+#include <vector>
+#include "RDShowDeviceBackend.h"
+#include "RDShowCOMObjectSharedPtr.h"
+
+#define WIN32_LEAN_AND_MEAN 
+#define NOMINMAX 
+#include <windows.h>
+#include <dshow.h>
+
+namespace RDShow
+{
+
+/*
+	DirectShowDeviceBackend
+
+	Enumerates the DirectShow video capture devices. 
+
+	The COM library is initialized for the thread that creates the backend (which should 
+	also be the one using the DeviceManager). Device arrival and removal are detected 
+	by hooking the WM_DEVICECHANGE message.
+*/
+class DirectShowDeviceBackend : public DeviceBackend
+{
+public:
+	DirectShowDeviceBackend();
+	virtual ~DirectShowDeviceBackend();
+
+	virtual bool				enumerateDevices( DeviceInfos& deviceInfos );
+	virtual DeviceInternals*	createDeviceInternals( const std::string& path );
+	virtual bool				hasDeviceListChanged();
+
+private:
+	struct MonikerInfo
+	{
+		std::string friendlyName;		
+		std::string devicePath;		
+		COMObjectSharedPtr<IMoniker> moniker;
+	};
+	typedef std::vector<MonikerInfo> MonikerInfos;
+
+	static bool					getMonikerInfo( COMObjectSharedPtr<IMoniker>& moniker, MonikerInfo& monikerInfo );
+	static bool					enumerateMonikers( MonikerInfos& monikerInfos );
+
+	static LRESULT CALLBACK		wndProcHook( int nCode, WPARAM wParam, LPARAM lParam );
+
+	MonikerInfos				mMonikerInfos;		// As found by the last enumeration
+	bool						mDeviceListChanged;
+
+	typedef std::vector<DirectShowDeviceBackend*> Instances;
+	static Instances			mInstances;
+	static HHOOK				mHookHandle;
+};
+
+}
@@ -0,0 +1,137 @@
+/*
+   The MIT License (MIT) (http://opensource.org/licenses/MIT)
+   
+   Copyright (c) 2015 Jacques Menuet
+   
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+   
+   The above copyright notice and this permission notice shall be included in all
+   copies or substantial portions of the Software.
+   
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+*/
+#pragma once
+
+// Only for the compilers with C++20 coroutines. The rest of the library stays C++11
+#if defined(__has_include)
+	#if __has_include(<coroutine>) && defined(__cpp_impl_coroutine)
+		#define RDSHOW_HAS_COROUTINES
+	#endif
+#endif
+
+#ifdef RDSHOW_HAS_COROUTINES
+
+#include <coroutine>
+#include "RDShowDevice.h"
+
+namespace RDShow
+{
+
+/*
+	Executor
+
+	Where the coroutines waiting for images are resumed. The application adapts its own 
+	executor to it, for asio for example:
+
+		class AsioExecutor : public RDShow::Executor
+		{
+		public:
+			AsioExecutor( asio::any_io_executor executor ) : mExecutor(executor) {}
+			virtual void execute( std::coroutine_handle<> handle ) { asio::post( mExecutor, handle ); }
+		private:
+			asio::any_io_executor mExecutor;
+		};
+
+	execute() is called from the capture thread of the device: it must return quickly.
+*/
+class Executor
+{
+public:
+	virtual ~Executor() {}
+	virtual void execute( std::coroutine_handle<> handle ) = 0;
+};
+
+/*
+	FrameAwaitable
+
+	Suspends a coroutine until the device has an image newer than the given sequence number, 
+	and resumes it on the executor. co_await returns the sequence number of the latest image, 
+	or 0 when the device isn't capturing or stops capturing. When an image is already there, 
+	the coroutine goes on right away without going through the executor.
+
+		unsigned int sequenceNumber = 0;
+		while ( (sequenceNumber = co_await RDShow::nextFrame( device, sequenceNumber, &executor ))!=0 )
+			...
+
+	The waiting coroutines cost no thread (see Device::ImageWaiter). Like waitForNextImage(), 
+	it only tells that an image is available: the device is updated as usual.
+	The coroutine must not be destroyed while it's suspended here.
+*/
+class FrameAwaitable : private Device::ImageWaiter
+{
+public:
+	FrameAwaitable( Device* device, unsigned int lastSequenceNumber, Executor* executor )
+		: mDevice(device),
+		  mLastSequenceNumber(lastSequenceNumber),
+		  mExecutor(executor),
+		  mHandle(),
+		  mSequenceNumber(0)
+	{
+	}
+
+	bool await_ready() const
+	{
+		return false;
+	}
+
+	bool await_suspend( std::coroutine_handle<> handle )
+	{
+		mHandle = handle;
+		if ( mDevice->asyncWaitForNextImage( mLastSequenceNumber, this ) )
+			return true;		// The coroutine may already be resumed on another thread: don't touch this anymore
+
+		mSequenceNumber = mDevice->getPublishedSequenceNumber();
+		return false;
+	}
+
+	unsigned int await_resume() const
+	{
+		return mSequenceNumber;
+	}
+
+private:
+	virtual void onImageAvailable( Device* /*device*/, unsigned int sequenceNumber )
+	{
+		mSequenceNumber = sequenceNumber;
+		if ( mExecutor )
+			mExecutor->execute( mHandle );
+		else
+			mHandle.resume();
+	}
+
+	Device*						mDevice;
+	unsigned int				mLastSequenceNumber;
+	Executor*					mExecutor;			// NULL to resume on the capture thread
+	std::coroutine_handle<>		mHandle;
+	unsigned int				mSequenceNumber;
+};
+
+inline FrameAwaitable nextFrame( Device* device, unsigned int lastSequenceNumber, Executor* executor )
+{
+	return FrameAwaitable( device, lastSequenceNumber, executor );
+}
+
+}
+
+#endif
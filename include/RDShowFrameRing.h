@@ -0,0 +1,151 @@
+/*
+   The MIT License (MIT) (http://opensource.org/licenses/MIT)
+   
+   Copyright (c) 2015 Jacques Menuet
+   
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+   
+   The above copyright notice and this permission notice shall be included in all
+   copies or substantial portions of the Software.
+   
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+*/
+#pragma once
+
+#include <vector>
+#include <atomic>
+#include <algorithm>
+#include <assert.h>
+
+namespace RDShow
+{
+
+/*
+	FrameRing
+
+	A bounded single-producer/single-consumer queue of preallocated objects (frames), 
+	without any lock. The objects are created once, as copies of a prototype, and are 
+	filled and read in place: nothing is allocated or copied by the ring itself.
+
+	The producer thread gets the next free slot with beginWrite(), fills it and publishes 
+	it with endWrite(). When all the slots are in use, beginWrite() returns NULL and it's 
+	up to the producer to drop its frame.
+
+	The consumer thread gets the oldest published slot with beginRead() and gives it back 
+	with endRead(). The consumer can hold several slots at once: endRead() always gives back 
+	the oldest ones it holds. beginReadAll() gets all the published slots at once, in constant 
+	time.
+*/
+template<class T>
+class FrameRing
+{
+public:
+	FrameRing( std::size_t capacity, const T& prototype )
+		: mSlots( capacity, prototype ),
+		  mPadding0(),
+		  mWriteIndex(0),
+		  mPadding1(),
+		  mReleaseIndex(0),
+		  mReadIndex(0),
+		  mPadding2()
+	{
+		assert( capacity>0 );
+	}
+
+	std::size_t	getCapacity() const		{ return mSlots.size(); }
+
+	// Producer side
+	T* beginWrite()
+	{
+		std::size_t writeIndex = mWriteIndex.load( std::memory_order_relaxed );
+		std::size_t releaseIndex = mReleaseIndex.load( std::memory_order_acquire );
+		if ( distance( releaseIndex, writeIndex )==mSlots.size() )
+			return NULL;
+		return &mSlots[ writeIndex % mSlots.size() ];
+	}
+
+	void endWrite()
+	{
+		std::size_t writeIndex = mWriteIndex.load( std::memory_order_relaxed );
+		mWriteIndex.store( next( writeIndex ), std::memory_order_release );
+	}
+
+	// Consumer side
+	T* beginRead()
+	{
+		std::size_t writeIndex = mWriteIndex.load( std::memory_order_acquire );
+		if ( mReadIndex==writeIndex )
+			return NULL;
+		T* slot = &mSlots[ mReadIndex % mSlots.size() ];
+		mReadIndex = next( mReadIndex );
+		return slot;
+	}
+
+	// Get all the published slots, as up to two ranges of contiguous slots: the second one is 
+	// only used when they wrap around the end of the ring. Return their total number
+	std::size_t beginReadAll( T*& firstSlots, std::size_t& numFirstSlots, T*& secondSlots, std::size_t& numSecondSlots )
+	{
+		std::size_t writeIndex = mWriteIndex.load( std::memory_order_acquire );
+		std::size_t numSlots = distance( mReadIndex, writeIndex );
+		std::size_t firstSlotIndex = mReadIndex % mSlots.size();
+		numFirstSlots = std::min( numSlots, mSlots.size() - firstSlotIndex );
+		numSecondSlots = numSlots - numFirstSlots;
+		firstSlots = numFirstSlots>0 ? &mSlots[firstSlotIndex] : NULL;
+		secondSlots = numSecondSlots>0 ? &mSlots[0] : NULL;
+		mReadIndex = writeIndex;
+		return numSlots;
+	}
+
+	// Give back the oldest slots the consumer holds
+	void endRead( std::size_t numSlots=1 )
+	{
+		std::size_t releaseIndex = mReleaseIndex.load( std::memory_order_relaxed );
+		assert( numSlots<=distance( releaseIndex, mReadIndex ) );		// Only what was read can be given back
+		mReleaseIndex.store( (releaseIndex + numSlots) % (2*mSlots.size()), std::memory_order_release );
+	}
+
+	// Number of slots published and not read yet. Exact on the consumer thread only
+	std::size_t getNumReadableSlots() const
+	{
+		return distance( mReadIndex, mWriteIndex.load( std::memory_order_acquire ) );
+	}
+
+private:
+	FrameRing( const FrameRing& other );				// Not implemented on purpose
+	FrameRing& operator=( const FrameRing& other );		// Not implemented on purpose
+
+	// The indices run modulo twice the capacity so a full ring can be told from an empty one
+	std::size_t next( std::size_t index ) const
+	{
+		return (index+1) % (2*mSlots.size());
+	}
+	
+	std::size_t distance( std::size_t from, std::size_t to ) const
+	{
+		return (to + 2*mSlots.size() - from) % (2*mSlots.size());
+	}
+
+	std::vector<T>				mSlots;
+
+	// Each index is written by a single thread. They're kept on separate cache lines 
+	// so the producer and the consumer don't invalidate each other's cache for nothing
+	char						mPadding0[64];
+	std::atomic<std::size_t>	mWriteIndex;		// Written by the producer
+	char						mPadding1[64];
+	std::atomic<std::size_t>	mReleaseIndex;		// Written by the consumer
+	std::size_t					mReadIndex;			// Only used by the consumer
+	char						mPadding2[64];
+};
+
+}
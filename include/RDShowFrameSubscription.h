@@ -0,0 +1,163 @@
+/*
+   The MIT License (MIT) (http://opensource.org/licenses/MIT)
+   
+   Copyright (c) 2015 Jacques Menuet
+   
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+   
+   The above copyright notice and this permission notice shall be included in all
+   copies or substantial portions of the Software.
+   
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+*/
+#pragma once
+
+#include <vector>
+#include <atomic>
+#include <condition_variable>
+#include "RDShowCapturedImage.h"
+#include "RDShowLock.h"
+
+namespace RDShow
+{
+
+class DeviceInternals;
+
+/*
+	FrameSubscription
+
+	A consumer of a Device's images with its own queue, consumed from its own thread, and its 
+	own policy for when it falls behind. A Device can feed several of them at once, a lossless 
+	recorder and a low-latency display for example, on top of its Listeners.
+
+	Each image is copied into the subscription's queue on the capture thread of the backend, 
+	right after the RealTimeListeners are called. When the queue is full (the consumer is 
+	behind), the policy decides what happens:
+	- DropOldest: the oldest queued image is discarded for the new one. The consumer always gets 
+	  the most recent images,
+	- DropNewest: the new image is discarded. The consumer gets the images in bursts without gaps,
+	- Block: the capture thread waits for the consumer to make room, up to the block timeout, 
+	  and then discards the new image. Lossless as long as the consumer keeps up on average, 
+	  but it delays the Device, its other subscriptions included, and the driver may drop 
+	  images meanwhile. The timeout should stay well below the driver's own buffering.
+	Either way, the Counters tell what happened.
+
+	The consumer gets the images one at a time with acquireImage(), in order. Only one thread 
+	should consume a subscription. The images are kept when the capture stops, so the consumer 
+	can drain the queue, and recycled when it starts again.
+
+	Subscriptions are created and deleted by their Device, while it isn't capturing.
+*/
+class FrameSubscription
+{
+public:
+	enum Policy
+	{
+		DropOldest,
+		DropNewest,
+		Block
+	};
+
+	Policy					getPolicy() const				{ return mPolicy; }
+	unsigned int			getQueueDepth() const			{ return mQueueDepth; }
+	unsigned int			getBlockTimeoutInMs() const		{ return mBlockTimeoutInMs; }
+
+	// Give back the previous image and wait up to the timeout for the next one. Return NULL on 
+	// timeout, or once the capture stopped and the queue is empty. The image stays valid until 
+	// the next call to acquireImage() or releaseImage(), even if the capture restarts meanwhile
+	const CapturedImage*	acquireImage( unsigned int timeoutInMs );
+	void					releaseImage();
+
+	/*
+		FrameSubscription::Counters
+
+		Every image received by the subscription is, in the end, either consumed or dropped by 
+		the policy, or still queued. The blocked images are the ones the capture thread had to 
+		wait for (Block policy), dropped or not.
+	*/
+	class Counters
+	{
+	public:
+		Counters()
+			: numReceivedFrames(0),
+			  numConsumedFrames(0),
+			  numDroppedFrames(0),
+			  numBlockedFrames(0),
+			  totalBlockedTimeInNs(0),
+			  maxBlockedTimeInNs(0),
+			  queueDepth(0)
+		{
+		}
+
+		unsigned long long		numReceivedFrames;
+		unsigned long long		numConsumedFrames;
+		unsigned long long		numDroppedFrames;
+		unsigned long long		numBlockedFrames;
+		long long				totalBlockedTimeInNs;
+		long long				maxBlockedTimeInNs;
+		unsigned int			queueDepth;
+	};
+
+	// Lock-free, can be called from any thread at any time. Never reset
+	Counters				getCounters() const;
+
+private:
+	friend class DeviceInternals;
+	FrameSubscription( const std::string& name, Policy policy, unsigned int queueDepth, unsigned int blockTimeoutInMs );
+	~FrameSubscription();
+
+	FrameSubscription( const FrameSubscription& other );				// Not implemented on purpose
+	FrameSubscription& operator=( const FrameSubscription& other );		// Not implemented on purpose
+
+	// Called by the DeviceInternals: open() before the capture starts, close() before it stops 
+	// (it wakes up the capture thread if it's blocked), offerBuffer() from the capture thread
+	void					open( const ImageFormat& imageFormat );
+	void					close();
+	void					offerBuffer( const unsigned char* bytes, unsigned int numBytes, unsigned int sequenceNumber, long long timestampInNs, long long arrivalTimeInNs );
+
+	void					deleteImages();
+	void					releaseConsumerImage();
+
+	// The counters only change while mLock is held
+	static void				incrementCounter( std::atomic<unsigned long long>& counter )	{ counter.store( counter.load( std::memory_order_relaxed ) + 1, std::memory_order_relaxed ); }
+
+	const Policy			mPolicy;
+	const unsigned int		mQueueDepth;
+	const unsigned int		mBlockTimeoutInMs;
+
+	// The queue depth plus one image for the consumer and one being written. The queue is a 
+	// ring of indices in mImages
+	std::vector<CapturedImage*>		mImages;
+	std::vector<unsigned int>		mFreeImages;
+	std::vector<unsigned int>		mQueue;
+	unsigned int					mQueueFront;
+	unsigned int					mQueueSize;
+	int								mConsumerImage;		// Index of the image the consumer holds, -1 if none
+	CapturedImage*					mOrphanedImage;		// Image of a previous format the consumer still holds, deleted on release
+
+	Lock							mLock;				// Guards all the above and mIsOpen
+	std::condition_variable_any		mImageQueued;		// The consumer waits for it
+	std::condition_variable_any		mImageDequeued;		// The capture thread waits for it (Block policy)
+	bool							mIsOpen;
+
+	std::atomic<unsigned long long>	mNumReceivedFrames;
+	std::atomic<unsigned long long>	mNumConsumedFrames;
+	std::atomic<unsigned long long>	mNumDroppedFrames;
+	std::atomic<unsigned long long>	mNumBlockedFrames;
+	std::atomic<long long>			mTotalBlockedTimeInNs;
+	std::atomic<long long>			mMaxBlockedTimeInNs;
+	std::atomic<unsigned int>		mCurrentQueueDepth;
+};
+
+}
@@ -31,12 +31,20 @@ namespace RDShow
 
 /*
 	Image
+
+	An Image can live directly in a file mapped in memory: its data is then the region
+	of the file starting at the given offset (see MemoryBuffer and MappedFile).
+	Temporary images of a processing chain can be allocated from a ScratchArena instead of
+	the heap (see ScratchArena). An Image can also wrap bytes it doesn't own, without copy.
 */
 class Image
 {
 public:
 	Image();
-	Image( const ImageFormat& imageFormat );
+	Image( const ImageFormat& imageFormat, MemoryAccounting::Tag tag=MemoryAccounting::Untagged );
+	Image( const ImageFormat& imageFormat, const std::string& filename, unsigned long long offset, MappedFile::Mode mode );
+	Image( const ImageFormat& imageFormat, ScratchArena& arena );
+	Image( const ImageFormat& imageFormat, const unsigned char* externalBytes );
 	Image( const Image& other );
 
 	const ImageFormat&				getFormat() const		{ return mFormat; }
@@ -25,6 +25,8 @@
 
 
 #include "RDShowImage.h"
+#include "RDShowCapturedImage.h"
+#include "RDShowLatencyHistogram.h"
 
 namespace RDShow
 {
@@ -32,23 +34,32 @@ namespace RDShow
 class ImageConverter
 {
 public:
-	ImageConverter( const ImageFormat& outputImageFormat );
+	ImageConverter( const ImageFormat& outputImageFormat, MemoryAccounting::Tag tag=MemoryAccounting::Converter );
 	virtual ~ImageConverter();
 
-	bool			update( const Image& sourceImage );
+	// The sequence number of the image tags the trace events of the conversion (see Tracer). 
+	// 0 when it isn't known
+	bool			update( const Image& sourceImage, unsigned int sequenceNumber );
+	bool			update( const CapturedImage& sourceImage )	{ return update( sourceImage.getImage(), sourceImage.getSequenceNumber() ); }
 	const Image&	getImage() const			{ return *mImage; }
 	Image&			getImage()					{ return *mImage; }
 
+	// Record the duration of each update() in the histogram, for example the ConversionStage 
+	// one of the device the images come from. NULL (default) to stop
+	void				setLatencyHistogram( LatencyHistogram* histogram )	{ mLatencyHistogram = histogram; }
+	LatencyHistogram*	getLatencyHistogram() const							{ return mLatencyHistogram; }
+
 	static bool		convertBGR24ImageToRGB24Image( const Image& sourceImage, Image& destImage );
 	static bool		convertBGRX32ImageToRGB24Image( const Image& sourceImage, Image& destImage );
 	static bool		convertBGRX32ImageToBGR24Image( const Image& sourceImage, Image& destImage );
 	static bool		convertYUYVImageToRGB24Image( const Image& sourceImage, Image& destImage );
 	static bool		convertYUYVImageToBGR24Image( const Image& sourceImage, Image& destImage );
 	
-	static bool		convertImage( const Image& source, Image& destinationImage );
+	static bool		convertImage( const Image& source, Image& destinationImage, unsigned int sequenceNumber=0 );
 
 private:
-	Image*			mImage;
+	Image*				mImage;
+	LatencyHistogram*	mLatencyHistogram;
 };
 
 }
\ No newline at end of file
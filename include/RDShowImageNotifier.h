@@ -0,0 +1,81 @@
+/*
+   The MIT License (MIT) (http://opensource.org/licenses/MIT)
+   
+   Copyright (c) 2015 Jacques Menuet
+   
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+   
+   The above copyright notice and this permission notice shall be included in all
+   copies or substantial portions of the Software.
+   
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+*/
+#pragma once
+
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include "RDShowLock.h"
+
+namespace RDShow
+{
+
+/*
+	ImageNotifier
+
+	Wakes up the threads waiting for images. The backends call notify() after publishing 
+	each image: as long as nobody waits, that's a single atomic read, no lock involved.
+
+	The condition waited for must only depend on values made visible before notify() is called
+	through sequentially consistent atomics. The waiters register themselves before checking 
+	the condition and notify() reads their count after these values changed, so either the 
+	waiter sees the new values or notify() sees the waiter.
+*/
+class ImageNotifier
+{
+public:
+	ImageNotifier( const std::string& name );
+
+	// Names the Lock the waiters wait with (see Lock::getAllStatistics())
+	void setName( const std::string& name )		{ mLock.setName( name ); }
+
+	void notify();
+
+	// Return the value of the predicate, after the timeout if it's still false. 
+	// The predicate is evaluated with the lock held, so two waiters never evaluate it at the same time
+	template<class Predicate>
+	bool wait( unsigned int timeoutInMs, Predicate predicate )
+	{
+		mNumWaiters++;
+		bool ret = false;
+		{
+			std::unique_lock<Lock> lock( mLock );
+			ret = mCondition.wait_for( lock, std::chrono::milliseconds(timeoutInMs), predicate );
+		}
+		mNumWaiters--;
+		return ret;
+	}
+
+private:
+	ImageNotifier( const ImageNotifier& other );				// Not implemented on purpose
+	ImageNotifier& operator=( const ImageNotifier& other );		// Not implemented on purpose
+
+	std::atomic<unsigned int>	mNumWaiters;
+	Lock						mLock;
+	std::condition_variable_any	mCondition;
+};
+
+}
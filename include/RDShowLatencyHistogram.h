@@ -0,0 +1,103 @@
+/*
+   The MIT License (MIT) (http://opensource.org/licenses/MIT)
+   
+   Copyright (c) 2015 Jacques Menuet
+   
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+   
+   The above copyright notice and this permission notice shall be included in all
+   copies or substantial portions of the Software.
+   
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+*/
+#pragma once
+
+#include <atomic>
+
+namespace RDShow
+{
+
+/*
+	LatencyHistogram
+
+	Distribution of durations, in nanoseconds, with a bounded relative error. The buckets are 
+	log-linear, like in HdrHistogram: the durations below 32 ns have their own bucket, then 
+	each power of two is split into 16 buckets of equal width, so the percentiles are within 
+	about 3% of the actual value. Durations above 2^40 ns (about 18 minutes) are clamped.
+
+	record() is lock-free and can be called from any thread. getSnapshot() copies the counts 
+	at once, without stopping the recording: samples recorded meanwhile may or may not be in 
+	it. A reset() running concurrently with record() may lose or keep these samples.
+*/
+class LatencyHistogram
+{
+public:
+	enum 
+	{
+		NumLinearBuckets = 32,
+		NumSubBucketsLog2 = 4,
+		NumSubBuckets = 1 << NumSubBucketsLog2,
+		MaxValueLog2 = 40,
+		NumBuckets = NumLinearBuckets + (MaxValueLog2 - 5) * NumSubBuckets
+	};
+
+	LatencyHistogram();
+
+	void				record( long long durationInNs );
+	void				reset();
+
+	class Snapshot
+	{
+	public:
+		Snapshot();
+
+		unsigned long long	getNumSamples() const		{ return mNumSamples; }
+		long long			getMinInNs() const			{ return mNumSamples>0 ? mMinInNs : 0; }
+		long long			getMaxInNs() const			{ return mMaxInNs; }
+		double				getMeanInNs() const;
+
+		// The percentile is between 0 and 100: 50 for the median, 99.9 for the p999...
+		long long			getPercentileInNs( double percentile ) const;
+
+	private:
+		friend class LatencyHistogram;
+		unsigned long long	mCounts[NumBuckets];
+		unsigned long long	mNumSamples;
+		long long			mSumInNs;
+		long long			mMinInNs;
+		long long			mMaxInNs;
+	};
+
+	Snapshot			getSnapshot() const;
+
+	// Cheaper than a snapshot when only the totals are needed
+	unsigned long long	getNumSamples() const		{ return mNumSamples.load( std::memory_order_relaxed ); }
+	long long			getTotalInNs() const		{ return mSumInNs.load( std::memory_order_relaxed ); }
+
+	static unsigned int	getBucketIndex( long long durationInNs );
+	static long long	getBucketLowestValue( unsigned int bucketIndex );
+	static long long	getBucketWidth( unsigned int bucketIndex );
+
+private:
+	LatencyHistogram( const LatencyHistogram& other );				// Not implemented on purpose
+	LatencyHistogram& operator=( const LatencyHistogram& other );	// Not implemented on purpose
+
+	std::atomic<unsigned long long>	mCounts[NumBuckets];
+	std::atomic<unsigned long long>	mNumSamples;
+	std::atomic<long long>			mSumInNs;
+	std::atomic<long long>			mMinInNs;
+	std::atomic<long long>			mMaxInNs;
+};
+
+}
@@ -0,0 +1,87 @@
+/*
+   The MIT License (MIT) (http://opensource.org/licenses/MIT)
+   
+   Copyright (c) 2015 Jacques Menuet
+   
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+   
+   The above copyright notice and this permission notice shall be included in all
+   copies or substantial portions of the Software.
+   
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+*/
+#pragma once
+
+#include <atomic>
+#include "RDShowCapturedImage.h"
+
+namespace RDShow
+{
+
+/*
+	LatestImageSlot
+
+	The latest image of a device, for any number of threads that just want the newest image 
+	now (a UI, thumbnails, a barcode reader...) without taking part in the update.
+
+	It's a double-buffered seqlock. The writer (the capture thread of the backend) copies each 
+	image into the slot that isn't the latest one, between two increments of the version of 
+	that slot, then makes it the latest. It never waits and doesn't know about the readers. 
+	A reader copies the latest slot and checks that its version didn't change meanwhile. If it 
+	did, the writer came back to that slot during the copy (two images arrived meanwhile): the 
+	copy may be torn, so the reader starts again. The readers never write to what the writer 
+	uses, so their number doesn't matter to the capture thread.
+*/
+class LatestImageSlot
+{
+public:
+	LatestImageSlot( const ImageFormat& imageFormat );
+	~LatestImageSlot();
+
+	const ImageFormat&		getImageFormat() const		{ return mImageFormat; }
+
+	// Single writer. The buffer can be larger than the image
+	void					write( const unsigned char* bytes, unsigned int numBytes, unsigned int sequenceNumber, long long timestampInNs, long long arrivalTimeInNs );
+
+	// Any number of threads. Copy the latest image into the destination, which must have the 
+	// format of the slot. Return false if the format differs or if there's no image newer 
+	// than lastSequenceNumber
+	bool					read( CapturedImage& destination, unsigned int lastSequenceNumber ) const;
+
+	// Of the latest image, 0 before the first one
+	unsigned int			getSequenceNumber() const	{ return mSequenceNumber.load( std::memory_order_acquire ); }
+
+	// How many times the readers had to start again
+	unsigned long long		getNumRetries() const		{ return mNumRetries.load( std::memory_order_relaxed ); }
+
+private:
+	LatestImageSlot( const LatestImageSlot& other );				// Not implemented on purpose
+	LatestImageSlot& operator=( const LatestImageSlot& other );		// Not implemented on purpose
+
+	struct Slot
+	{
+		Slot( const ImageFormat& imageFormat ) : version(0), image(imageFormat) {}
+
+		mutable std::atomic<unsigned int>	version;	// Odd while the writer writes the image. Mutable for ThreadSanitizer builds, see read()
+		CapturedImage				image;
+	};
+
+	ImageFormat								mImageFormat;
+	Slot*									mSlots[2];
+	std::atomic<unsigned int>				mLatestSlotIndex;
+	std::atomic<unsigned int>				mSequenceNumber;
+	mutable std::atomic<unsigned long long>	mNumRetries;
+};
+
+}
@@ -0,0 +1,218 @@
+/*
+   The MIT License (MIT) (http://opensource.org/licenses/MIT)
+   
+   Copyright (c) 2015 Jacques Menuet
+   
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+   
+   The above copyright notice and this permission notice shall be included in all
+   copies or substantial portions of the Software.
+   
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+*/
+#pragma once
+
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <assert.h>
+#include "RDShowLock.h"
+
+namespace RDShow
+{
+
+/*
+	ListenerList
+
+	A list of listeners that can be changed from any thread while other threads go through 
+	it, without any lock on their side (read-copy-update). The list is an immutable Snapshot: 
+	each change publishes a new Snapshot, copied from the current one with the change applied. 
+	The changes are serialized by a Lock that only they take, so they never block or slow 
+	down the readers.
+
+	A reader goes through the list with a ReadScope, which counts it in while it holds the 
+	Snapshot. A reader can still be going through a Snapshot that was replaced, so a removed 
+	listener may get one more call. The replaced Snapshots are deleted as soon as no reader 
+	is counted in: by the change itself when nobody is reading, or else by the last reader 
+	to leave. ReadScopes can be nested, for example when a listener stops the capture, whose 
+	notification goes through the list again: the Snapshots stay until the outermost one ends.
+*/
+template<class T>
+class ListenerList
+{
+public:
+	class Snapshot
+	{
+	public:
+		std::size_t		size() const							{ return mItems.size(); }
+		bool			empty() const							{ return mItems.empty(); }
+		const T&		operator[]( std::size_t index ) const	{ return mItems[index]; }
+
+		typedef typename std::vector<T>::const_iterator const_iterator;
+		const_iterator	begin() const							{ return mItems.begin(); }
+		const_iterator	end() const								{ return mItems.end(); }
+
+	private:
+		friend class ListenerList;
+		Snapshot( const std::vector<T>& items ) : mItems(items), mNextReplacedSnapshot(NULL) {}
+
+		std::vector<T>	mItems;
+		Snapshot*		mNextReplacedSnapshot;
+	};
+
+	/*
+		ListenerList::ReadScope
+
+		Holds the current Snapshot of the list until it goes out of scope. Lock-free, 
+		can be used from any thread.
+	*/
+	class ReadScope
+	{
+	public:
+		ReadScope( const ListenerList& list )
+			: mList(list),
+			  mSnapshot(list.beginRead())
+		{
+		}
+
+		~ReadScope()
+		{
+			mList.endRead();
+		}
+
+		const Snapshot&		getSnapshot() const		{ return *mSnapshot; }
+
+	private:
+		ReadScope( const ReadScope& other );				// Not implemented on purpose
+		ReadScope& operator=( const ReadScope& other );		// Not implemented on purpose
+
+		const ListenerList&	mList;
+		const Snapshot*		mSnapshot;
+	};
+
+	ListenerList( const std::string& name )
+		: mSnapshot( new Snapshot( std::vector<T>() ) ),
+		  mNumReaders(0),
+		  mLock(name),
+		  mReplacedSnapshots(NULL),
+		  mHasReplacedSnapshots(false)
+	{
+	}
+
+	// Nobody must be reading the list anymore
+	~ListenerList()
+	{
+		assert( mNumReaders==0 );
+		deleteReplacedSnapshots();
+		delete mSnapshot.load();
+	}
+
+	// Names the Lock that serializes the changes (see Lock::getAllStatistics())
+	void setName( const std::string& name )
+	{
+		mLock.setName( name );
+	}
+
+	// Can be called from any thread
+	void add( const T& item )
+	{
+		Lock::Scope lockScope( mLock );
+		std::vector<T> items( mSnapshot.load()->mItems );
+		items.push_back( item );
+		replaceSnapshot( new Snapshot( items ) );
+	}
+
+	// Remove the first item for which the predicate is true. Return false if there's none.
+	// Can be called from any thread
+	template<class Predicate>
+	bool remove( const Predicate& predicate )
+	{
+		Lock::Scope lockScope( mLock );
+		std::vector<T> items( mSnapshot.load()->mItems );
+		for ( typename std::vector<T>::iterator itr=items.begin(); itr!=items.end(); ++itr )
+		{
+			if ( predicate( *itr ) )
+			{
+				items.erase( itr );
+				replaceSnapshot( new Snapshot( items ) );
+				return true;
+			}
+		}
+		return false;
+	}
+
+private:
+	ListenerList( const ListenerList& other );				// Not implemented on purpose
+	ListenerList& operator=( const ListenerList& other );	// Not implemented on purpose
+
+	// The readers count themselves in before they load the Snapshot, and a change replaces 
+	// the Snapshot before it counts the readers (all sequentially consistent). Either a reader 
+	// gets the new Snapshot, or it's counted and the replaced one stays
+	const Snapshot* beginRead() const
+	{
+		mNumReaders.fetch_add( 1 );
+		return mSnapshot.load();
+	}
+
+	void endRead() const
+	{
+		// The last reader out deletes what was replaced while it was reading. If a change is 
+		// in progress, it's left to that change or to the next reader, so readers never wait
+		if ( mNumReaders.fetch_sub( 1 )==1 && mHasReplacedSnapshots.load() )
+		{
+			std::unique_lock<Lock> lock( mLock, std::try_to_lock );
+			if ( lock.owns_lock() )
+				reclaim();
+		}
+	}
+
+	// Called with the Lock held
+	void replaceSnapshot( Snapshot* snapshot )
+	{
+		Snapshot* replacedSnapshot = mSnapshot.exchange( snapshot );
+		assert( replacedSnapshot );
+		replacedSnapshot->mNextReplacedSnapshot = mReplacedSnapshots;
+		mReplacedSnapshots = replacedSnapshot;
+		mHasReplacedSnapshots = true;
+		reclaim();
+	}
+
+	// Called with the Lock held. The Snapshots can only be replaced with the Lock, so a 
+	// reader counted in after the check gets the current Snapshot
+	void reclaim() const
+	{
+		if ( mNumReaders.load()==0 )
+			deleteReplacedSnapshots();
+	}
+
+	void deleteReplacedSnapshots() const
+	{
+		while ( mReplacedSnapshots )
+		{
+			Snapshot* snapshot = mReplacedSnapshots;
+			mReplacedSnapshots = snapshot->mNextReplacedSnapshot;
+			delete snapshot;
+		}
+		mHasReplacedSnapshots = false;
+	}
+
+	std::atomic<Snapshot*>				mSnapshot;
+	mutable std::atomic<unsigned int>	mNumReaders;
+	mutable Lock						mLock;
+	mutable Snapshot*					mReplacedSnapshots;		// Guarded by mLock
+	mutable std::atomic<bool>			mHasReplacedSnapshots;
+};
+
+}
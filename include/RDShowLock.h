@@ -0,0 +1,124 @@
+/*
+   The MIT License (MIT) (http://opensource.org/licenses/MIT)
+   
+   Copyright (c) 2015 Jacques Menuet
+   
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+   
+   The above copyright notice and this permission notice shall be included in all
+   copies or substantial portions of the Software.
+   
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+*/
+#pragma once
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <atomic>
+
+namespace RDShow
+{
+
+/*
+	Lock
+
+	A mutex (std::mutex underneath) that can measure its own contention, to see how long the 
+	capture threads and the consumers wait for each other.
+
+	When the statistics are enabled with setStatisticsEnabled(), each Lock counts its 
+	acquisitions, the contended ones (when the lock was already held) and records the time 
+	spent waiting for it and holding it. The statistics are updated while the lock is held and 
+	can be read from any thread. When disabled, locking costs a relaxed atomic read on top 
+	of the mutex.
+
+	Locks are named so their statistics can be told apart: getAllStatistics() returns those 
+	of all the existing Locks.
+
+	Lock has lock(), try_lock() and unlock() so it can be used with the standard RAII helpers, 
+	but Lock::Scope is the usual way to hold it.
+*/
+class Lock
+{
+public:
+	Lock( const std::string& name );
+	~Lock();
+
+	void				setName( const std::string& name );
+	std::string			getName() const;
+
+	void				lock();
+	bool				try_lock();
+	void				unlock();
+
+	class Scope
+	{
+	public:
+		Scope( Lock& lock )		: mLock(lock)	{ mLock.lock(); }
+		~Scope()								{ mLock.unlock(); }
+	private:
+		Scope( const Scope& other );				// Not implemented on purpose
+		Scope& operator=( const Scope& other );		// Not implemented on purpose
+		Lock&	mLock;
+	};
+
+	class Statistics
+	{
+	public:
+		Statistics();
+
+		std::string			name;
+		unsigned long long	numAcquisitions;
+		unsigned long long	numContentions;			// Acquisitions that had to wait
+		long long			totalWaitTimeInNs;
+		long long			maxWaitTimeInNs;
+		long long			totalHoldTimeInNs;
+		long long			maxHoldTimeInNs;
+	};
+
+	Statistics			getStatistics() const;
+
+	// Doesn't wait for the lock: an update made concurrently may survive the reset
+	void				resetStatistics();
+
+	static void			setStatisticsEnabled( bool enabled );
+	static bool			isStatisticsEnabled();
+	
+	static void			getAllStatistics( std::vector<Statistics>& statistics );
+	static void			resetAllStatistics();
+
+private:
+	Lock( const Lock& other );					// Not implemented on purpose
+	Lock& operator=( const Lock& other );		// Not implemented on purpose
+
+	void				onAcquired( bool contended, long long waitTimeInNs );
+	Statistics			getCounters() const;		// All the statistics but the name
+
+	// Only changed while the lock is held, so there's no need for atomic read-modify-writes 
+	static void			add( std::atomic<long long>& value, long long delta )	{ value.store( value.load( std::memory_order_relaxed ) + delta, std::memory_order_relaxed ); }
+	static void			max( std::atomic<long long>& value, long long other )	{ if ( other>value.load( std::memory_order_relaxed ) ) value.store( other, std::memory_order_relaxed ); }
+
+	std::mutex					mMutex;
+	std::string					mName;				// Guarded by the registry mutex
+	long long					mAcquireTimeInNs;	// 0 when the statistics were disabled at acquisition. Guarded by mMutex
+
+	std::atomic<long long>		mNumAcquisitions;
+	std::atomic<long long>		mNumContentions;
+	std::atomic<long long>		mTotalWaitTimeInNs;
+	std::atomic<long long>		mMaxWaitTimeInNs;
+	std::atomic<long long>		mTotalHoldTimeInNs;
+	std::atomic<long long>		mMaxHoldTimeInNs;
+};
+
+}
@@ -0,0 +1,106 @@
+/*
+   The MIT License (MIT) (http://opensource.org/licenses/MIT)
+   
+   Copyright (c) 2015 Jacques Menuet
+   
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+   
+   The above copyright notice and this permission notice shall be included in all
+   copies or substantial portions of the Software.
+   
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+*/
+#pragma once
+
+#include <string>
+#include <cstddef>
+
+namespace RDShow
+{
+
+/*
+	MappedFile
+
+	Maps a region of a file into the address space of the process. The bytes of the region
+	can then be read and written directly, the OS page cache holding the data rather than the
+	process heap. This is meant for very large frame stores (long pre-trigger histories, 
+	recording spools, etc...) that we want the OS to page in and out on our behalf.
+
+	Several MappedFile objects (possibly in different processes) can map the same file. 
+	They all see the same bytes without any copy being made. 
+
+	The region doesn't need to start on a page boundary: the mapping is internally extended
+	down to the closest boundary the OS accepts and getBytes() points to the requested offset.
+
+	In ReadWrite mode the file is created if it doesn't exist and grown if it's too small 
+	to contain the region. In ReadOnly mode the file must exist and be large enough, and 
+	the bytes are mapped read-only: only the const getBytes() gives access to them.
+
+	If the file can't be opened or mapped, the object is left invalid (see isValid()).
+*/
+class MappedFile
+{
+public:
+	enum Mode
+	{
+		ReadOnly,
+		ReadWrite
+	};
+
+	enum Advice
+	{
+		Normal,			// No particular access pattern
+		Sequential,		// The region will be accessed in order. The OS can read ahead aggressively
+		WillNeed,		// The region will be accessed soon. The OS can start paging it in
+		DontNeed		// The region won't be accessed soon. The OS can evict it from memory
+	};
+
+	MappedFile( const std::string& filename, unsigned long long offset, unsigned int sizeInBytes, Mode mode );
+	~MappedFile();
+
+	bool					isValid() const			{ return mBytes!=NULL; }
+	const std::string&		getFilename() const		{ return mFilename; }
+	unsigned long long		getOffset() const		{ return mOffset; }
+	unsigned int			getSizeInBytes() const	{ return mSizeInBytes; }
+	Mode					getMode() const			{ return mMode; }
+	const unsigned char*	getBytes() const		{ return mBytes; }
+	unsigned char*			getWritableBytes()		{ return mMode==ReadWrite ? mBytes : NULL; }	// NULL in ReadOnly mode
+
+	bool					advise( Advice advice );
+	bool					flush();
+
+private:
+	MappedFile( const MappedFile& other );				// Not implemented on purpose
+	MappedFile& operator=( const MappedFile& other );	// Not implemented on purpose
+
+	bool					map();
+	void					unmap();
+
+	std::string				mFilename;
+	unsigned long long		mOffset;
+	unsigned int			mSizeInBytes;
+	Mode					mMode;
+
+#ifdef _WIN32
+	void*					mFileHandle;		// HANDLEs, kept as void* to avoid including windows.h here
+	void*					mMappingHandle;
+#else
+	int						mFileDescriptor;
+#endif
+	unsigned char*			mMappingStart;		// Start of the mapped view (aligned on the OS boundary)
+	std::size_t				mMappingSizeInBytes;
+	unsigned char*			mBytes;				// Start of the requested region within the view
+};
+
+}
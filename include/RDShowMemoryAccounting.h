@@ -0,0 +1,125 @@
+/*
+   The MIT License (MIT) (http://opensource.org/licenses/MIT)
+   
+   Copyright (c) 2015 Jacques Menuet
+   
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+   
+   The above copyright notice and this permission notice shall be included in all
+   copies or substantial portions of the Software.
+   
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+*/
+#pragma once
+
+#include <atomic>
+#include <string>
+
+namespace RDShow
+{
+
+/*
+	MemoryAccounting
+
+	Global counters of the memory allocated for image data by MemoryBuffer (and ScratchArena). 
+	They give visibility on how much memory the frames use as the number of devices grows:
+	live bytes, peak (high-water) bytes, number of allocations, globally and per tag.
+
+	A tag is an optional label given to an allocation to tell what it's for. 
+
+	The counters are updated with atomic operations only, they can be read at any time from 
+	any thread through a Snapshot. Comparing two snapshots gives the allocation rate.
+	A budget can be set, a snapshot then tells whether it's been exceeded so a monitoring 
+	agent can raise an alert.
+
+	Note: the memory of mapped files (see MappedFile) lives in the OS page cache and isn't 
+	accounted for.
+*/
+class MemoryAccounting
+{
+public:
+	enum Tag
+	{
+		Untagged,
+		Capture,		// Buffers receiving the captured images
+		Converter,		// Output images of ImageConverters
+		Viewer,			// Images held for display
+		Pool,			// Preallocated frames of queues and pools
+		Scratch,		// ScratchArena blocks
+		TagCount
+	};
+
+	static const char*	getTagName( Tag tag );
+
+	struct Counters
+	{
+		Counters();
+		unsigned long long	liveSizeInBytes;
+		unsigned long long	peakSizeInBytes;
+		unsigned long long	numAllocations;
+		unsigned long long	numDeallocations;
+	};
+
+	class Snapshot
+	{
+	public:
+		Snapshot();
+
+		double				getTimeInSec() const				{ return mTimeInSec; }
+		const Counters&		getCounters() const					{ return mCounters; }
+		const Counters&		getCounters( Tag tag ) const		{ return mTagCounters[tag]; }
+		unsigned long long	getBudgetInBytes() const			{ return mBudgetInBytes; }
+		bool				isOverBudget() const;
+		
+		double				getAllocationRate( const Snapshot& previous ) const;	// Allocations per second since the previous snapshot
+
+		std::string			toString() const;
+
+	private:
+		friend class MemoryAccounting;
+		double				mTimeInSec;
+		Counters			mCounters;
+		Counters			mTagCounters[TagCount];
+		unsigned long long	mBudgetInBytes;
+	};
+
+	static void			getSnapshot( Snapshot& snapshot );
+	static void			resetPeaks();
+
+	static void			setBudgetInBytes( unsigned long long budgetInBytes );	// 0 means no budget
+	static unsigned long long getBudgetInBytes();
+
+	static void			onAllocation( Tag tag, unsigned long long sizeInBytes );
+	static void			onDeallocation( Tag tag, unsigned long long sizeInBytes );
+
+private:
+	struct AtomicCounters
+	{
+		std::atomic<unsigned long long>	liveSizeInBytes;
+		std::atomic<unsigned long long>	peakSizeInBytes;
+		std::atomic<unsigned long long>	numAllocations;
+		std::atomic<unsigned long long>	numDeallocations;
+	};
+
+	static void			add( AtomicCounters& counters, unsigned long long sizeInBytes );
+	static void			remove( AtomicCounters& counters, unsigned long long sizeInBytes );
+	static void			read( const AtomicCounters& counters, Counters& values );
+
+	static AtomicCounters					mCounters;
+	static AtomicCounters					mTagCounters[TagCount];
+	static std::atomic<unsigned long long>	mBudgetInBytes;
+	static const char*						mTagNames[TagCount];
+};
+
+}
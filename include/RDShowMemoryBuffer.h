@@ -23,29 +23,83 @@
 */
 #pragma once
 
+#include <string>
+#include <assert.h>
+#include "RDShowMappedFile.h"
+#include "RDShowMemoryAccounting.h"
+
 namespace RDShow
 {
 
+class ScratchArena;
+
+/*
+	MemoryBuffer
+
+	A fixed-size block of bytes. By default the bytes are allocated on the heap and zero-filled.
+	
+	A MemoryBuffer can also be backed by a region of a file mapped in memory (see MappedFile).
+	In that case the bytes live in the OS page cache, they are not zero-filled but reflect the 
+	current content of the file. If the file can't be mapped, the MemoryBuffer is empty.
+	A buffer mapped in ReadOnly mode is read-only: whatever would write to the buffer (fill(), 
+	copyFrom(), the ImageConverter) fails. getBytes() only gives read access, writing goes 
+	through getWritableBytes(), which must not be called on a read-only buffer.
+	
+	A MemoryBuffer can also be carved out of a ScratchArena for short-lived intermediate 
+	results. It's then not zero-filled either, and becomes invalid when the arena is reset.
+
+	Finally a MemoryBuffer can borrow bytes owned by someone else, typically a driver buffer, 
+	to look at them without copy. It's then read-only, and only valid as long as the bytes are.
+	
+	Copying a MemoryBuffer always produces a heap-backed one.
+
+	Heap allocations are reported to the MemoryAccounting, under the tag given at construction.
+*/
 class MemoryBuffer
 {
 public:
+	enum Storage
+	{
+		EmptyStorage,		// No bytes: default-constructed, or the mapping failed
+		HeapStorage,
+		MappedFileStorage,
+		ScratchArenaStorage,
+		ExternalStorage
+	};
+
 	MemoryBuffer();
-	MemoryBuffer( unsigned int sizeInBytes );
+	MemoryBuffer( unsigned int sizeInBytes, MemoryAccounting::Tag tag=MemoryAccounting::Untagged );
+	MemoryBuffer( const std::string& filename, unsigned long long offset, unsigned int sizeInBytes, MappedFile::Mode mode );
+	MemoryBuffer( ScratchArena& arena, unsigned int sizeInBytes );
+	MemoryBuffer( const unsigned char* externalBytes, unsigned int sizeInBytes );
 	MemoryBuffer( const MemoryBuffer& other );
 	~MemoryBuffer();	
 
 	unsigned int			getSizeInBytes() const	{ return mSizeInBytes; }
 	const unsigned char*	getBytes() const		{ return mBytes; }
-	unsigned char*			getBytes()				{ return mBytes; }
+	unsigned char*			getWritableBytes()		{ assert( !mIsReadOnly ); return mIsReadOnly ? NULL : mBytes; }
+	bool					isReadOnly() const		{ return mIsReadOnly; }
 	
-	void					fill( char value );
+	// Return false if the buffer is read-only
+	bool					fill( char value );
 	bool					copyFrom( const MemoryBuffer& other );
 
+	Storage					getStorage() const		{ return mStorage; }
+	MemoryAccounting::Tag	getTag() const			{ return mTag; }
+	bool					isMapped() const		{ return mMappedFile!=NULL; }
+	const MappedFile*		getMappedFile() const	{ return mMappedFile; }
+	bool					advise( MappedFile::Advice advice );
+	bool					flush();
+
 private:
 	MemoryBuffer& operator=( const MemoryBuffer& other );	// Not implemented on purpose
 
 	unsigned char*			mBytes;
 	unsigned int			mSizeInBytes;
+	Storage					mStorage;
+	MemoryAccounting::Tag	mTag;
+	MappedFile*				mMappedFile;
+	bool					mIsReadOnly;
 };
 
 }
@@ -0,0 +1,90 @@
+/*
+   The MIT License (MIT) (http://opensource.org/licenses/MIT)
+   
+   Copyright (c) 2015 Jacques Menuet
+   
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+   
+   The above copyright notice and this permission notice shall be included in all
+   copies or substantial portions of the Software.
+   
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+*/
+#pragma once
+
+#include <vector>
+#include <utility>
+#include <cstddef>
+
+namespace RDShow
+{
+
+/*
+	ScratchArena
+
+	A bump-pointer allocator for the temporary buffers of a multi-step processing chain 
+	(convert, resize, grey, analyse...). Allocating is just moving a pointer forward and 
+	nothing is ever freed individually: the whole arena is reset at once, typically at the 
+	start of each frame. The intermediate buffers of a frame end up contiguous in memory 
+	and stay warm in the cache from one frame to the next.
+
+	The arena sizes itself from the first frame: what doesn't fit in the current block is 
+	served from separate heap blocks, and at the next reset() the arena grows its block to 
+	the peak amount used so that subsequent frames are served from the block only.
+
+	Usage:
+		arena.reset();
+		Image tempImage( format, arena );		// See Image and MemoryBuffer constructors
+		...
+	
+	Calling reset() invalidates everything allocated so far. The MemoryBuffers and Images
+	built on the arena must not be used afterwards (destroying them is fine).
+	An arena must only be used by one thread at a time.
+*/
+class ScratchArena
+{
+public:
+	ScratchArena();
+	ScratchArena( unsigned int capacityInBytes );
+	~ScratchArena();
+
+	unsigned char*		allocate( unsigned int sizeInBytes );
+	void				reset();
+
+	unsigned int		getCapacityInBytes() const			{ return mCapacityInBytes; }
+	unsigned int		getUsedSizeInBytes() const			{ return mUsedSizeInBytes; }
+	unsigned int		getPeakUsedSizeInBytes() const		{ return mPeakUsedSizeInBytes; }
+	std::size_t			getNumOverflowBlocks() const		{ return mOverflowBlocks.size(); }
+
+	static const unsigned int Alignment = 64;		// Allocations start on a cache-line boundary
+
+private:
+	ScratchArena( const ScratchArena& other );				// Not implemented on purpose
+	ScratchArena& operator=( const ScratchArena& other );	// Not implemented on purpose
+
+	void				allocateBlock( unsigned int capacityInBytes );
+	void				freeOverflowBlocks();
+	static unsigned int	alignSize( unsigned int sizeInBytes )	{ return (sizeInBytes + Alignment - 1) & ~(Alignment - 1); }
+	static unsigned char* alignPointer( unsigned char* pointer );
+
+	unsigned char*		mBlock;					// As allocated. mBlockStart is the aligned start
+	unsigned char*		mBlockStart;
+	unsigned int		mCapacityInBytes;
+	unsigned int		mUsedInBlockInBytes;
+	unsigned int		mUsedSizeInBytes;		// Including the overflow blocks
+	unsigned int		mPeakUsedSizeInBytes;
+	std::vector< std::pair<unsigned char*, unsigned int> >	mOverflowBlocks;		// Blocks and their size
+};
+
+}
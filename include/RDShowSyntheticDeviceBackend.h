@@ -0,0 +1,70 @@
+/*
+   The MIT License (MIT) (http://opensource.org/licenses/MIT)
+   
+   Copyright (c) 2015 Jacques Menuet
+   
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+   
+   The above copyright notice and this permission notice shall be included in all
+   copies or substantial portions of the Software.
+   
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+*/
+#pragma once
+
+#include "RDShowDeviceBackend.h"
+#include "RDShowSyntheticDeviceInternals.h"
+
+namespace RDShow
+{
+
+/*
+	SyntheticDeviceBackend
+
+	Provides SyntheticDeviceInternals based devices to a DeviceManager, so the capture 
+	path can be exercised without any camera (benchmarks, soak tests...). 
+
+	Devices are declared with addDevice() and show up (or disappear after removeDevice())
+	at the next update of the DeviceManager. Their path is "synthetic://" followed by their name.
+*/
+class SyntheticDeviceBackend : public DeviceBackend
+{
+public:
+	SyntheticDeviceBackend();
+	virtual ~SyntheticDeviceBackend();
+
+	// Return the path of the device or an empty string if a device with this name already exists
+	std::string					addDevice(	const std::string& name, 
+											const CaptureSettingsList& captureSettingsList, 
+											SyntheticDeviceInternals::Pattern pattern=SyntheticDeviceInternals::ColorBars );
+	bool						removeDevice( const std::string& path );
+
+	virtual bool				enumerateDevices( DeviceInfos& deviceInfos );
+	virtual DeviceInternals*	createDeviceInternals( const std::string& path );
+	virtual bool				hasDeviceListChanged();
+
+private:
+	struct SyntheticDevice
+	{
+		DeviceInfo							info;
+		CaptureSettingsList					captureSettingsList;
+		SyntheticDeviceInternals::Pattern	pattern;
+	};
+	typedef std::vector<SyntheticDevice> SyntheticDevices;
+
+	SyntheticDevices			mDevices;
+	bool						mDeviceListChanged;
+};
+
+}
@@ -0,0 +1,89 @@
+/*
+   The MIT License (MIT) (http://opensource.org/licenses/MIT)
+   
+   Copyright (c) 2015 Jacques Menuet
+   
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+   
+   The above copyright notice and this permission notice shall be included in all
+   copies or substantial portions of the Software.
+   
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+*/
+#pragma once
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+#include "RDShowDeviceInternals.h"
+#include "RDShowImage.h"
+
+namespace RDShow
+{
+
+/*
+	SyntheticDeviceInternals
+
+	A device that generates moving test patterns from its own thread, in any ImageFormat and 
+	at the frame rate of the started CaptureSettings. Frames are paced against absolute 
+	deadlines so the frame rate doesn't drift, and are timestamped with the time elapsed 
+	since the start of the capture.
+
+	The frame counter is embedded in the top left corner of each image as 32 black or white 
+	8x8 blocks (most significant bit first) and can be read back with readFrameCounter(). 
+	This requires images at least 256 pixels wide and 8 pixels high.
+*/
+class SyntheticDeviceInternals : public DeviceInternals
+{
+public:
+	enum Pattern
+	{
+		ColorBars,		// Vertical color bars scrolling horizontally
+		Gradient		// Diagonal gradient moving toward the top left corner
+	};
+
+	SyntheticDeviceInternals( const CaptureSettingsList& captureSettingsList, Pattern pattern );
+	virtual ~SyntheticDeviceInternals();
+
+	Pattern					getPattern() const		{ return mPattern; }
+
+	static bool				readFrameCounter( const Image& image, unsigned int& frameCounter );
+
+protected:
+	virtual bool			startBackendCapture( std::size_t captureSettingsIndex );
+	virtual bool			stopBackendCapture();
+
+private:
+	void					captureThreadMain( std::size_t captureSettingsIndex );
+	void					renderFrame( unsigned int frameCounter );
+	void					writeRow( unsigned int y, unsigned int frameCounter );
+	void					writeFrameCounter( unsigned int frameCounter );
+
+	static void				writePixels( const unsigned char* rgbBytes, unsigned int numPixels, ImageFormat::Encoding encoding, unsigned char* destBytes );
+
+	static const unsigned int mCounterBlockSize = 8;
+	static const unsigned int mCounterNumBits = 32;
+
+	Pattern					mPattern;
+	Image*					mFrame;					// Rendered frame, allocated when the capture starts 
+	std::vector<unsigned char> mRGBRow;				// Scratch row of RGB24 pixels
+	
+	std::thread				mThread;
+	std::mutex				mStopMutex;
+	std::condition_variable	mStopCondition;
+	bool					mStopRequested;
+};
+
+}
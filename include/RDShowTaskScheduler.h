@@ -0,0 +1,124 @@
+/*
+   The MIT License (MIT) (http://opensource.org/licenses/MIT)
+   
+   Copyright (c) 2015 Jacques Menuet
+   
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+   
+   The above copyright notice and this permission notice shall be included in all
+   copies or substantial portions of the Software.
+   
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+*/
+#pragma once
+
+#include <atomic>
+#include "RDShowThread.h"
+
+namespace RDShow
+{
+
+/*
+	TaskScheduler
+
+	The library-wide pool of worker threads that the parallel code (conversions, parallel 
+	copies...) shares, rather than each feature starting its own threads. With dozens of 
+	cameras, they'd otherwise end up with far more threads than cores.
+
+	Each worker has its own task queue. A worker runs the tasks of its own queue first, 
+	newest first (they're likely still in its cache), and when it's empty it steals the 
+	oldest tasks from the other queues. A thread waiting for a TaskGroup runs pending tasks 
+	meanwhile, so the threads submitting work are part of the pool too.
+
+	By default there's one worker per CPU but one, as the submitting thread does its share, 
+	and the workers are started on first use: the first parallelFor() or TaskGroup, or 
+	getNumWorkerThreads(). Configure the pool before that, or call shutdown() first. To keep 
+	the start of the workers off a latency-sensitive path, call getNumWorkerThreads() once 
+	configured. Without workers (single CPU machine, or set to 0), everything runs on the 
+	calling thread.
+
+	Tasks are plain function pointers with a context and a range: submitting them doesn't 
+	allocate, so they can be used on the capture and delivery paths. A queue that is full 
+	makes the submitter run the task itself.
+*/
+class TaskScheduler
+{
+public:
+	typedef void (*TaskFunction)( void* context, unsigned int begin, unsigned int end );
+
+	static void				setNumWorkerThreads( unsigned int numThreads );
+	static unsigned int		getNumWorkerThreads();
+
+	// Pin the Nth worker to the (N+1)th CPU, CPU 0 being left to the main thread. 
+	// Takes precedence over the cpuMask of the worker thread settings
+	static void				setWorkerThreadsPinned( bool pinned );
+	static bool				areWorkerThreadsPinned();
+
+	// The scheduling settings of the workers (see Thread::Settings), and what each of them got
+	static void				setWorkerThreadSettings( const Thread::Settings& settings );
+	static Thread::Settings	getWorkerThreadSettings();
+	static bool				getEffectiveWorkerThreadSettings( unsigned int workerIndex, Thread::Settings& settings );
+
+	// Run the function on a worker without waiting for it, for work that blocks (starting a 
+	// capture...) rather than computations. Only the idle workers take these tasks, never a 
+	// thread waiting for a TaskGroup, so they don't delay the parallel code. Without workers, 
+	// or when too many are pending, the function runs on the calling thread
+	static void				post( TaskFunction function, void* context );
+
+	// Stop the workers once their queues are empty. They're started again on the next use.
+	// The pool isn't reference counted: no parallelFor() or TaskGroup may be in flight on 
+	// any thread, as they keep using the workers' queues until they're done
+	static void				shutdown();
+
+	/*
+		TaskScheduler::TaskGroup
+
+		Tasks that are waited for together. The context of the tasks must stay valid until 
+		wait() returns, which the destructor calls.
+	*/
+	class TaskGroup
+	{
+	public:
+		TaskGroup();
+		~TaskGroup();
+
+		void				run( TaskFunction function, void* context, unsigned int begin=0, unsigned int end=0 );
+		void				wait();
+
+	private:
+		TaskGroup( const TaskGroup& other );				// Not implemented on purpose
+		TaskGroup& operator=( const TaskGroup& other );		// Not implemented on purpose
+
+		std::atomic<unsigned int>	mNumPendingTasks;
+	};
+
+	// Call body( rangeBegin, rangeEnd ) on sub-ranges of [begin, end) of at least grainSize 
+	// items (except the last one), in parallel, and return once they're all done. For example 
+	// over the rows of an image. The body must be callable concurrently
+	template<class Body>
+	static void				parallelFor( unsigned int begin, unsigned int end, unsigned int grainSize, const Body& body )
+	{
+		parallelFor( begin, end, grainSize, &invokeBody<Body>, const_cast<void*>( static_cast<const void*>(&body) ) );
+	}
+	static void				parallelFor( unsigned int begin, unsigned int end, unsigned int grainSize, TaskFunction function, void* context );
+
+private:
+	template<class Body>
+	static void				invokeBody( void* context, unsigned int begin, unsigned int end )
+	{
+		(*static_cast<const Body*>(context))( begin, end );
+	}
+};
+
+}
@@ -0,0 +1,103 @@
+/*
+   The MIT License (MIT) (http://opensource.org/licenses/MIT)
+   
+   Copyright (c) 2015 Jacques Menuet
+   
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+   
+   The above copyright notice and this permission notice shall be included in all
+   copies or substantial portions of the Software.
+   
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+*/
+#pragma once
+
+#include <string>
+
+namespace RDShow
+{
+
+/*
+	Thread
+
+	Utilities for the threads of the library (device workers, synthetic capture threads, 
+	TaskScheduler workers...) and of the application.
+*/
+class Thread
+{
+public:
+	// Number of logical CPUs, at least 1
+	static unsigned int		getNumCPUs();
+
+	// Restrict the current thread to the CPUs whose bit is set in the mask (bit 0 for CPU 0). 
+	// Only the first 64 CPUs can be selected. Return false if the system doesn't allow it 
+	// (not supported, or invalid mask), in which case the thread can still run on any CPU
+	static bool				setCurrentThreadAffinity( unsigned long long cpuMask );
+
+	/*
+		Thread::Settings
+
+		How a thread is scheduled:
+		- priority: relative to the other threads. On Linux it's the nice value of the thread 
+		  (from 10 for Lowest to -20 for TimeCritical): going above Normal needs privileges 
+		  (CAP_SYS_NICE or a high enough RLIMIT_NICE),
+		- policy: the real-time policies (SCHED_FIFO and SCHED_RR on Linux) preempt all the 
+		  normal threads. realTimePriority is their priority, from 1 to 99. They need privileges 
+		  too. Windows has no per-thread equivalent: they're applied as the TimeCritical priority,
+		- cpuMask: the CPUs the thread may run on (bit 0 for CPU 0), 0 for any.
+		The default settings leave the threads as the system created them.
+	*/
+	class Settings
+	{
+	public:
+		enum Priority
+		{
+			Lowest,
+			BelowNormal,
+			Normal,
+			AboveNormal,
+			Highest,
+			TimeCritical
+		};
+
+		enum Policy
+		{
+			NormalPolicy,
+			FifoPolicy,
+			RoundRobinPolicy
+		};
+
+		Settings();
+
+		bool				isDefault() const;
+		std::string			toString() const;
+
+		Priority			priority;
+		Policy				policy;
+		int					realTimePriority;
+		unsigned long long	cpuMask;
+	};
+
+	// Apply the settings to the current thread as far as the system allows, and return the ones 
+	// it actually got: a real-time policy that's refused falls back to the normal policy with 
+	// the requested priority, a refused priority leaves the priority as it was, and so does a 
+	// refused affinity. A cpuMask of 0 leaves the affinity as it is
+	static Settings			applyToCurrentThread( const Settings& settings );
+
+	// What the system reports for the current thread. The cpuMask is 0 when the thread can run 
+	// on all the CPUs, or when the system can't tell
+	static Settings			getCurrentThreadSettings();
+};
+
+}
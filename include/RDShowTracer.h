@@ -0,0 +1,103 @@
+/*
+   The MIT License (MIT) (http://opensource.org/licenses/MIT)
+   
+   Copyright (c) 2015 Jacques Menuet
+   
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+   
+   The above copyright notice and this permission notice shall be included in all
+   copies or substantial portions of the Software.
+   
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+*/
+#pragma once
+
+#include <string>
+
+namespace RDShow
+{
+
+/*
+	Tracer
+
+	A timeline of what the capture, delivery, conversion and listener code is doing, to 
+	understand frame pacing issues that the counters and histograms average out.
+
+	The code of these paths is wrapped in Tracer::Scope objects that carry a static name and 
+	the sequence number of the image being processed (0 when it isn't known). When the library 
+	is built with RDSHOW_ENABLE_TRACING defined (CMake option RAPADIRECTSHOW_ENABLE_TRACING) 
+	and tracing is enabled with setEnabled(), each Scope records its start time and duration 
+	in a ring buffer owned by the current thread: no lock and no allocation, except for the 
+	buffer of a thread when it records its first event. The oldest events of a thread are 
+	overwritten once its buffer is full.
+
+	writeChromeTraceFile() writes the events of all the threads in the Chrome trace JSON 
+	format, which chrome://tracing and https://ui.perfetto.dev open. The capture thread of 
+	each device is named after the device, so each camera gets its own track. Write the file 
+	after disabling tracing and stopping the captures: events recorded meanwhile might be 
+	written half-updated.
+
+	Without RDSHOW_ENABLE_TRACING, Scope is an empty object: there's no cost at all. When it's 
+	compiled in but disabled, a Scope costs a relaxed atomic read. The application must be 
+	compiled with the same setting as the library.
+*/
+class Tracer
+{
+public:
+	static bool			isAvailable();		// Whether the library was built with RDSHOW_ENABLE_TRACING
+
+	static void			setEnabled( bool enabled );
+	static bool			isEnabled();
+
+	// The size of the ring buffer of each thread. Only applies to the threads that didn't 
+	// record anything yet
+	static void			setNumEventsPerThread( unsigned int numEvents );
+	static unsigned int	getNumEventsPerThread();
+
+	// The name of the current thread in the trace. Allocates: call it when the thread starts.
+	// Threads that never record anything don't show up in the trace
+	static void			setCurrentThreadName( const std::string& name );
+
+	// Forget the events recorded so far. Call it while tracing is disabled
+	static void			clear();
+
+	static bool			writeChromeTraceFile( const std::string& filename );
+
+	class Scope
+	{
+	public:
+#ifdef RDSHOW_ENABLE_TRACING
+		// The name must be a string literal, or at least outlive the Tracer
+		Scope( const char* name, unsigned int sequenceNumber )	
+			: mName( isEnabled() ? name : NULL ), mSequenceNumber(sequenceNumber), mStartTimeInNs( mName ? getTimeInNs() : 0 ) {}
+		~Scope()											{ if ( mName ) recordEvent( mName, mSequenceNumber, mStartTimeInNs ); }
+#else
+		Scope( const char* /*name*/, unsigned int /*sequenceNumber*/ )	{}
+#endif
+	private:
+		Scope( const Scope& other );				// Not implemented on purpose
+		Scope& operator=( const Scope& other );		// Not implemented on purpose
+#ifdef RDSHOW_ENABLE_TRACING
+		const char*		mName;
+		unsigned int	mSequenceNumber;
+		long long		mStartTimeInNs;
+#endif
+	};
+
+private:
+	static long long	getTimeInNs();
+	static void			recordEvent( const char* name, unsigned int sequenceNumber, long long startTimeInNs );
+};
+
+}
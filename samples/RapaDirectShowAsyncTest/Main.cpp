@@ -0,0 +1,359 @@
+/*
+   The MIT License (MIT) (http://opensource.org/licenses/MIT)
+   
+   Copyright (c) 2015 Jacques Menuet
+   
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+   
+   The above copyright notice and this permission notice shall be included in all
+   copies or substantial portions of the Software.
+   
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+*/
+#include "RDShowDeviceManager.h"
+#include "RDShowDevice.h"
+#include "RDShowSyntheticDeviceBackend.h"
+#include "RDShowFrameAwaitable.h"
+#include "RDShowTaskScheduler.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <thread>
+#include <atomic>
+
+// Many logical consumers wait for the images of a few synthetic devices, all served by a 
+// single executor thread instead of a thread each. Half of them are Device::ImageWaiters 
+// posting to the executor, the other half coroutines awaiting RDShow::nextFrame() when the 
+// compiler supports them. The devices run in threaded mode and are started and stopped 
+// with the future-returning methods, so nothing polls.
+// Each consumer must see increasing sequence numbers and finish when the capture stops.
+// At the end, starts and stops are queued back to back on each device without waiting: they 
+// must run in order, the last one deciding the state of the device. A last start and stop 
+// are left pending when the devices are deleted.
+// Returns a non-zero value on failure.
+//
+// Usage: RapaDirectShowAsyncTest [numDevices] [numConsumersPerDevice] [durationInSec] [frameRate]
+
+// Runs the posted tasks in order, on the thread that calls run()
+class QueueExecutor
+{
+public:
+	QueueExecutor()
+		: mStopRequested(false)
+	{
+	}
+
+	void post( const std::function<void()>& task )
+	{
+		{
+			std::lock_guard<std::mutex> lock( mMutex );
+			mTasks.push_back( task );
+		}
+		mCondition.notify_one();
+	}
+
+	// Return once stopped and all the tasks are done
+	void run()
+	{
+		for (;;)
+		{
+			std::function<void()> task;
+			{
+				std::unique_lock<std::mutex> lock( mMutex );
+				mCondition.wait( lock, [this]() { return mStopRequested || !mTasks.empty(); } );
+				if ( mTasks.empty() )
+					return;
+				task = mTasks.front();
+				mTasks.pop_front();
+			}
+			task();
+		}
+	}
+
+	void stop()
+	{
+		{
+			std::lock_guard<std::mutex> lock( mMutex );
+			mStopRequested = true;
+		}
+		mCondition.notify_one();
+	}
+
+private:
+	std::mutex							mMutex;
+	std::condition_variable				mCondition;
+	std::deque< std::function<void()> >	mTasks;
+	bool								mStopRequested;
+};
+
+// What a consumer saw. Only touched from the executor thread
+class ConsumerStatistics
+{
+public:
+	ConsumerStatistics()
+		: numImages(0),
+		  numErrors(0),
+		  lastSequenceNumber(0),
+		  isFinished(false)
+	{
+	}
+
+	void onImage( unsigned int sequenceNumber )
+	{
+		if ( sequenceNumber<=lastSequenceNumber )
+			numErrors++;
+		lastSequenceNumber = sequenceNumber;
+		numImages++;
+	}
+
+	unsigned int	numImages;
+	unsigned int	numErrors;
+	unsigned int	lastSequenceNumber;
+	bool			isFinished;
+};
+
+// Waits with the callback interface, handling the images on the executor
+class CallbackConsumer : public RDShow::Device::ImageWaiter
+{
+public:
+	CallbackConsumer()
+		: device(NULL),
+		  executor(NULL)
+	{
+	}
+
+	void start()
+	{
+		executor->post( [this]() { waitForNextImage(); } );
+	}
+
+	ConsumerStatistics		statistics;
+	RDShow::Device*			device;
+	QueueExecutor*			executor;
+
+private:
+	// Called on the capture thread
+	virtual void onImageAvailable( RDShow::Device* /*device*/, unsigned int sequenceNumber )
+	{
+		executor->post( [this, sequenceNumber]() { onImage( sequenceNumber ); } );
+	}
+
+	void onImage( unsigned int sequenceNumber )
+	{
+		if ( sequenceNumber==0 )
+		{
+			statistics.isFinished = true;
+			return;
+		}
+		statistics.onImage( sequenceNumber );
+		waitForNextImage();
+	}
+
+	void waitForNextImage()
+	{
+		if ( !device->asyncWaitForNextImage( statistics.lastSequenceNumber, this ) )
+			onImage( device->getPublishedSequenceNumber() );
+	}
+};
+
+#ifdef RDSHOW_HAS_COROUTINES
+
+// Resumes the coroutines on the QueueExecutor
+class CoroutineExecutor : public RDShow::Executor
+{
+public:
+	CoroutineExecutor( QueueExecutor& executor )
+		: mExecutor(executor)
+	{
+	}
+
+	virtual void execute( std::coroutine_handle<> handle )
+	{
+		mExecutor.post( [handle]() { handle.resume(); } );
+	}
+
+private:
+	QueueExecutor&	mExecutor;
+};
+
+// A coroutine that runs until it's done, without anybody waiting for it
+class DetachedTask
+{
+public:
+	class promise_type
+	{
+	public:
+		DetachedTask		get_return_object()		{ return DetachedTask(); }
+		std::suspend_never	initial_suspend()		{ return std::suspend_never(); }
+		std::suspend_never	final_suspend() noexcept	{ return std::suspend_never(); }
+		void				return_void()			{}
+		void				unhandled_exception()	{ abort(); }
+	};
+};
+
+DetachedTask consumeImages( RDShow::Device* device, RDShow::Executor* executor, ConsumerStatistics* statistics )
+{
+	unsigned int sequenceNumber = 0;
+	while ( (sequenceNumber = co_await RDShow::nextFrame( device, sequenceNumber, executor ))!=0 )
+		statistics->onImage( sequenceNumber );
+	statistics->isFinished = true;
+}
+
+#endif
+
+int main( int argc, char* argv[] )
+{
+	unsigned int numDevices = argc>1 ? atoi(argv[1]) : 2;
+	unsigned int numConsumersPerDevice = argc>2 ? atoi(argv[2]) : 500;
+	double durationInSec = argc>3 ? atof(argv[3]) : 3.0;
+	float frameRate = argc>4 ? static_cast<float>( atof(argv[4]) ) : 60.f;
+
+	// The asynchronous starts and stops run on the TaskScheduler workers, which a single CPU 
+	// machine wouldn't have
+	RDShow::TaskScheduler::setNumWorkerThreads( 2 );
+
+	RDShow::DeviceManager deviceManager;
+	RDShow::SyntheticDeviceBackend* backend = new RDShow::SyntheticDeviceBackend();
+	for ( unsigned int i=0; i<numDevices; ++i )
+	{
+		RDShow::CaptureSettingsList captureSettingsList;
+		captureSettingsList.push_back( RDShow::CaptureSettings( RDShow::ImageFormat( 320, 240, RDShow::ImageFormat::RGB24 ), frameRate ) );
+		char name[32];
+		sprintf( name, "Async%u", i );
+		backend->addDevice( name, captureSettingsList );
+	}
+	deviceManager.addBackend( backend );
+	deviceManager.setThreadedMode( true );
+	deviceManager.update();
+
+	const RDShow::Devices& devices = deviceManager.getDevices();
+	if ( devices.size()!=numDevices )
+	{
+		printf("Expected %u devices, got %u\n", numDevices, static_cast<unsigned int>(devices.size()) );
+		return 1;
+	}
+
+	std::vector< std::future<bool> > startResults;
+	for ( std::size_t i=0; i<devices.size(); ++i )
+		startResults.push_back( devices[i]->startCaptureAsync( 0 ) );
+	for ( std::size_t i=0; i<startResults.size(); ++i )
+	{
+		if ( !startResults[i].get() )
+		{
+			printf("Failed to start %s\n", devices[i]->getName().c_str() );
+			return 1;
+		}
+	}
+
+	QueueExecutor executor;
+	std::thread executorThread( &QueueExecutor::run, &executor );
+
+	std::vector<CallbackConsumer> callbackConsumers( numDevices * numConsumersPerDevice );
+	for ( std::size_t i=0; i<callbackConsumers.size(); ++i )
+	{
+		callbackConsumers[i].device = devices[i % numDevices];
+		callbackConsumers[i].executor = &executor;
+		callbackConsumers[i].start();
+	}
+
+#ifdef RDSHOW_HAS_COROUTINES
+	CoroutineExecutor coroutineExecutor( executor );
+	std::vector<ConsumerStatistics> coroutineStatistics( numDevices * numConsumersPerDevice );
+	for ( std::size_t i=0; i<coroutineStatistics.size(); ++i )
+	{
+		RDShow::Device* device = devices[i % numDevices];
+		ConsumerStatistics* statistics = &coroutineStatistics[i];
+		executor.post( [device, &coroutineExecutor, statistics]() { consumeImages( device, &coroutineExecutor, statistics ); } );
+	}
+#else
+	printf("Coroutines: not supported by the compiler, only the ImageWaiters are tested\n");
+	std::vector<ConsumerStatistics> coroutineStatistics;
+#endif
+
+	std::this_thread::sleep_for( std::chrono::milliseconds( static_cast<int>(durationInSec * 1000) ) );
+
+	// Stopping the capture wakes up all the consumers one last time
+	std::vector< std::future<void> > stopResults;
+	for ( std::size_t i=0; i<devices.size(); ++i )
+		stopResults.push_back( devices[i]->stopCaptureAsync() );
+	for ( std::size_t i=0; i<stopResults.size(); ++i )
+		stopResults[i].get();
+
+	executor.stop();
+	executorThread.join();
+
+	bool success = true;
+	for ( std::size_t i=0; i<devices.size(); ++i )
+	{
+		unsigned long long numImages[2] = { 0, 0 };
+		unsigned int numErrors[2] = { 0, 0 };
+		unsigned int numUnfinished[2] = { 0, 0 };
+		for ( std::size_t j=i; j<callbackConsumers.size(); j+=numDevices )
+		{
+			const ConsumerStatistics& statistics = callbackConsumers[j].statistics;
+			numImages[0] += statistics.numImages;
+			numErrors[0] += statistics.numErrors;
+			numUnfinished[0] += statistics.isFinished ? 0 : 1;
+			if ( statistics.numImages==0 )
+				success = false;
+		}
+		for ( std::size_t j=i; j<coroutineStatistics.size(); j+=numDevices )
+		{
+			const ConsumerStatistics& statistics = coroutineStatistics[j];
+			numImages[1] += statistics.numImages;
+			numErrors[1] += statistics.numErrors;
+			numUnfinished[1] += statistics.isFinished ? 0 : 1;
+			if ( statistics.numImages==0 )
+				success = false;
+		}
+		printf( "%s: %llu frames delivered - waiters: %llu images, %u errors, %u unfinished - coroutines: %llu images, %u errors, %u unfinished\n",
+				devices[i]->getName().c_str(), devices[i]->getFrameCounters().numDeliveredFrames, 
+				numImages[0], numErrors[0], numUnfinished[0], numImages[1], numErrors[1], numUnfinished[1] );
+		if ( numErrors[0]>0 || numErrors[1]>0 || numUnfinished[0]>0 || numUnfinished[1]>0 )
+			success = false;
+	}
+
+	// Overlapping starts and stops
+	for ( std::size_t i=0; i<devices.size(); ++i )
+	{
+		RDShow::Device* device = devices[i];
+		std::future<bool> firstStart = device->startCaptureAsync( 0 );
+		std::future<void> firstStop = device->stopCaptureAsync();
+		std::future<bool> secondStart = device->startCaptureAsync( 0 );
+		bool isStarted = firstStart.get() && secondStart.get();
+		firstStop.get();
+		bool wasCapturing = device->isCapturing();
+		device->stopCaptureAsync().get();
+		printf( "%s: overlapping starts and stops %s, %s in the end\n", device->getName().c_str(), 
+				isStarted ? "succeeded" : "failed", wasCapturing ? "capturing" : "stopped" );
+		if ( !isStarted || !wasCapturing || device->isCapturing() )
+			success = false;
+	}
+
+	// Left pending: deleting the devices along with the DeviceManager waits for them
+	for ( std::size_t i=0; i<devices.size(); ++i )
+	{
+		devices[i]->startCaptureAsync( 0 );
+		devices[i]->stopCaptureAsync();
+	}
+
+	printf( success ? "SUCCESS\n" : "FAILURE\n" );
+	return success ? 0 : 1;
+}
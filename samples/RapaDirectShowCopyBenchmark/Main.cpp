@@ -0,0 +1,153 @@
+/*
+   The MIT License (MIT) (http://opensource.org/licenses/MIT)
+   
+   Copyright (c) 2015 Jacques Menuet
+   
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+   
+   The above copyright notice and this permission notice shall be included in all
+   copies or substantial portions of the Software.
+   
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+*/
+#include "RDShowCopyEngine.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include <chrono>
+#include <thread>
+
+// Measures the throughput of the different copy methods of the CopyEngine for a range of 
+// block sizes, as well as their impact on a working set that another piece of code would 
+// like to keep in the cache. The output helps choosing the thresholds of the CopyEngine
+// on a given machine.
+
+typedef std::chrono::high_resolution_clock Clock;
+
+static double getElapsedInSec( Clock::time_point start )
+{
+	return std::chrono::duration<double>( Clock::now() - start ).count();
+}
+
+// Sum the working set. The value is returned so the compiler can't optimize it away
+static unsigned int readWorkingSet( const std::vector<unsigned char>& workingSet )
+{
+	unsigned int sum = 0;
+	for ( std::size_t i=0; i<workingSet.size(); i+=64 )
+		sum += workingSet[i];
+	return sum;
+}
+
+enum Method
+{
+	Memcpy,
+	NonTemporal,
+	Parallel,
+	MethodCount
+};
+
+// Return the time of one copy plus the time to read the working set again afterwards, 
+// averaged over several iterations, in seconds
+static double measure( Method method, unsigned char* dest, const unsigned char* src, std::size_t numBytes, unsigned int numThreads, 
+					   const std::vector<unsigned char>& workingSet, double& workingSetTime, unsigned int& checksum )
+{
+	std::size_t numIterations = 1 + (256 * 1024 * 1024) / numBytes;
+	if ( numIterations>1000 )
+		numIterations = 1000;
+	
+	double copyTime = 0;
+	workingSetTime = 0;
+	for ( std::size_t i=0; i<numIterations; ++i )
+	{
+		checksum += readWorkingSet( workingSet );		// Bring the working set in the cache
+
+		Clock::time_point start = Clock::now();
+		switch ( method )
+		{
+			case Memcpy:		memcpy( dest, src, numBytes ); break;
+			case NonTemporal:	RDShow::CopyEngine::copyNonTemporal( dest, src, numBytes ); break;
+			case Parallel:		RDShow::CopyEngine::copyParallel( dest, src, numBytes, numThreads, true ); break;
+			default: break;
+		}
+		copyTime += getElapsedInSec( start );
+
+		start = Clock::now();
+		checksum += readWorkingSet( workingSet );		// How much of it is still in the cache?
+		workingSetTime += getElapsedInSec( start );
+	}
+	workingSetTime /= numIterations;
+	return copyTime / numIterations;
+}
+
+int main()
+{
+	unsigned int numThreads = std::thread::hardware_concurrency();
+	if ( numThreads<2 )
+		numThreads = 2;
+
+	const std::size_t maxSize = 64 * 1024 * 1024;
+	std::vector<unsigned char> source( maxSize, 1 );
+	std::vector<unsigned char> destination( maxSize, 0 );
+	std::vector<unsigned char> workingSet( 4 * 1024 * 1024, 2 );
+	unsigned int checksum = 0;
+
+	printf( "Non-temporal stores supported: %s\n", RDShow::CopyEngine::isNonTemporalSupported() ? "yes" : "no" );
+	printf( "Parallel copies use %u threads\n", numThreads );
+	printf( "Working set size: %u KB\n\n", static_cast<unsigned int>(workingSet.size()/1024) );
+	printf( "%10s | %-24s | %-24s | %-24s\n", "", "memcpy", "non-temporal", "parallel non-temporal" );
+	printf( "%10s | %10s %13s | %10s %13s | %10s %13s\n", "size (KB)", "GB/s", "re-read (us)", "GB/s", "re-read (us)", "GB/s", "re-read (us)" );
+
+	std::size_t nonTemporalCrossover = 0;
+	std::size_t parallelCrossover = 0;
+	for ( std::size_t numBytes=64*1024; numBytes<=maxSize; numBytes*=2 )
+	{
+		double copyTimes[MethodCount];
+		double workingSetTimes[MethodCount];
+		for ( int method=0; method<MethodCount; ++method )
+			copyTimes[method] = measure( static_cast<Method>(method), &destination[0], &source[0], numBytes, numThreads, workingSet, workingSetTimes[method], checksum );
+
+		printf( "%10u |", static_cast<unsigned int>(numBytes/1024) );
+		for ( int method=0; method<MethodCount; ++method )
+			printf( " %10.2f %13.1f |", numBytes / copyTimes[method] / 1e9, workingSetTimes[method] * 1e6 );
+		printf( "\n" );
+
+		// The crossover is the size from which a method stays cheaper once the cost of 
+		// re-reading the working set is taken into account
+		double memcpyCost = copyTimes[Memcpy] + workingSetTimes[Memcpy];
+		double nonTemporalCost = copyTimes[NonTemporal] + workingSetTimes[NonTemporal];
+		double parallelCost = copyTimes[Parallel] + workingSetTimes[Parallel];
+		if ( nonTemporalCost>=memcpyCost )
+			nonTemporalCrossover = 0;
+		else if ( nonTemporalCrossover==0 )
+			nonTemporalCrossover = numBytes;
+		if ( parallelCost>=nonTemporalCost || parallelCost>=memcpyCost )
+			parallelCrossover = 0;
+		else if ( parallelCrossover==0 )
+			parallelCrossover = numBytes;
+	}
+
+	printf( "\nSuggested settings:\n" );
+	if ( nonTemporalCrossover )
+		printf( "  CopyEngine::setNonTemporalThreshold( %u*1024 )\n", static_cast<unsigned int>(nonTemporalCrossover/1024) );
+	else
+		printf( "  Non-temporal copies never won, keep the threshold above %u KB\n", static_cast<unsigned int>(maxSize/1024) );
+	if ( parallelCrossover )
+		printf( "  CopyEngine::setParallelThreshold( %u*1024 ) and CopyEngine::setMaxNumThreads( %u )\n", static_cast<unsigned int>(parallelCrossover/1024), numThreads );
+	else
+		printf( "  Parallel copies never won, keep CopyEngine::setMaxNumThreads( 1 )\n" );
+	
+	printf( "(checksum %u)\n", checksum );
+	return 0;
+}
@@ -0,0 +1,137 @@
+/*
+   The MIT License (MIT) (http://opensource.org/licenses/MIT)
+   
+   Copyright (c) 2015 Jacques Menuet
+   
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+   
+   The above copyright notice and this permission notice shall be included in all
+   copies or substantial portions of the Software.
+   
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+*/
+#include "RDShowMemoryBuffer.h"
+#include "RDShowMappedFile.h"
+#include "RDShowImage.h"
+#include "RDShowImageConverter.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <string>
+
+// Maps a temporary file, writes to it through a ReadWrite mapping and reads it back through 
+// a ReadOnly one. The region starts off a page boundary and spans several pages. Every way of 
+// writing to the ReadOnly mapping must be refused rather than crash on the protected pages.
+// Returns a non-zero value on failure.
+//
+// Usage: RapaDirectShowMappedFileTest [temporaryFilename]
+
+static bool check( bool condition, const char* description )
+{
+	if ( !condition )
+		printf( "Failed: %s\n", description );
+	return condition;
+}
+
+static bool hasPattern( const unsigned char* bytes, unsigned int sizeInBytes, unsigned char seed )
+{
+	for ( unsigned int i=0; i<sizeInBytes; ++i )
+	{
+		if ( bytes[i]!=static_cast<unsigned char>( seed + i * 7 ) )
+			return false;
+	}
+	return true;
+}
+
+int main( int argc, char* argv[] )
+{
+	std::string filename = "RapaDirectShowMappedFileTest.tmp";
+	if ( argc>1 )
+		filename = argv[1];
+	remove( filename.c_str() );
+
+	const unsigned long long offset = 100;
+	const unsigned int width = 64;
+	const unsigned int height = 48;
+	const RDShow::ImageFormat imageFormat( width, height, RDShow::ImageFormat::RGB24 );
+	const unsigned int sizeInBytes = imageFormat.getDataSizeInBytes();
+
+	bool success = true;
+
+	// Write path: the file is created and grown to contain the region
+	{
+		RDShow::MemoryBuffer buffer( filename, offset, sizeInBytes, RDShow::MappedFile::ReadWrite );
+		success &= check( buffer.isMapped() && buffer.getSizeInBytes()==sizeInBytes, "ReadWrite mapping" );
+		success &= check( !buffer.isReadOnly() && buffer.getWritableBytes()!=NULL, "ReadWrite mapping is writable" );
+		if ( !success )
+		{
+			printf( "FAILURE\n" );
+			return 1;
+		}
+
+		success &= check( buffer.fill( 0x5A ), "fill() of a ReadWrite mapping" );
+		unsigned char* bytes = buffer.getWritableBytes();
+		for ( unsigned int i=0; i<sizeInBytes; ++i )
+			bytes[i] = static_cast<unsigned char>( 1 + i * 7 );
+		success &= check( buffer.flush(), "flush()" );
+
+		// DontNeed drops the pages from the process, the data must survive in the page cache
+		success &= check( buffer.advise( RDShow::MappedFile::Sequential ), "Sequential advice" );
+		success &= check( buffer.advise( RDShow::MappedFile::WillNeed ), "WillNeed advice" );
+		success &= check( buffer.advise( RDShow::MappedFile::DontNeed ), "DontNeed advice" );
+		success &= check( hasPattern( buffer.getBytes(), sizeInBytes, 1 ), "Content after DontNeed" );
+		success &= check( buffer.advise( RDShow::MappedFile::Normal ), "Normal advice" );
+	}
+
+	// Read path: a ReadOnly mapping of the same region sees what was written
+	{
+		RDShow::Image image( imageFormat, filename, offset, RDShow::MappedFile::ReadOnly );
+		RDShow::MemoryBuffer& buffer = image.getBuffer();
+		const RDShow::MemoryBuffer& constBuffer = buffer;
+		success &= check( buffer.isMapped() && buffer.getSizeInBytes()==sizeInBytes, "ReadOnly mapping" );
+		success &= check( buffer.isReadOnly(), "ReadOnly mapping is read-only" );
+		success &= check( constBuffer.getBytes()!=NULL && hasPattern( constBuffer.getBytes(), sizeInBytes, 1 ), "Content of the ReadOnly mapping" );
+
+		// Writes are refused
+		success &= check( !buffer.fill( 0 ), "fill() of a ReadOnly mapping refused" );
+		RDShow::MemoryBuffer source( sizeInBytes );
+		success &= check( !buffer.copyFrom( source ), "copyFrom() into a ReadOnly mapping refused" );
+		RDShow::Image sourceImage( RDShow::ImageFormat( width, height, RDShow::ImageFormat::BGR24 ) );
+		success &= check( !RDShow::ImageConverter::convertImage( sourceImage, image ), "Conversion into a ReadOnly mapping refused" );
+		success &= check( hasPattern( constBuffer.getBytes(), sizeInBytes, 1 ), "ReadOnly mapping unchanged" );
+		success &= check( buffer.advise( RDShow::MappedFile::DontNeed ), "DontNeed advice on a ReadOnly mapping" );
+
+		// So is a buffer borrowing someone else's bytes
+		RDShow::MemoryBuffer borrowedBuffer( constBuffer.getBytes(), sizeInBytes );
+		success &= check( borrowedBuffer.isReadOnly() && !borrowedBuffer.fill( 0 ), "fill() of borrowed bytes refused" );
+
+		// A ReadWrite mapping writes through to the ReadOnly one
+		RDShow::MemoryBuffer writer( filename, offset, sizeInBytes, RDShow::MappedFile::ReadWrite );
+		for ( unsigned int i=0; i<sizeInBytes; ++i )
+			source.getWritableBytes()[i] = static_cast<unsigned char>( 2 + i * 7 );
+		success &= check( writer.copyFrom( source ), "copyFrom() into a ReadWrite mapping" );
+		success &= check( hasPattern( constBuffer.getBytes(), sizeInBytes, 2 ), "ReadOnly mapping sees the writes" );
+	}
+
+	// A ReadOnly mapping can't extend past the end of the file
+	{
+		RDShow::MemoryBuffer buffer( filename, offset + sizeInBytes, sizeInBytes, RDShow::MappedFile::ReadOnly );
+		success &= check( !buffer.isMapped() && buffer.getSizeInBytes()==0, "ReadOnly mapping past the end of the file refused" );
+	}
+
+	remove( filename.c_str() );
+
+	printf( success ? "SUCCESS\n" : "FAILURE\n" );
+	return success ? 0 : 1;
+}
@@ -23,17 +23,25 @@
 */
 #include "RDShowDeviceManager.h"
 #include "RDShowDevice.h"
+#include "RDShowSyntheticDeviceBackend.h"
 
 #include <stdio.h>
 #include <assert.h>
-
-#define WIN32_LEAN_AND_MEAN 
-#define NOMINMAX 
-#include <windows.h>
+#include <chrono>
+#include <thread>
 
 int main()
 {
 	RDShow::DeviceManager* deviceManager = new RDShow::DeviceManager();
+
+	// A synthetic device, so there's something to capture from even without camera.
+	// The DirectShow devices come first when there are some
+	RDShow::SyntheticDeviceBackend* syntheticBackend = new RDShow::SyntheticDeviceBackend();
+	RDShow::CaptureSettingsList captureSettingsList;
+	captureSettingsList.push_back( RDShow::CaptureSettings( RDShow::ImageFormat( 640, 480, RDShow::ImageFormat::BGR24 ), 30.f ) );
+	syntheticBackend->addDevice( "Test pattern", captureSettingsList );
+	deviceManager->addBackend( syntheticBackend );
+
 	deviceManager->update();
 	
 	if ( deviceManager->getDevices().empty() )
@@ -51,7 +59,7 @@ int main()
 			printf("start:%d", ret);
 		}
 		
-		::Sleep(100);
+		std::this_thread::sleep_for( std::chrono::milliseconds(100) );
 		
 		printf(".");
 		if ( i==20 || i==40 )
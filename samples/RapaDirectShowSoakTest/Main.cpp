@@ -0,0 +1,752 @@
+/*
+   The MIT License (MIT) (http://opensource.org/licenses/MIT)
+   
+   Copyright (c) 2015 Jacques Menuet
+   
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+   
+   The above copyright notice and this permission notice shall be included in all
+   copies or substantial portions of the Software.
+   
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+*/
+#include "RDShowDeviceManager.h"
+#include "RDShowDevice.h"
+#include "RDShowSyntheticDeviceBackend.h"
+#include "RDShowAllocationTracker.h"
+#include "RDShowMemoryAccounting.h"
+#include "RDShowScratchArena.h"
+#include "RDShowClock.h"
+#include "RDShowImageConverter.h"
+#include "RDShowTracer.h"
+#include "RDShowLock.h"
+#include "RDShowThread.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include <chrono>
+#include <thread>
+#include <atomic>
+
+// Before the capture, checks that the MemoryAccounting only counts the buffers that allocate, 
+// and that a ScratchArena stops touching the heap once it has seen its peak frame.
+// Captures from several synthetic devices for a while and checks the frame counters embedded 
+// in the images and their timestamps: they must always increase. This is checked for the images received at each
+// update, as well as for the ones received on the capture threads by a RealTimeListener.
+// Reports the received frame rate of each device, its frame counters and the latency between 
+// the arrival of the images and their processing. The frame counters must match what the 
+// listeners observed. The images are also converted to RGB24 at each update, and the latency 
+// percentiles of each stage are reported, as well as the contention on the library's locks 
+// and the statistics each device measured just before the end.
+// Each device also feeds two FrameSubscriptions consumed by their own threads: a lossless one 
+// (Block policy) that must get every image, and a low-latency one (DropOldest, depth 1) whose 
+// counters must match the images it missed.
+// Meanwhile, another thread keeps adding and removing a Listener and a RealTimeListener 
+// on each device: they must get images, and the capture must not notice.
+// At the end, a Listener removes itself and stops the capture from its callback, in the 
+// middle of the update going through the Listeners. And the image a subscription's consumer 
+// holds across a restart of the capture must not be recycled for the new images.
+// A few more threads keep reading the newest image of every device from its latest image 
+// slot: the images must never be torn and must get newer.
+// The capture threads ask for an above normal priority: the priority they actually got is 
+// reported, as it takes privileges on Linux.
+// When the library is built with allocation tracking, the program aborts on the first heap 
+// allocation made on the capture or delivery paths once they're warmed up.
+// Returns a non-zero value on failure.
+//
+// With a frame queue, every image is seen unless the queue overflows between two updates.
+// With consumer threads, the devices are updated by a pool of threads waiting for any of 
+// them to have a new image instead of the main thread. With "workers" instead of a number of 
+// consumer threads, the DeviceManager runs in threaded mode: each device is updated by its 
+// own worker thread ("pinned-workers" also pins each worker to a CPU). With "batch", the 
+// devices are in batch mode: the main thread takes all their queued images at once every few 
+// frames, checks each of them and converts the newest one.
+//
+// When the library is built with tracing and a trace file is given, the timeline of the 
+// capture is written to it in the Chrome trace format.
+//
+// Usage: RapaDirectShowSoakTest [numDevices] [durationInSec] [frameRate] [frameQueueDepth] [numConsumerThreads|workers|pinned-workers|batch] [traceFile]
+
+typedef std::chrono::steady_clock Clock;
+
+class FrameCounterChecker
+{
+public:
+	FrameCounterChecker()
+		: numImages(0),
+		  numSkippedFrames(0),
+		  numErrors(0),
+		  numSequenceGaps(0),
+		  totalLatencyInNs(0),
+		  maxLatencyInNs(0),
+		  lastSequenceNumber(0),
+		  lastFrameCounter(0),
+		  lastTimestampInNs(0)
+	{
+	}
+
+	void check( const RDShow::CapturedImage& capturedImage )
+	{
+		if ( capturedImage.getSequenceNumber()==lastSequenceNumber )
+			return;
+		numSequenceGaps += capturedImage.getSequenceNumber() - lastSequenceNumber - 1;
+		lastSequenceNumber = capturedImage.getSequenceNumber();
+
+		long long latencyInNs = RDShow::Clock::getTimeInNs() - capturedImage.getArrivalTimeInNs();
+		totalLatencyInNs += latencyInNs;
+		if ( latencyInNs>maxLatencyInNs )
+			maxLatencyInNs = latencyInNs;
+
+		unsigned int frameCounter = 0;
+		if ( !RDShow::SyntheticDeviceInternals::readFrameCounter( capturedImage.getImage(), frameCounter ) )
+		{
+			numErrors++;
+			return;
+		}
+
+		// Without frame queue, frames produced between two updates are legitimately skipped 
+		// as only the latest one is kept 
+		if ( numImages>0 )
+		{
+			if ( frameCounter<=lastFrameCounter || capturedImage.getTimestampInNs()<=lastTimestampInNs )
+				numErrors++;
+			else
+				numSkippedFrames += frameCounter - lastFrameCounter - 1;
+		}
+		lastFrameCounter = frameCounter;
+		lastTimestampInNs = capturedImage.getTimestampInNs();
+		numImages++;
+	}
+
+	unsigned int	numImages;
+	unsigned int	numSkippedFrames;
+	unsigned int	numErrors;
+	unsigned int	numSequenceGaps;		// The images the library didn't pass on
+	long long		totalLatencyInNs;
+	long long		maxLatencyInNs;
+
+	double			getAverageLatencyInMs() const	{ return numImages>0 ? totalLatencyInNs / 1e6 / numImages : 0; }
+	double			getMaxLatencyInMs() const		{ return maxLatencyInNs / 1e6; }
+
+private:
+	unsigned int	lastSequenceNumber;
+	unsigned int	lastFrameCounter;
+	long long		lastTimestampInNs;
+};
+
+class SoakListener : public RDShow::Device::Listener, public RDShow::Device::RealTimeListener
+{
+public:
+	SoakListener()
+		: converter(NULL)
+	{
+	}
+
+	virtual void onDeviceCapturedImage( RDShow::Device* device )
+	{
+		polledImages.check( *device->getCapturedImage() );
+		if ( converter )
+			converter->update( *device->getCapturedImage() );
+	}
+
+	// Called on the capture thread
+	virtual void onDeviceCapturedImage( RDShow::Device* /*device*/, const RDShow::CapturedImage& image )
+	{
+		realTimeImages.check( image );
+	}
+
+	FrameCounterChecker		polledImages;
+	FrameCounterChecker		realTimeImages;		// Only touched by the capture thread while capturing
+	RDShow::ImageConverter*	converter;
+};
+
+// Added and removed over and over while capturing
+class ChurnListener : public RDShow::Device::Listener, public RDShow::Device::RealTimeListener
+{
+public:
+	ChurnListener()
+		: numImages(0),
+		  numRealTimeImages(0)
+	{
+	}
+
+	virtual void onDeviceCapturedImage( RDShow::Device* /*device*/ )
+	{
+		numImages++;
+	}
+
+	virtual void onDeviceCapturedImage( RDShow::Device* /*device*/, const RDShow::CapturedImage& /*image*/ )
+	{
+		numRealTimeImages++;
+	}
+
+	std::atomic<unsigned int>	numImages;
+	std::atomic<unsigned int>	numRealTimeImages;
+};
+
+// Removes itself and stops the capture on its first image
+class SelfStoppingListener : public RDShow::Device::Listener
+{
+public:
+	SelfStoppingListener()
+		: numImages(0),
+		  hasRemovedItself(false)
+	{
+	}
+
+	virtual void onDeviceCapturedImage( RDShow::Device* device )
+	{
+		numImages++;
+		hasRemovedItself = device->removeListener( this );
+		device->stopCapture();
+	}
+
+	std::atomic<unsigned int>	numImages;
+	std::atomic<bool>			hasRemovedItself;
+};
+
+// Reads the newest image of each device, until told to stop
+class LatestImageReader
+{
+public:
+	LatestImageReader()
+		: devices(NULL),
+		  stopRequested(false)
+	{
+	}
+
+	void run()
+	{
+		std::vector<RDShow::CapturedImage> images;
+		for ( std::size_t i=0; i<devices->size(); ++i )
+			images.push_back( RDShow::CapturedImage( (*devices)[i]->getSupportedCaptureSettingsList()[0].getImageFormat() ) );
+		checkers.resize( devices->size() );
+		while ( !stopRequested )
+		{
+			bool hasReadImages = false;
+			for ( std::size_t i=0; i<devices->size(); ++i )
+			{
+				if ( (*devices)[i]->readLatestImage( images[i], images[i].getSequenceNumber() ) )
+				{
+					checkers[i].check( images[i] );
+					hasReadImages = true;
+				}
+			}
+			if ( !hasReadImages )
+				std::this_thread::sleep_for( std::chrono::milliseconds(1) );
+		}
+	}
+
+	const RDShow::Devices*				devices;
+	std::atomic<bool>					stopRequested;
+	std::vector<FrameCounterChecker>	checkers;
+};
+
+// Consumes a FrameSubscription on its own thread, until told to stop and the queue is drained
+class SubscriptionConsumer
+{
+public:
+	SubscriptionConsumer()
+		: subscription(NULL),
+		  stopRequested(false)
+	{
+	}
+
+	void run()
+	{
+		for (;;)
+		{
+			const RDShow::CapturedImage* image = subscription->acquireImage( 100 );
+			if ( image )
+				images.check( *image );
+			else if ( stopRequested )
+				break;
+		}
+		subscription->releaseImage();
+	}
+
+	RDShow::FrameSubscription*	subscription;
+	std::atomic<bool>			stopRequested;		// Once the capture stopped
+	FrameCounterChecker			images;
+};
+
+void printLatencyHistograms( const RDShow::Device* device )
+{
+	const char* stageNames[RDShow::Device::NumLatencyStages] = { "delivery", "queueing", "listener", "conversion", "end-to-end" };
+	for ( int stage=0; stage<RDShow::Device::NumLatencyStages; ++stage )
+	{
+		RDShow::LatencyHistogram::Snapshot snapshot = device->getLatencyHistogram( static_cast<RDShow::Device::LatencyStage>(stage) ).getSnapshot();
+		printf( "    %-10s: %6llu samples, p50 %8.1f us, p99 %8.1f us, p999 %8.1f us, max %8.1f us\n", stageNames[stage], 
+				snapshot.getNumSamples(), snapshot.getPercentileInNs(50) / 1e3, snapshot.getPercentileInNs(99) / 1e3, 
+				snapshot.getPercentileInNs(99.9) / 1e3, snapshot.getMaxInNs() / 1e3 );
+	}
+}
+
+// Empty buffers (default-constructed, failed mappings) don't allocate and mustn't count as 
+// deallocations. A heap buffer is counted once each way, under its tag
+bool checkMemoryAccounting()
+{
+	RDShow::MemoryAccounting::Snapshot before;
+	RDShow::MemoryAccounting::getSnapshot( before );
+	{
+		RDShow::Image emptyImage;
+		RDShow::MemoryBuffer emptyBuffer;
+		RDShow::MemoryBuffer failedMapping( "RapaDirectShowSoakTest/does/not/exist", 0, 1024, RDShow::MappedFile::ReadOnly );
+		RDShow::MemoryBuffer heapBuffer( 1000, RDShow::MemoryAccounting::Viewer );
+	}
+	RDShow::MemoryAccounting::Snapshot after;
+	RDShow::MemoryAccounting::getSnapshot( after );
+
+	const RDShow::MemoryAccounting::Counters& total = after.getCounters();
+	const RDShow::MemoryAccounting::Counters& tagged = after.getCounters( RDShow::MemoryAccounting::Viewer );
+	const RDShow::MemoryAccounting::Counters& untagged = after.getCounters( RDShow::MemoryAccounting::Untagged );
+	bool success = total.numAllocations - before.getCounters().numAllocations==1 && 
+				   total.numDeallocations - before.getCounters().numDeallocations==1 &&
+				   total.liveSizeInBytes==before.getCounters().liveSizeInBytes &&
+				   total.peakSizeInBytes>=before.getCounters().liveSizeInBytes + 1000 &&
+				   tagged.numAllocations - before.getCounters( RDShow::MemoryAccounting::Viewer ).numAllocations==1 &&
+				   tagged.numDeallocations - before.getCounters( RDShow::MemoryAccounting::Viewer ).numDeallocations==1 &&
+				   tagged.liveSizeInBytes==before.getCounters( RDShow::MemoryAccounting::Viewer ).liveSizeInBytes &&
+				   untagged.numDeallocations==before.getCounters( RDShow::MemoryAccounting::Untagged ).numDeallocations;
+	printf( "Memory accounting: %s - %s\n", success ? "consistent" : "inconsistent", after.toString().c_str() );
+	return success;
+}
+
+// An arena too small for a frame serves the first one from overflow blocks. The next reset 
+// grows its block to the peak: from then on, each frame comes from that single block. The 
+// frames past the warm-up ones are hot paths for the AllocationTracker, which aborts on 
+// any allocation when it's available
+bool checkScratchArena( unsigned int numWarmUpFrames )
+{
+	RDShow::ScratchArena arena( 64 * 1024 );
+	bool success = true;
+	for ( unsigned int frameNumber=1; frameNumber<=numWarmUpFrames + 5; ++frameNumber )
+	{
+		RDShow::MemoryAccounting::Snapshot before;
+		RDShow::MemoryAccounting::getSnapshot( before );
+		{
+			RDShow::AllocationTracker::Scope allocationScope( frameNumber );
+			arena.reset();
+			RDShow::Image convertedImage( RDShow::ImageFormat( 640, 480, RDShow::ImageFormat::RGB24 ), arena );
+			RDShow::Image paddedImage( RDShow::ImageFormat( 640, 480, RDShow::ImageFormat::BGRX32 ), arena );
+			memset( convertedImage.getBuffer().getWritableBytes(), 0, convertedImage.getBuffer().getSizeInBytes() );
+			memset( paddedImage.getBuffer().getWritableBytes(), 0, paddedImage.getBuffer().getSizeInBytes() );
+		}
+		RDShow::MemoryAccounting::Snapshot after;
+		RDShow::MemoryAccounting::getSnapshot( after );
+
+		// The first frame overflows, the second one grows the block
+		unsigned long long numAllocations = after.getCounters( RDShow::MemoryAccounting::Scratch ).numAllocations - 
+											before.getCounters( RDShow::MemoryAccounting::Scratch ).numAllocations;
+		if ( frameNumber==1 )
+			success &= arena.getNumOverflowBlocks()>0;
+		else 
+			success &= arena.getNumOverflowBlocks()==0 && arena.getCapacityInBytes()>=arena.getPeakUsedSizeInBytes() && 
+					   numAllocations==(frameNumber==2 ? 1u : 0u);
+	}
+	printf( "Scratch arena: %s, %u bytes block for a %u bytes peak\n", success ? "no allocation after the first frames" : "still allocating", 
+			arena.getCapacityInBytes(), arena.getPeakUsedSizeInBytes() );
+	return success;
+}
+
+int main( int argc, char* argv[] )
+{
+	unsigned int numDevices = argc>1 ? atoi(argv[1]) : 4;
+	double durationInSec = argc>2 ? atof(argv[2]) : 10.0;
+	float frameRate = argc>3 ? static_cast<float>( atof(argv[3]) ) : 60.f;
+	unsigned int frameQueueDepth = argc>4 ? atoi(argv[4]) : 0;
+	unsigned int numConsumerThreads = argc>5 ? atoi(argv[5]) : 0;
+	bool useWorkerThreads = argc>5 && ( strcmp( argv[5], "workers" )==0 || strcmp( argv[5], "pinned-workers" )==0 );
+	bool pinWorkerThreads = argc>5 && strcmp( argv[5], "pinned-workers" )==0;
+	bool useBatches = argc>5 && strcmp( argv[5], "batch" )==0;
+	const char* traceFilename = argc>6 ? argv[6] : NULL;
+
+	if ( !checkMemoryAccounting() )
+	{
+		printf( "FAILURE\n" );
+		return 1;
+	}
+
+	RDShow::DeviceManager deviceManager;
+	RDShow::SyntheticDeviceBackend* backend = new RDShow::SyntheticDeviceBackend();
+	
+	// Cycle through the encodings and patterns
+	const RDShow::ImageFormat::Encoding encodings[] = 
+		{ RDShow::ImageFormat::RGB24, RDShow::ImageFormat::BGR24, RDShow::ImageFormat::BGRX32, RDShow::ImageFormat::YUYV };
+	for ( unsigned int i=0; i<numDevices; ++i )
+	{
+		RDShow::CaptureSettingsList captureSettingsList;
+		captureSettingsList.push_back( RDShow::CaptureSettings( RDShow::ImageFormat( 640, 480, encodings[i%4] ), frameRate ) );
+		char name[32];
+		sprintf( name, "Soak%u", i );
+		RDShow::SyntheticDeviceInternals::Pattern pattern = (i/4)%2==0 ? RDShow::SyntheticDeviceInternals::ColorBars : RDShow::SyntheticDeviceInternals::Gradient;
+		backend->addDevice( name, captureSettingsList, pattern );
+	}
+	deviceManager.addBackend( backend );
+	deviceManager.setThreadedMode( useWorkerThreads, pinWorkerThreads );
+	RDShow::Thread::Settings captureThreadSettings;
+	captureThreadSettings.priority = RDShow::Thread::Settings::AboveNormal;
+	deviceManager.setThreadSettings( RDShow::Device::CaptureThread, captureThreadSettings );
+	deviceManager.update();
+
+	const RDShow::Devices& devices = deviceManager.getDevices();
+	if ( devices.size()!=numDevices )
+	{
+		printf("Expected %u devices, got %u\n", numDevices, static_cast<unsigned int>(devices.size()) );
+		return 1;
+	}
+
+	if ( RDShow::AllocationTracker::isAvailable() )
+	{
+		RDShow::AllocationTracker::setNumWarmUpFrames( 10 );
+		RDShow::AllocationTracker::setMode( RDShow::AllocationTracker::Fail );
+		printf("Allocation tracking: abort on hot path allocation after 10 frames\n");
+	}
+	else
+	{
+		printf("Allocation tracking: not available (build with RAPADIRECTSHOW_TRACK_ALLOCATIONS)\n");
+	}
+
+	if ( !checkScratchArena( 10 ) )
+	{
+		printf( "FAILURE\n" );
+		return 1;
+	}
+
+	if ( traceFilename )
+	{
+		if ( RDShow::Tracer::isAvailable() )
+		{
+			RDShow::Tracer::setCurrentThreadName( "Main" );
+			RDShow::Tracer::setEnabled( true );
+		}
+		else
+		{
+			printf("Tracing: not available (build with RAPADIRECTSHOW_ENABLE_TRACING)\n");
+		}
+	}
+
+	RDShow::Lock::setStatisticsEnabled( true );
+
+	Clock::time_point startTime = Clock::now();
+	std::vector<SoakListener> listeners( numDevices );
+	std::vector<SubscriptionConsumer> losslessConsumers( numDevices );
+	std::vector<SubscriptionConsumer> latestConsumers( numDevices );
+	for ( std::size_t i=0; i<devices.size(); ++i )
+	{
+		const RDShow::ImageFormat& imageFormat = devices[i]->getSupportedCaptureSettingsList()[0].getImageFormat();
+		listeners[i].converter = new RDShow::ImageConverter( RDShow::ImageFormat( imageFormat.getWidth(), imageFormat.getHeight(), RDShow::ImageFormat::RGB24 ) );
+		listeners[i].converter->setLatencyHistogram( &devices[i]->getLatencyHistogram( RDShow::Device::ConversionStage ) );
+		devices[i]->addListener( &listeners[i] );
+		devices[i]->addRealTimeListener( &listeners[i] );
+		devices[i]->setFrameQueueDepth( frameQueueDepth );
+		devices[i]->setBatchModeEnabled( useBatches );
+		devices[i]->setLatestImageSlotEnabled( true );
+		losslessConsumers[i].subscription = devices[i]->createFrameSubscription( RDShow::FrameSubscription::Block, 4, 1000 );
+		latestConsumers[i].subscription = devices[i]->createFrameSubscription( RDShow::FrameSubscription::DropOldest, 1 );
+		if ( !devices[i]->startCapture( 0 ) )
+		{
+			printf("Failed to start %s\n", devices[i]->getName().c_str() );
+			return 1;
+		}
+	}
+
+	std::vector<std::thread> subscriptionThreads;
+	for ( unsigned int i=0; i<numDevices; ++i )
+	{
+		subscriptionThreads.push_back( std::thread( &SubscriptionConsumer::run, &losslessConsumers[i] ) );
+		subscriptionThreads.push_back( std::thread( &SubscriptionConsumer::run, &latestConsumers[i] ) );
+	}
+
+	const unsigned int numLatestImageReaders = 3;
+	std::vector<LatestImageReader> latestImageReaders( numLatestImageReaders );
+	std::vector<std::thread> latestImageReaderThreads;
+	for ( unsigned int i=0; i<numLatestImageReaders; ++i )
+	{
+		latestImageReaders[i].devices = &devices;
+		latestImageReaderThreads.push_back( std::thread( &LatestImageReader::run, &latestImageReaders[i] ) );
+	}
+
+	std::atomic<bool> stopConsumers( false );
+	std::vector<ChurnListener> churnListeners( numDevices );
+	std::thread churnThread( [&devices, &churnListeners, &stopConsumers]()
+		{
+			while ( !stopConsumers )
+			{
+				for ( std::size_t i=0; i<devices.size(); ++i )
+				{
+					devices[i]->addListener( &churnListeners[i] );
+					devices[i]->addRealTimeListener( &churnListeners[i] );
+				}
+				std::this_thread::sleep_for( std::chrono::milliseconds(20) );
+				for ( std::size_t i=0; i<devices.size(); ++i )
+				{
+					devices[i]->removeListener( &churnListeners[i] );
+					devices[i]->removeRealTimeListener( &churnListeners[i] );
+				}
+				std::this_thread::sleep_for( std::chrono::milliseconds(5) );
+			}
+		} );
+	std::vector<std::thread> consumerThreads;
+	for ( unsigned int i=0; i<numConsumerThreads; ++i )
+	{
+		consumerThreads.push_back( std::thread( [&deviceManager, &devices, &stopConsumers, i]()
+			{
+				char threadName[32];
+				sprintf( threadName, "Consumer%u", i );
+				RDShow::Tracer::setCurrentThreadName( threadName );
+				RDShow::Devices readyDevices;
+				while ( !stopConsumers )
+				{
+					if ( !deviceManager.waitForAnyImage( devices, readyDevices, 100 ) )
+						continue;
+					for ( std::size_t j=0; j<readyDevices.size(); ++j )
+						readyDevices[j]->update();
+				}
+			} ) );
+	}
+
+	double elapsedInSec = 0;
+	std::vector<unsigned long long> numBatches( numDevices );
+	std::vector<std::size_t> maxBatchSizes( numDevices );
+	while ( elapsedInSec<durationInSec )
+	{
+		if ( useBatches )
+		{
+			// Let a few images queue up
+			std::this_thread::sleep_for( std::chrono::duration<double>( 4.0 / frameRate ) );
+			deviceManager.update();
+			for ( std::size_t i=0; i<devices.size(); ++i )
+			{
+				RDShow::Device::ImageBatch batch;
+				if ( !devices[i]->takeImages( batch ) )
+					continue;
+				for ( std::size_t j=0; j<batch.size(); ++j )
+					listeners[i].polledImages.check( batch[j] );
+				listeners[i].converter->update( batch.back() );
+				numBatches[i]++;
+				if ( batch.size()>maxBatchSizes[i] )
+					maxBatchSizes[i] = batch.size();
+			}
+		}
+		else if ( consumerThreads.empty() && !useWorkerThreads )
+		{
+			// All the devices run at the same frame rate: the first one paces the loop
+			deviceManager.update();
+			devices[0]->waitForNextImage( devices[0]->getCapturedImage()->getSequenceNumber(), 100 );
+		}
+		else
+		{
+			std::this_thread::sleep_for( std::chrono::milliseconds(10) );
+		}
+		elapsedInSec = std::chrono::duration<double>( Clock::now() - startTime ).count();
+	}
+
+	stopConsumers = true;
+	churnThread.join();
+	for ( unsigned int i=0; i<numLatestImageReaders; ++i )
+	{
+		latestImageReaders[i].stopRequested = true;
+		latestImageReaderThreads[i].join();
+	}
+	for ( std::size_t i=0; i<consumerThreads.size(); ++i )
+		consumerThreads[i].join();
+
+	std::vector<RDShow::Device::Statistics> statistics( numDevices );
+	for ( std::size_t i=0; i<devices.size(); ++i )
+		statistics[i] = devices[i]->getStatistics();
+
+	std::vector<std::string> threadSettingsDescriptions( numDevices );
+	for ( std::size_t i=0; i<devices.size(); ++i )
+	{
+		RDShow::Thread::Settings effectiveSettings;
+		threadSettingsDescriptions[i] = "capture thread ";
+		threadSettingsDescriptions[i] += devices[i]->getEffectiveThreadSettings( RDShow::Device::CaptureThread, effectiveSettings ) ? effectiveSettings.toString() : "not started";
+		if ( devices[i]->getEffectiveThreadSettings( RDShow::Device::WorkerThread, effectiveSettings ) )
+			threadSettingsDescriptions[i] += ", worker thread " + effectiveSettings.toString();
+	}
+
+	std::vector<unsigned long long> listenerSkippedFrameCounts( numDevices );
+	for ( std::size_t i=0; i<devices.size(); ++i )
+	{
+		devices[i]->stopCapture();
+		devices[i]->getListenerSkippedFrameCount( &listeners[i], listenerSkippedFrameCounts[i] );
+		devices[i]->removeListener( &listeners[i] );
+		delete listeners[i].converter;
+		listeners[i].converter = NULL;
+		devices[i]->removeRealTimeListener( &listeners[i] );
+		losslessConsumers[i].stopRequested = true;
+		latestConsumers[i].stopRequested = true;
+	}
+	for ( std::size_t i=0; i<subscriptionThreads.size(); ++i )
+		subscriptionThreads[i].join();
+	RDShow::AllocationTracker::setMode( RDShow::AllocationTracker::Disabled );
+
+	if ( traceFilename && RDShow::Tracer::isAvailable() )
+	{
+		RDShow::Tracer::setEnabled( false );
+		if ( RDShow::Tracer::writeChromeTraceFile( traceFilename ) )
+			printf("Trace written to %s\n", traceFilename );
+		else
+			printf("Failed to write the trace to %s\n", traceFilename );
+	}
+
+	bool success = true;
+	for ( std::size_t i=0; i<devices.size(); ++i )
+	{
+		const FrameCounterChecker& polled = listeners[i].polledImages;
+		const FrameCounterChecker& realTime = listeners[i].realTimeImages;
+		const RDShow::CaptureSettings& captureSettings = devices[i]->getSupportedCaptureSettingsList()[0];
+		printf( "%s %s: %u images (%.1f fps for %.1f), %u skipped, %u errors, latency %.2f/%.2f ms (avg/max) - "
+				"real-time: %u images, %u skipped, %u errors, latency %.2f/%.2f ms\n", 
+				devices[i]->getName().c_str(), captureSettings.getImageFormat().toString().c_str(),
+				polled.numImages, polled.numImages / elapsedInSec, captureSettings.getFrameRate(),
+				polled.numSkippedFrames, polled.numErrors, polled.getAverageLatencyInMs(), polled.getMaxLatencyInMs(),
+				realTime.numImages, realTime.numSkippedFrames, realTime.numErrors, realTime.getAverageLatencyInMs(), realTime.getMaxLatencyInMs() );
+		if ( polled.numImages==0 || polled.numErrors>0 || realTime.numImages==0 || realTime.numErrors>0 )
+			success = false;
+
+		// Without any frame in flight, the counters must add up
+		RDShow::Device::FrameCounters counters = devices[i]->getFrameCounters();
+		printf( "    %llu delivered, %llu consumed, %llu overwritten, %llu dropped, %llu skipped (%llu by the listener)\n",
+				counters.numDeliveredFrames, counters.numConsumedFrames, counters.numOverwrittenFrames, 
+				counters.numDroppedFrames, counters.numSkippedFrames, listenerSkippedFrameCounts[i] );
+		if ( counters.numDeliveredFrames!=realTime.numImages || counters.numConsumedFrames!=polled.numImages ||
+			 counters.numConsumedFrames + counters.numOverwrittenFrames + counters.numDroppedFrames>counters.numDeliveredFrames || 
+			 counters.numSkippedFrames!=polled.numSequenceGaps || listenerSkippedFrameCounts[i]!=polled.numSequenceGaps )
+			success = false;
+
+		printf( "    measured %.1f fps (%.1f over 1s), jitter %.2f ms, %.1f MB/s, queue depth %u, listener %.1f us, conversion %.1f us\n",
+				statistics[i].frameRate, statistics[i].windowedFrameRate, statistics[i].frameIntervalJitterInNs / 1e6, 
+				statistics[i].bytesPerSecond / 1e6, statistics[i].queueDepth, 
+				statistics[i].getAverageListenerTimeInNs() / 1e3, statistics[i].getAverageConversionTimeInNs() / 1e3 );
+		printf( "    %s\n", threadSettingsDescriptions[i].c_str() );
+		printf( "    latest image readers:" );
+		for ( unsigned int j=0; j<numLatestImageReaders; ++j )
+		{
+			const FrameCounterChecker& checker = latestImageReaders[j].checkers[i];
+			printf( " %u images (%u errors)", checker.numImages, checker.numErrors );
+			if ( checker.numImages==0 || checker.numErrors>0 )
+				success = false;
+		}
+		printf( "\n" );
+		printf( "    churned listener: %u images, %u real-time\n", churnListeners[i].numImages.load(), churnListeners[i].numRealTimeImages.load() );
+		if ( churnListeners[i].numRealTimeImages==0 || (churnListeners[i].numImages==0 && !useBatches) )
+			success = false;
+		if ( useBatches )
+		{
+			printf( "    %llu batches, %.1f images on average, %u at most\n", numBatches[i], 
+					numBatches[i]>0 ? static_cast<double>(polled.numImages) / numBatches[i] : 0.0, static_cast<unsigned int>(maxBatchSizes[i]) );
+			if ( numBatches[i]==0 )
+				success = false;
+		}
+		printLatencyHistograms( devices[i] );
+
+		// The lossless subscription gets every image, the other one misses exactly the ones it dropped
+		RDShow::FrameSubscription::Counters lossless = losslessConsumers[i].subscription->getCounters();
+		RDShow::FrameSubscription::Counters latest = latestConsumers[i].subscription->getCounters();
+		printf( "    lossless subscription: %llu received, %llu consumed, %llu dropped, %llu blocked (max %.2f ms), %u errors - "
+				"latest: %llu received, %llu consumed, %llu dropped, %u errors\n",
+				lossless.numReceivedFrames, lossless.numConsumedFrames, lossless.numDroppedFrames, lossless.numBlockedFrames, 
+				lossless.maxBlockedTimeInNs / 1e6, losslessConsumers[i].images.numErrors,
+				latest.numReceivedFrames, latest.numConsumedFrames, latest.numDroppedFrames, latestConsumers[i].images.numErrors );
+		if ( lossless.numReceivedFrames==0 || lossless.numDroppedFrames>0 || lossless.numConsumedFrames!=lossless.numReceivedFrames ||
+			 losslessConsumers[i].images.numImages!=lossless.numConsumedFrames || losslessConsumers[i].images.numSequenceGaps>0 ||
+			 losslessConsumers[i].images.numErrors>0 )
+			success = false;
+		if ( latest.numReceivedFrames==0 || latest.numConsumedFrames + latest.numDroppedFrames!=latest.numReceivedFrames ||
+			 latestConsumers[i].images.numImages!=latest.numConsumedFrames || latestConsumers[i].images.numSequenceGaps!=latest.numDroppedFrames ||
+			 latestConsumers[i].images.numErrors>0 )
+			success = false;
+		devices[i]->deleteFrameSubscription( losslessConsumers[i].subscription );
+		devices[i]->deleteFrameSubscription( latestConsumers[i].subscription );
+	}
+
+	// The image the consumer holds is kept out of the new capture's images until it's released
+	{
+		RDShow::Device* device = devices[0];
+		RDShow::FrameSubscription* subscription = device->createFrameSubscription( RDShow::FrameSubscription::DropOldest, 1 );
+		bool isStarted = device->startCapture( 0 );
+		const RDShow::CapturedImage* heldImage = subscription->acquireImage( 1000 );
+		device->stopCapture();
+		bool isRestarted = device->startCapture( 0 );
+		unsigned int heldSequenceNumber = heldImage ? heldImage->getSequenceNumber() : 0;
+		std::vector<unsigned char> heldBytes;
+		if ( heldImage )
+			heldBytes.assign( heldImage->getImage().getBuffer().getBytes(), heldImage->getImage().getBuffer().getBytes() + heldImage->getImage().getBuffer().getSizeInBytes() );
+
+		// More images than the subscription has go through it meanwhile
+		Clock::time_point restartTime = Clock::now();
+		while ( subscription->getCounters().numReceivedFrames<10 && Clock::now() - restartTime<std::chrono::seconds(5) )
+			std::this_thread::sleep_for( std::chrono::milliseconds(5) );
+		bool isHeldImageIntact = heldImage && heldImage->getSequenceNumber()==heldSequenceNumber && 
+			memcmp( heldImage->getImage().getBuffer().getBytes(), heldBytes.data(), heldBytes.size() )==0;
+		unsigned long long numReceivedFrames = subscription->getCounters().numReceivedFrames;
+		device->stopCapture();
+		subscription->releaseImage();
+		device->deleteFrameSubscription( subscription );
+		printf( "Image held across a restart: %s, %llu images received meanwhile\n", isHeldImageIntact ? "intact" : "recycled", numReceivedFrames );
+		if ( !isStarted || !isRestarted || !isHeldImageIntact || numReceivedFrames<10 )
+			success = false;
+	}
+
+	// The Listener after the one that stops the capture is still called for that image, from 
+	// the snapshot of the list the update holds on to
+	{
+		RDShow::Device* device = devices[0];
+		SelfStoppingListener selfStoppingListener;
+		device->setBatchModeEnabled( false );
+		device->addListener( &selfStoppingListener );
+		device->addListener( &churnListeners[0] );
+		unsigned int numChurnImages = churnListeners[0].numImages;
+		bool isStarted = device->startCapture( 0 );
+		Clock::time_point stopStartTime = Clock::now();
+		while ( device->isCapturing() && Clock::now() - stopStartTime<std::chrono::seconds(5) )
+		{
+			deviceManager.update();
+			std::this_thread::sleep_for( std::chrono::milliseconds(5) );
+		}
+		printf( "Self-stopping listener: %u images, %s, %s, next listener called %u times\n", selfStoppingListener.numImages.load(), 
+				selfStoppingListener.hasRemovedItself ? "removed itself" : "not removed", device->isCapturing() ? "still capturing" : "stopped",
+				churnListeners[0].numImages - numChurnImages );
+		if ( !isStarted || selfStoppingListener.numImages!=1 || !selfStoppingListener.hasRemovedItself || device->isCapturing() ||
+			 churnListeners[0].numImages - numChurnImages!=1 )
+			success = false;
+		device->stopCapture();
+		device->removeListener( &churnListeners[0] );
+	}
+
+	std::vector<RDShow::Lock::Statistics> lockStatistics;
+	RDShow::Lock::getAllStatistics( lockStatistics );
+	for ( std::size_t i=0; i<lockStatistics.size(); ++i )
+	{
+		const RDShow::Lock::Statistics& statistics = lockStatistics[i];
+		printf( "Lock %s: %llu acquisitions, %llu contended, wait %.1f/%.1f us (total/max), hold %.1f/%.1f us\n", 
+				statistics.name.c_str(), statistics.numAcquisitions, statistics.numContentions, 
+				statistics.totalWaitTimeInNs / 1e3, statistics.maxWaitTimeInNs / 1e3,
+				statistics.totalHoldTimeInNs / 1e3, statistics.maxHoldTimeInNs / 1e3 );
+	}
+
+	if ( RDShow::AllocationTracker::isAvailable() )
+	{
+		printf("Hot path allocations: %llu\n", RDShow::AllocationTracker::getNumHotPathAllocations() );
+		if ( RDShow::AllocationTracker::getNumHotPathAllocations()>0 )
+			success = false;
+	}
+
+	printf( success ? "SUCCESS\n" : "FAILURE\n" );
+	return success ? 0 : 1;
+}
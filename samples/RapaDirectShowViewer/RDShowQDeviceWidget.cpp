@@ -114,7 +114,7 @@ void QDeviceWidget::onDeviceCapturedImage( Device* device )
 	const RDShow::CapturedImage* capturedImage = device->getCapturedImage();
 	if ( capturedImage )
 	{
-		mImageWidget->setImage( capturedImage->getImage() );
+		mImageWidget->setImage( capturedImage->getImage(), capturedImage->getSequenceNumber() );
 		mImageNumberLabel->setText( QString::number( capturedImage->getSequenceNumber() ) );
 	}
 }
@@ -141,10 +141,11 @@ bool QDeviceWidget::writeRGB24ImageAsPPM( const Image& image, const char* filena
 	return true;
 }
 
-bool QDeviceWidget::writeImageAsPPM( const Image& image, const char* filename )
+bool QDeviceWidget::writeImageAsPPM( const CapturedImage& capturedImage, const char* filename )
 {
-	ImageConverter converter( ImageFormat( image.getFormat().getWidth(), image.getFormat().getHeight(), ImageFormat::RGB24 ) );
-	if ( !converter.update( image ) )
+	const ImageFormat& imageFormat = capturedImage.getImage().getFormat();
+	ImageConverter converter( ImageFormat( imageFormat.getWidth(), imageFormat.getHeight(), ImageFormat::RGB24 ) );
+	if ( !converter.update( capturedImage ) )
 		return false;
 	return writeRGB24ImageAsPPM( converter.getImage(), filename );
 }
@@ -160,7 +161,7 @@ void QDeviceWidget::keyPressEvent( QKeyEvent* event )
 			{
 				std::stringstream stream;
 				stream << mDevice->getName().c_str() << "_" << capturedImage->getSequenceNumber() << ".ppm";
-				writeImageAsPPM( capturedImage->getImage(), stream.str().c_str() );
+				writeImageAsPPM( *capturedImage, stream.str().c_str() );
 			}
 		}
     }
@@ -67,7 +67,7 @@ private slots:
 
 private:
 	static bool					writeRGB24ImageAsPPM( const Image& image, const char* filename );
-	static bool					writeImageAsPPM( const Image& image, const char* filename );
+	static bool					writeImageAsPPM( const CapturedImage& capturedImage, const char* filename );
 
 	RDShow::Device*			mDevice;
 	RDShow::QImageWidget*	mImageWidget;
@@ -53,7 +53,7 @@ void QImageWidget::paintEvent( QPaintEvent* /*paintEvent*/ )
 		painter.drawImage( QPointF(0,0), mQImageMaker->getQImage() );
 }
 	
-void QImageWidget::setImage( const RDShow::Image& image )
+void QImageWidget::setImage( const RDShow::Image& image, unsigned int sequenceNumber )
 {
 	unsigned int width = image.getFormat().getWidth();
 	unsigned int height = image.getFormat().getHeight();
@@ -70,7 +70,7 @@ void QImageWidget::setImage( const RDShow::Image& image )
 		delete mQImageMaker;
 		mQImageMaker = new QRGB888ImageMaker( width, height );
 	}
-	mQImageMaker->update( image );
+	mQImageMaker->update( image, sequenceNumber );
 
 	update();
 }
@@ -83,10 +83,10 @@ QRGB888ImageMaker::QRGB888ImageMaker( int width, int height )
 	  mImageConverter(NULL)
 {
 	ImageFormat rgbFormat( width, height, ImageFormat::RGB24 );
-	mImageConverter = new ImageConverter( rgbFormat );
+	mImageConverter = new ImageConverter( rgbFormat, MemoryAccounting::Viewer );
 	
 	// Get a grip onto the data of the image that serves as output of the ImageConverter
-	uchar* data = reinterpret_cast<uchar*>( mImageConverter->getImage().getBuffer().getBytes() );
+	uchar* data = reinterpret_cast<uchar*>( mImageConverter->getImage().getBuffer().getWritableBytes() );
 
 	// Create a QImage pointing *directly* onto this data
 	mQImage = new QImage( data, width, height, QImage::Format_RGB888 );
@@ -101,13 +101,13 @@ QRGB888ImageMaker::~QRGB888ImageMaker()
 	mImageConverter = NULL;
 }
 	
-bool QRGB888ImageMaker::update( const Image& image )
+bool QRGB888ImageMaker::update( const Image& image, unsigned int sequenceNumber )
 {
 	// Here we just have to update the ImageConverter
 	// It internally updates the Image it contains.
 	// Without having to do anything, this updates the QImage because
 	// it shares its data with the the Image we just updated
-	return mImageConverter->update( image );
+	return mImageConverter->update( image, sequenceNumber );
 }
 
 }
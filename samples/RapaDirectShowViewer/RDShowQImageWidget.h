@@ -57,7 +57,7 @@ public:
 	QImageWidget( QWidget* parent );
 	virtual ~QImageWidget();
 
-	void				setImage( const RDShow::Image& image );
+	void				setImage( const RDShow::Image& image, unsigned int sequenceNumber=0 );
 
 protected:
 	virtual void		paintEvent( QPaintEvent* paintEvent );
@@ -82,7 +82,7 @@ public:
 	QRGB888ImageMaker( int width, int height );
 	~QRGB888ImageMaker();
 	
-	bool			update( const Image& image );
+	bool			update( const Image& image, unsigned int sequenceNumber );
 	const QImage&	getQImage() const { return *mQImage; }
 
 private:
@@ -0,0 +1,193 @@
+/*
+   The MIT License (MIT) (http://opensource.org/licenses/MIT)
+   
+   Copyright (c) 2015 Jacques Menuet
+   
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+   
+   The above copyright notice and this permission notice shall be included in all
+   copies or substantial portions of the Software.
+   
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+*/
+#include "RDShowAllocationTracker.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <new>
+#include <atomic>
+
+namespace RDShow
+{
+
+static std::atomic<int> gMode( AllocationTracker::Disabled );
+static std::atomic<unsigned int> gNumWarmUpFrames( 0 );
+static std::atomic<unsigned long long> gNumHotPathAllocations( 0 );
+static std::atomic<unsigned long long> gNumHotPathAllocatedBytes( 0 );
+
+// Per-thread number of nested Scopes whose frame is past the warm-up.
+// A plain integer on purpose, so accessing it never allocates
+static thread_local unsigned int tNumHotScopes = 0;
+
+bool AllocationTracker::isAvailable()
+{
+#ifdef RDSHOW_TRACK_ALLOCATIONS
+	return true;
+#else
+	return false;
+#endif
+}
+
+void AllocationTracker::setMode( Mode mode )
+{
+	gMode.store( mode );
+}
+
+AllocationTracker::Mode AllocationTracker::getMode()
+{
+	return static_cast<Mode>( gMode.load() );
+}
+
+void AllocationTracker::setNumWarmUpFrames( unsigned int numFrames )
+{
+	gNumWarmUpFrames.store( numFrames );
+}
+
+unsigned int AllocationTracker::getNumWarmUpFrames()
+{
+	return gNumWarmUpFrames.load();
+}
+
+unsigned long long AllocationTracker::getNumHotPathAllocations()
+{
+	return gNumHotPathAllocations.load();
+}
+
+unsigned long long AllocationTracker::getNumHotPathAllocatedBytes()
+{
+	return gNumHotPathAllocatedBytes.load();
+}
+
+void AllocationTracker::resetCounters()
+{
+	gNumHotPathAllocations.store( 0 );
+	gNumHotPathAllocatedBytes.store( 0 );
+}
+
+bool AllocationTracker::enterScope( unsigned int frameNumber )
+{
+	bool isHot = frameNumber>gNumWarmUpFrames.load( std::memory_order_relaxed );
+	if ( isHot )
+		++tNumHotScopes;
+	return isHot;
+}
+
+void AllocationTracker::leaveScope( bool isHot )
+{
+	if ( isHot )
+		--tNumHotScopes;
+}
+
+// Called for every allocation when the tracking is compiled in
+void AllocationTracker::onAllocation( std::size_t sizeInBytes )
+{
+	if ( tNumHotScopes==0 )
+		return;
+
+	int mode = gMode.load( std::memory_order_relaxed );
+	if ( mode==Disabled )
+		return;
+
+	gNumHotPathAllocations.fetch_add( 1, std::memory_order_relaxed );
+	gNumHotPathAllocatedBytes.fetch_add( sizeInBytes, std::memory_order_relaxed );
+	if ( mode==Fail )
+	{
+		// No formatting here: printf-like functions can allocate
+		fputs( "RDShow::AllocationTracker: heap allocation on a capture/delivery path after warm-up\n", stderr );
+		abort();
+	}
+}
+
+}
+
+#ifdef RDSHOW_TRACK_ALLOCATIONS
+
+/*
+	Replacements for the global allocation functions.
+	They are only compiled in when tracking is requested.
+*/
+static void* trackedAllocate( std::size_t sizeInBytes )
+{
+	RDShow::AllocationTracker::onAllocation( sizeInBytes );
+	void* pointer = malloc( sizeInBytes ? sizeInBytes : 1 );
+	if ( !pointer )
+		throw std::bad_alloc();
+	return pointer;
+}
+
+void* operator new( std::size_t sizeInBytes )
+{
+	return trackedAllocate( sizeInBytes );
+}
+
+void* operator new[]( std::size_t sizeInBytes )
+{
+	return trackedAllocate( sizeInBytes );
+}
+
+void* operator new( std::size_t sizeInBytes, const std::nothrow_t& ) throw()
+{
+	RDShow::AllocationTracker::onAllocation( sizeInBytes );
+	return malloc( sizeInBytes ? sizeInBytes : 1 );
+}
+
+void* operator new[]( std::size_t sizeInBytes, const std::nothrow_t& ) throw()
+{
+	RDShow::AllocationTracker::onAllocation( sizeInBytes );
+	return malloc( sizeInBytes ? sizeInBytes : 1 );
+}
+
+void operator delete( void* pointer ) throw()
+{
+	free( pointer );
+}
+
+void operator delete[]( void* pointer ) throw()
+{
+	free( pointer );
+}
+
+void operator delete( void* pointer, const std::nothrow_t& ) throw()
+{
+	free( pointer );
+}
+
+void operator delete[]( void* pointer, const std::nothrow_t& ) throw()
+{
+	free( pointer );
+}
+
+#ifdef __cpp_sized_deallocation
+void operator delete( void* pointer, std::size_t ) throw()
+{
+	free( pointer );
+}
+
+void operator delete[]( void* pointer, std::size_t ) throw()
+{
+	free( pointer );
+}
+#endif
+
+#endif
@@ -31,9 +31,20 @@ namespace RDShow
 {
 
 CapturedImage::CapturedImage( ImageFormat imageFormat )
-	: mImage(imageFormat),
+	: mImage(imageFormat, MemoryAccounting::Capture),
 	  mSequenceNumber(0),
-	  mTimestampInSec(0.f)
+	  mTimestampInNs(0),
+	  mArrivalTimeInNs(0),
+	  mPublishTimeInNs(0)
+{
+}
+
+CapturedImage::CapturedImage( ImageFormat imageFormat, const unsigned char* externalBytes )
+	: mImage(imageFormat, externalBytes),
+	  mSequenceNumber(0),
+	  mTimestampInNs(0),
+	  mArrivalTimeInNs(0),
+	  mPublishTimeInNs(0)
 {
 }
 
@@ -21,22 +21,16 @@
    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
    SOFTWARE.
 */
-#include "RDShowCriticalSectionEnterer.h"
+#include "RDShowClock.h"
 
-#include <assert.h>
+#include <chrono>
 
 namespace RDShow
 {
 
-CriticalSectionEnterer::CriticalSectionEnterer( CRITICAL_SECTION& criticalSection )
-	: mCriticalSection( criticalSection )
+long long Clock::getTimeInNs()
 {
-	EnterCriticalSection( &mCriticalSection );
-}	
-
-CriticalSectionEnterer::~CriticalSectionEnterer()
-{
-	LeaveCriticalSection( &mCriticalSection );
+	return std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::steady_clock::now().time_since_epoch() ).count();
 }
 
 }
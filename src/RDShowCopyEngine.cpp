@@ -0,0 +1,152 @@
+/*
+   The MIT License (MIT) (http://opensource.org/licenses/MIT)
+   
+   Copyright (c) 2015 Jacques Menuet
+   
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+   
+   The above copyright notice and this permission notice shall be included in all
+   copies or substantial portions of the Software.
+   
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+*/
+#include "RDShowCopyEngine.h"
+
+#include <memory.h>
+#include <assert.h>
+#include <algorithm>
+#include "RDShowTaskScheduler.h"
+
+#if defined(_M_X64) || ( defined(_M_IX86_FP) && _M_IX86_FP>=2 ) || defined(__SSE2__)
+	#define RDSHOW_COPY_ENGINE_SSE2
+	#include <emmintrin.h>
+#endif
+
+namespace RDShow
+{
+
+// Default values. Run the RapaDirectShowCopyBenchmark sample to tune them for a given machine
+std::size_t CopyEngine::mNonTemporalThreshold = 4 * 1024 * 1024;
+std::size_t CopyEngine::mParallelThreshold = 16 * 1024 * 1024;
+unsigned int CopyEngine::mMaxNumThreads = 1;
+
+bool CopyEngine::isNonTemporalSupported()
+{
+#ifdef RDSHOW_COPY_ENGINE_SSE2
+	return true;
+#else
+	return false;
+#endif
+}
+
+// Copy using the best method for the size of the block (see class description)
+void CopyEngine::copy( void* destination, const void* source, std::size_t numBytes )
+{
+	bool nonTemporal = numBytes>=mNonTemporalThreshold;
+	if ( mMaxNumThreads>1 && numBytes>=mParallelThreshold )
+		copyParallel( destination, source, numBytes, mMaxNumThreads, nonTemporal );
+	else if ( nonTemporal )
+		copyNonTemporal( destination, source, numBytes );
+	else
+		memcpy( destination, source, numBytes );
+}
+
+// Copy with streaming stores that bypass the cache. Falls back to memcpy when the 
+// CPU architecture isn't supported
+void CopyEngine::copyNonTemporal( void* destination, const void* source, std::size_t numBytes )
+{
+#ifdef RDSHOW_COPY_ENGINE_SSE2
+	unsigned char* dest = static_cast<unsigned char*>(destination);
+	const unsigned char* src = static_cast<const unsigned char*>(source);
+
+	// Streaming stores need a 16-byte aligned destination: copy the unaligned head normally
+	std::size_t headSize = (16 - (reinterpret_cast<std::size_t>(dest) & 15)) & 15;
+	if ( headSize>numBytes )
+		headSize = numBytes;
+	memcpy( dest, src, headSize );
+	dest += headSize;
+	src += headSize;
+	numBytes -= headSize;
+
+	// Copy 64 bytes (a cache line) per iteration
+	std::size_t numBlocks = numBytes / 64;
+	for ( std::size_t i=0; i<numBlocks; ++i )
+	{
+		__m128i a = _mm_loadu_si128( reinterpret_cast<const __m128i*>(src) );
+		__m128i b = _mm_loadu_si128( reinterpret_cast<const __m128i*>(src + 16) );
+		__m128i c = _mm_loadu_si128( reinterpret_cast<const __m128i*>(src + 32) );
+		__m128i d = _mm_loadu_si128( reinterpret_cast<const __m128i*>(src + 48) );
+		_mm_stream_si128( reinterpret_cast<__m128i*>(dest), a );
+		_mm_stream_si128( reinterpret_cast<__m128i*>(dest + 16), b );
+		_mm_stream_si128( reinterpret_cast<__m128i*>(dest + 32), c );
+		_mm_stream_si128( reinterpret_cast<__m128i*>(dest + 48), d );
+		src += 64;
+		dest += 64;
+	}
+
+	// Make the streaming stores visible to the other threads before returning
+	_mm_sfence();
+
+	// Copy the remaining tail
+	memcpy( dest, src, numBytes - numBlocks * 64 );
+#else
+	memcpy( destination, source, numBytes );
+#endif
+}
+
+void CopyEngine::copyChunk( void* destination, const void* source, std::size_t numBytes, bool nonTemporal )
+{
+	if ( nonTemporal )
+		copyNonTemporal( destination, source, numBytes );
+	else
+		memcpy( destination, source, numBytes );
+}
+
+// Split the copy in numThreads chunks, copied in parallel by the calling thread and 
+// the TaskScheduler workers
+void CopyEngine::copyParallel( void* destination, const void* source, std::size_t numBytes, unsigned int numThreads, bool nonTemporal )
+{
+	if ( numThreads<=1 || numBytes<numThreads*64 )
+	{
+		copyChunk( destination, source, numBytes, nonTemporal );
+		return;
+	}
+
+	unsigned char* dest = static_cast<unsigned char*>(destination);
+	const unsigned char* src = static_cast<const unsigned char*>(source);
+
+	// The chunks are split on cache line boundaries of the destination, so two threads never 
+	// write the same line whatever its alignment. The first and last chunks take the 
+	// unaligned head and tail
+	std::size_t chunkSize = numBytes / numThreads;
+	std::size_t destAddress = reinterpret_cast<std::size_t>(dest);
+	auto getSplitOffset = [&]( unsigned int chunk ) -> std::size_t
+		{
+			if ( chunk==0 )
+				return 0;
+			if ( chunk==numThreads )
+				return numBytes;
+			std::size_t splitAddress = (destAddress + chunk * chunkSize + 63) & ~static_cast<std::size_t>(63);
+			return std::min( splitAddress - destAddress, numBytes );
+		};
+	
+	TaskScheduler::parallelFor( 0, numThreads, 1, [&]( unsigned int firstChunk, unsigned int endChunk )
+		{
+			std::size_t offset = getSplitOffset( firstChunk );
+			std::size_t endOffset = getSplitOffset( endChunk );
+			copyChunk( dest + offset, src + offset, endOffset - offset, nonTemporal );
+		} );
+}
+
+}
@@ -24,68 +24,66 @@
 #include "RDShowDevice.h"
 
 #include <assert.h>
-#include <algorithm>
 #include "RDShowDeviceInternals.h"
+#include "RDShowDeviceWorker.h"
+#include "RDShowAllocationTracker.h"
+#include "RDShowClock.h"
+#include "RDShowTaskScheduler.h"
+#include "RDShowTracer.h"
 
 namespace RDShow
 {
 
-Device::Device( DeviceManager* parentDeviceManager, void* monikerSharedPtrAsVoidPtr, const std::string& name, const std::string& path )
+// The Device takes ownership of the DeviceInternals
+Device::Device( DeviceManager* parentDeviceManager, DeviceInternals* internals, const std::string& name, const std::string& path )
 	: mParentDeviceManager(parentDeviceManager),
 	  mName(name),
 	  mPath(path),
-	  mSupportedCaptureSettingsList(),
-	  mMediaTypeIndices(),
-	  mInternals(NULL),
+	  mInternals(internals),
+	  mWorker(NULL),
+	  mThreadSettings(),
 	  mStartedCaptureSettingsIndex(0),
-	  mCapturedImage(NULL)
+	  mListeners( name + " listeners" ),
+	  mCaptureCommandsLock( name + " capture commands" ),
+	  mCaptureCommands(),
+	  mCaptureCommandsDone()
 {
-	COMObjectSharedPtr<IMoniker>& monikerSharedPtr = *(reinterpret_cast< COMObjectSharedPtr<IMoniker>* >( monikerSharedPtrAsVoidPtr ));
-	mInternals = new DeviceInternals( monikerSharedPtr );
-
-	// Convert the supported VideoMediaTypes of the DeviceInternals into a CaptureSettingsList
-	// We only keep the types that our Image class can handle
-	CaptureSettingsList settingsList;
-	const DeviceInternals::VideoMediaTypes&	mediaTypes = mInternals->getSupportedVideoMediaTypes();
-	for ( std::size_t index=0; index<mediaTypes.size(); ++index )
-	{
-		const DeviceInternals::VideoMediaType mediaType = mediaTypes[index];
-		
-		bool supported = true;
-		ImageFormat::Encoding encoding = ImageFormat::RGB24;
-		
-	//printf("%s\n", mediaType.toString().c_str() );
-		if ( mediaType.subType==MEDIASUBTYPE_RGB24 )		// RGB24 in the MediaType world actually means BGR24 (reading each byte in sequence gives: blue, green, red)
-			encoding = ImageFormat::BGR24;
-		else if ( mediaType.subType==MEDIASUBTYPE_RGB32 )	// Same for RGB32, the sequence is blue, green, red, unused
-			encoding = ImageFormat::BGRX32;
-		else if ( mediaType.subType==MEDIASUBTYPE_YUY2 )
-			encoding = ImageFormat::YUYV;
-		else 
-			supported = false;
-
-		if ( supported )
-		{
-			ImageFormat imageFormat = ImageFormat( mediaType.width, mediaType.height, encoding );
-			CaptureSettings settings( imageFormat, mediaType.getFrameRate() );
-			mSupportedCaptureSettingsList.push_back( settings );
-			mMediaTypeIndices.push_back(index);
-		}
-	}
+	assert( mInternals );
+	mInternals->setParentDevice( this );
 }
 
 Device::~Device()
 {
+	// The task running the asynchronous starts and stops is done with the device once it 
+	// emptied the queue, under the lock. Starting or stopping can take a while: sleep meanwhile
+	{
+		std::unique_lock<Lock> lock( mCaptureCommandsLock );
+		mCaptureCommandsDone.wait( lock, [this]() { return mCaptureCommands.empty(); } );
+	}
+
 	if ( isCapturing() )
 		stopCapture();
+	delete mWorker;
+	mWorker = NULL;
 	delete mInternals;
 	mInternals = NULL;
 }
 
+const CaptureSettingsList& Device::getSupportedCaptureSettingsList() const
+{
+	return mInternals->getSupportedCaptureSettingsList();
+}
+
 bool Device::isCapturing() const
 {
 	return mInternals->isCapturing();
 }
+
+// The CapturedImage lives in the DeviceInternals and changes at each update  
+const CapturedImage* Device::getCapturedImage() const
+{
+	return mInternals->getCapturedImage();
+}
 /*
 bool Device::startCapture( const CaptureSettings& captureSettings )
 {
@@ -105,21 +103,12 @@ bool Device::startCapture( std::size_t captureSettingsIndex )
 	if ( isCapturing() )
 		return false;
 
-	if ( captureSettingsIndex>=mSupportedCaptureSettingsList.size() )
+	if ( captureSettingsIndex>=getSupportedCaptureSettingsList().size() )
 		return false;
 
 	// Remember which CaptureSettings we've started
 	mStartedCaptureSettingsIndex = captureSettingsIndex;
 	
-	// Prepare the Image that will receive the data when the update method is called
-	const CaptureSettings& captureSettings = mSupportedCaptureSettingsList[mStartedCaptureSettingsIndex];
-	mCapturedImage = new CapturedImage( captureSettings.getImageFormat() );
-	
-	// Find the MediaType corresponding to the index of the CaptureSettings to use
-	assert( mStartedCaptureSettingsIndex<mMediaTypeIndices.size() );
-	int mediaTypeIndex = mMediaTypeIndices[mStartedCaptureSettingsIndex];
-	
-	//const DeviceInternals::VideoMediaType& mediaType = mInternals->getSupportedVideoMediaTypes()[mediaTypeIndex];
 	// Prepare an image for vertical flip if necessary
 	/*assert( !mTempImage );
 	if ( mediaType.stride<0 )
@@ -127,12 +116,22 @@ bool Device::startCapture( std::size_t captureSettingsIndex )
 	*/
 
 	// Start the capture
-	bool ret = mInternals->startCapture( mediaTypeIndex );
+	mInternals->setCaptureThreadSettings( mThreadSettings[CaptureThread] );
+	bool ret = mInternals->startCapture( mStartedCaptureSettingsIndex );
 	if ( ret )
 	{
 		// Notify
-		for ( Listeners::const_iterator itr=mListeners.begin(); itr!=mListeners.end(); ++itr )
-			(*itr)->onDeviceStarted( this );
+		Listeners::ReadScope listenersScope( mListeners );
+		const Listeners::Snapshot& listeners = listenersScope.getSnapshot();
+		for ( Listeners::Snapshot::const_iterator itr=listeners.begin(); itr!=listeners.end(); ++itr )
+			itr->listener->onDeviceStarted( this );
+
+		// The Listeners know about the start before the worker calls them
+		if ( mWorker && !isBatchModeEnabled() )
+		{
+			mWorker->setThreadSettings( mThreadSettings[WorkerThread] );
+			mWorker->start();
+		}
 	}
 /*	else
 	{
@@ -161,21 +160,97 @@ bool Device::getStartedCaptureSettingsIndex( unsigned int& index ) const
 	return true;
 }*/
 
+std::future<bool> Device::startCaptureAsync( std::size_t captureSettingsIndex )
+{
+	CaptureCommand* command = new CaptureCommand();
+	command->isStart = true;
+	command->captureSettingsIndex = captureSettingsIndex;
+	std::future<bool> future = command->startPromise.get_future();
+	postCaptureCommand( command );
+	return future;
+}
+
+std::future<void> Device::stopCaptureAsync()
+{
+	CaptureCommand* command = new CaptureCommand();
+	command->isStart = false;
+	command->captureSettingsIndex = 0;
+	std::future<void> future = command->stopPromise.get_future();
+	postCaptureCommand( command );
+	return future;
+}
+
+void Device::postCaptureCommand( CaptureCommand* command )
+{
+	// Only post a task when none is running: the running one takes the new command
+	bool isIdle = false;
+	{
+		Lock::Scope lockScope( mCaptureCommandsLock );
+		isIdle = mCaptureCommands.empty();
+		mCaptureCommands.push_back( command );
+	}
+	if ( isIdle )
+		TaskScheduler::post( &Device::runCaptureCommands, this );
+}
+
+void Device::runCaptureCommands( void* context, unsigned int /*begin*/, unsigned int /*end*/ )
+{
+	Device* device = static_cast<Device*>(context);
+	for (;;)
+	{
+		CaptureCommand* command = NULL;
+		{
+			Lock::Scope lockScope( device->mCaptureCommandsLock );
+			command = device->mCaptureCommands.front();
+		}
+
+		bool ret = true;
+		if ( command->isStart )
+			ret = device->startCapture( command->captureSettingsIndex );
+		else
+			device->stopCapture();
+
+		bool hasMoreCommands = false;
+		{
+			Lock::Scope lockScope( device->mCaptureCommandsLock );
+			device->mCaptureCommands.pop_front();
+			hasMoreCommands = !device->mCaptureCommands.empty();
+
+			// Notified with the lock held, as the device may be deleted as soon as it's released
+			if ( !hasMoreCommands )
+				device->mCaptureCommandsDone.notify_all();
+		}
+
+		// Once the queue is empty, the device may be deleted: it mustn't be used anymore
+		if ( command->isStart )
+			command->startPromise.set_value( ret );
+		else
+			command->stopPromise.set_value();
+		delete command;
+		if ( !hasMoreCommands )
+			return;
+	}
+}
+
 void Device::stopCapture()
 {
 	if ( !isCapturing() )
 		return; 
 
+	// No more Listener calls from the worker after this (unless we're on the worker thread)
+	if ( mWorker )
+		mWorker->stop();
+
 	// Notify
-	for ( Listeners::const_iterator itr=mListeners.begin(); itr!=mListeners.end(); ++itr )
-		(*itr)->onDeviceStopping( this );
+	{
+		Listeners::ReadScope listenersScope( mListeners );
+		const Listeners::Snapshot& listeners = listenersScope.getSnapshot();
+		for ( Listeners::Snapshot::const_iterator itr=listeners.begin(); itr!=listeners.end(); ++itr )
+			itr->listener->onDeviceStopping( this );
+	}
 
 	mInternals->stopCapture();
 
-	// Delete the CaptureImage that receives the data
-	delete mCapturedImage;
-	mCapturedImage = NULL;
-	
 	// Also delete the TempImage when that is only created when a vertical flip is needed
 /*	delete mTempImage;
 	mTempImage = NULL;
@@ -185,45 +260,234 @@ void Device::stopCapture()
 
 void Device::update()
 {
-	if ( !isCapturing() )
+	// The application takes the images itself
+	if ( isBatchModeEnabled() )
+	{
+		mInternals->releaseClaim();
 		return;
+	}
 
-	assert( mCapturedImage );
+	// Go through the new images: the latest one only, or all the queued ones when there's 
+	// a frame queue. No copy involved. 
+	// Only the images published when the update starts are seen: if the Listeners are slower 
+	// than the device, the queue never empties and the update would never return
+	unsigned int lastSequenceNumber = mInternals->getPublishedSequenceNumber();
+	while ( isCapturing() )		// A listener might stop the capture
+	{
+		if ( getCapturedImage()->getSequenceNumber()>=lastSequenceNumber )
+			break;
 
-	MemoryBuffer& buffer = mCapturedImage->getImage().getBuffer();
-	unsigned int sequenceNumber = 0;
-	LONGLONG timestamp = 0;
-	bool ret = mInternals->getCapturedImage( buffer, sequenceNumber, timestamp );
-	if ( !ret )
-		return;
-	
-	// Set the sequence number
-	mCapturedImage->setSequenceNumber( sequenceNumber );
-	
-	// Set the timestamp
-	// The timestamp coming form the Internals object is in 100 nanosecond units
-	// http://msdn.microsoft.com/fr-fr/library/windows/desktop/dd374658(v=vs.85).aspx
-	float timestampInSec = static_cast<float>(timestamp) /  1e7f;		
-	mCapturedImage->setTimestampInSec( timestampInSec );	
+		// Nothing below should allocate once the capture is warmed up
+		AllocationTracker::Scope allocationScope( getCapturedImage()->getSequenceNumber()+1 );
 
-	// Notify
-	for ( Listeners::const_iterator itr=mListeners.begin(); itr!=mListeners.end(); ++itr )
-		(*itr)->onDeviceCapturedImage( this );
+		if ( !mInternals->updateCapturedImage() )
+			break;
+
+		unsigned int sequenceNumber = getCapturedImage()->getSequenceNumber();
+		Tracer::Scope traceScope( "Device::update", sequenceNumber );
+
+		// Notify, timing each Listener. The Listeners can change meanwhile, even from a Listener: 
+		// those of the update of this image are the ones in the snapshot, which the scope keeps
+		long long timeInNs = Clock::getTimeInNs();
+		LatencyHistogram& listenerHistogram = getLatencyHistogram( ListenerStage );
+		Listeners::ReadScope listenersScope( mListeners );
+		const Listeners::Snapshot& listeners = listenersScope.getSnapshot();
+		for ( Listeners::Snapshot::const_iterator itr=listeners.begin(); itr!=listeners.end(); ++itr )
+		{
+			{
+				Tracer::Scope listenerTraceScope( "Listener", sequenceNumber );
+				itr->listener->onDeviceCapturedImage( this );
+			}
+			long long endTimeInNs = Clock::getTimeInNs();
+			listenerHistogram.record( endTimeInNs - timeInNs );
+			timeInNs = endTimeInNs;
+		}
+
+		// A Listener may have stopped the capture and the image is gone with it
+		const CapturedImage* capturedImage = getCapturedImage();
+		if ( capturedImage )
+			getLatencyHistogram( EndToEndStage ).record( timeInNs - capturedImage->getArrivalTimeInNs() );
+	}
+
+	// Whichever thread claimed the device is done with it (see DeviceManager::waitForAnyImage())
+	mInternals->releaseClaim();
+}
+
+bool Device::setWorkerThreadEnabled( bool enabled )
+{
+	if ( isCapturing() )
+		return false;
+	if ( enabled && !mWorker )
+	{
+		mWorker = new DeviceWorker( this, mInternals );
+	}
+	else if ( !enabled )
+	{
+		delete mWorker;
+		mWorker = NULL;
+	}
+	return true;
+}
+
+bool Device::setBatchModeEnabled( bool enabled )
+{
+	return mInternals->setBatchModeEnabled( enabled );
+}
+
+bool Device::isBatchModeEnabled() const
+{
+	return mInternals->isBatchModeEnabled();
+}
+
+bool Device::takeImages( ImageBatch& batch )
+{
+	Tracer::Scope traceScope( "Device::takeImages", getPublishedSequenceNumber() );
+	return mInternals->takeImages( batch );
+}
+
+void Device::setThreadSettings( ThreadRole role, const Thread::Settings& settings )
+{
+	assert( role>=0 && role<NumThreadRoles );
+	mThreadSettings[role] = settings;
+}
+
+const Thread::Settings& Device::getThreadSettings( ThreadRole role ) const
+{
+	assert( role>=0 && role<NumThreadRoles );
+	return mThreadSettings[role];
+}
+
+bool Device::getEffectiveThreadSettings( ThreadRole role, Thread::Settings& settings ) const
+{
+	switch ( role )
+	{
+	case CaptureThread:		return mInternals->getEffectiveCaptureThreadSettings( settings );
+	case WorkerThread:		return mWorker && mWorker->getEffectiveThreadSettings( settings );
+	default:				assert( false ); return false;
+	}
+}
+
+bool Device::waitForNextImage( unsigned int lastSequenceNumber, unsigned int timeoutInMs )
+{
+	return mInternals->waitForNextImage( lastSequenceNumber, timeoutInMs );
+}
+
+unsigned int Device::getPublishedSequenceNumber() const
+{
+	return isCapturing() ? mInternals->getPublishedSequenceNumber() : 0;
+}
+
+bool Device::setLatestImageSlotEnabled( bool enabled )
+{
+	return mInternals->setLatestImageSlotEnabled( enabled );
+}
+
+bool Device::isLatestImageSlotEnabled() const
+{
+	return mInternals->isLatestImageSlotEnabled();
+}
+
+bool Device::readLatestImage( CapturedImage& destination, unsigned int lastSequenceNumber ) const
+{
+	return mInternals->readLatestImage( destination, lastSequenceNumber );
+}
+
+bool Device::asyncWaitForNextImage( unsigned int lastSequenceNumber, ImageWaiter* waiter )
+{
+	return mInternals->asyncWaitForNextImage( lastSequenceNumber, waiter );
+}
+
+bool Device::cancelWaitForNextImage( ImageWaiter* waiter )
+{
+	return mInternals->cancelWaitForNextImage( waiter );
+}
+
+bool Device::setFrameQueueDepth( unsigned int depth )
+{
+	return mInternals->setFrameQueueDepth( depth );
+}
+
+unsigned int Device::getFrameQueueDepth() const
+{
+	return mInternals->getFrameQueueDepth();
 }
 
 void Device::addListener( Listener* listener )
 {
 	assert(listener);
-	mListeners.push_back(listener);
+	// All the Listeners see the same images: what a Listener missed is what the device 
+	// skipped since the Listener was added 
+	ListenerEntry entry;
+	entry.listener = listener;
+	entry.numSkippedFramesWhenAdded = getFrameCounters().numSkippedFrames;
+	mListeners.add( entry );
 }
 
 bool Device::removeListener( Listener* listener )
 {
-	Listeners::iterator itr = std::find( mListeners.begin(), mListeners.end(), listener );
-	if ( itr==mListeners.end() )
-		return false;
-	mListeners.erase( itr );
-	return true;
+	return mListeners.remove( [listener]( const ListenerEntry& entry ) { return entry.listener==listener; } );
+}
+
+LatencyHistogram& Device::getLatencyHistogram( LatencyStage stage )
+{
+	return mInternals->getLatencyHistogram( stage );
+}
+
+const LatencyHistogram& Device::getLatencyHistogram( LatencyStage stage ) const
+{
+	return mInternals->getLatencyHistogram( stage );
+}
+
+void Device::resetLatencyHistograms()
+{
+	for ( int stage=0; stage<NumLatencyStages; ++stage )
+		getLatencyHistogram( static_cast<LatencyStage>(stage) ).reset();
+}
+
+Device::Statistics Device::getStatistics() const
+{
+	return mInternals->getStatistics();
+}
+
+Device::FrameCounters Device::getFrameCounters() const
+{
+	return mInternals->getFrameCounters();
+}
+
+bool Device::getListenerSkippedFrameCount( Listener* listener, unsigned long long& count ) const
+{
+	count = 0;
+	Listeners::ReadScope listenersScope( mListeners );
+	const Listeners::Snapshot& listeners = listenersScope.getSnapshot();
+	for ( Listeners::Snapshot::const_iterator itr=listeners.begin(); itr!=listeners.end(); ++itr )
+	{
+		if ( itr->listener==listener )
+		{
+			count = getFrameCounters().numSkippedFrames - itr->numSkippedFramesWhenAdded;
+			return true;
+		}
+	}
+	return false;
+}
+
+bool Device::addRealTimeListener( RealTimeListener* listener )
+{
+	return mInternals->addRealTimeListener( listener );
+}
+
+bool Device::removeRealTimeListener( RealTimeListener* listener )
+{
+	return mInternals->removeRealTimeListener( listener );
+}
+
+FrameSubscription* Device::createFrameSubscription( FrameSubscription::Policy policy, unsigned int queueDepth, unsigned int blockTimeoutInMs )
+{
+	return mInternals->createFrameSubscription( policy, queueDepth, blockTimeoutInMs );
+}
+
+bool Device::deleteFrameSubscription( FrameSubscription* subscription )
+{
+	return mInternals->deleteFrameSubscription( subscription );
 }
 
 }
\ No newline at end of file
@@ -24,616 +24,677 @@
 #include "RDShowDeviceInternals.h"
 
 #include <assert.h>
-#include <string>
-#include <sstream>
 #include <algorithm>
-
-// http://msdn.microsoft.com/en-us/library/windows/desktop/dd407331(v=vs.85).aspx
-// http://www.codeproject.com/Articles/34663/DirectShow-Examples-for-Using-SampleGrabber-for-Gr
-
-// http://msrds.googlecode.com/svn/trunk/wavelets/haar_src/src/dshow/
-// http://msrds.googlecode.com/svn/trunk/wavelets/haar_src/src/dshow/VideoCapture.cpp
-
-
-// http://stackoverflow.com/questions/5031740/finding-out-when-the-samplegrabber-is-ready-in-directshow
-
-// Base Microsoft Playcap example customised to use a sample grabber
-// http://www.planet-source-code.com/vb/scripts/ShowCode.asp?txtCodeId=13364&lngWId=3
+#include <thread>
+#include "RDShowCopyEngine.h"
+#include "RDShowAllocationTracker.h"
+#include "RDShowClock.h"
+#include "RDShowTracer.h"
 
 namespace RDShow
 {
 
-/*
-	DeviceInternals::VideoMediaType
-*/
-DeviceInternals::VideoMediaType::VideoMediaType()
-	: width(0),
-	  height(0),
-	  needVerticalFlip(false),
-	  frameInterval(0),
-	  subType()
-{
-}
-
-bool DeviceInternals::VideoMediaType::operator==( const DeviceInternals::VideoMediaType& other ) const
-{	
-	return	width==other.width &&
-			height==other.height &&
-			needVerticalFlip==other.needVerticalFlip && 
-			frameInterval==other.frameInterval &&
-			subType==other.subType;
-}
-
-bool DeviceInternals::VideoMediaType::operator!=( const DeviceInternals::VideoMediaType& other ) const
-{
-	return	!( (*this)==other );
-}
-
-std::string DeviceInternals::VideoMediaType::getSubTypeName( const GUID& mediaType )
-{
-	// Specific non-FourCC types
-	if ( mediaType==MEDIASUBTYPE_RGB1 )	
-		return "RGB1";
-	if ( mediaType==MEDIASUBTYPE_RGB4 )	
-		return "";
-	if ( mediaType==MEDIASUBTYPE_RGB8 )	
-		return "RGB8";
-	if ( mediaType==MEDIASUBTYPE_RGB565 )	
-		return "RGB565";
-	if ( mediaType==MEDIASUBTYPE_RGB555 )	
-		return "RGB555";
-	if ( mediaType==MEDIASUBTYPE_RGB24 )	
-		return "RGB24";
-	if ( mediaType==MEDIASUBTYPE_RGB32 )	
-		return "RGB32";
-	
-	if ( mediaType==MEDIASUBTYPE_ARGB1555 )	
-		return "ARGB1555";
-	if ( mediaType==MEDIASUBTYPE_ARGB4444 )	
-		return "ARGB4444";
-	if ( mediaType==MEDIASUBTYPE_ARGB32 )	
-		return "ARGB32";
-	if ( mediaType==MEDIASUBTYPE_A2R10G10B10 )	
-		return "A2R10G10B10";
-	if ( mediaType==MEDIASUBTYPE_A2B10G10R10 )	
-		return "MEDIASUBTYPE_A2B10G10R10";
-
-	// For the other GUIDs, we to extract the FourCC 
-	DWORD fcc = mediaType.Data1;
-	char* fccAsChars = reinterpret_cast<char*>( &fcc );
-	std::string ret( fccAsChars, sizeof(DWORD) );
-
-	return ret;
+DeviceInternals::DeviceInternals()
+	: mSupportedCaptureSettingsList(),
+	  mParentDevice(NULL),
+	  mFrameQueueDepth(0),
+	  mIsBatchMode(false),
+	  mImageFormat(),
+	  mRealTimeListeners("Real-time listeners"),
+	  mFrameSubscriptions(),
+	  mCapturedImage(NULL),
+	  mLock("Image exchange"),
+	  mBackImage(NULL),
+	  mMiddleImage(NULL),
+	  mFrontImage(NULL),
+	  mHasNewImage(false),
+	  mIsLatestImageSlotEnabled(false),
+	  mLatestImageSlot(NULL),
+	  mNumLatestImageSlotReaders(0),
+	  mFrameRing(NULL),
+	  mNumHeldRingImages(0),
+	  mImageSequenceNumber(0),
+	  mIsCapturing(false),
+	  mPublishedSequenceNumber(0),
+	  mConsumedSequenceNumber(0),
+	  mImageNotifier("Image notifier"),
+	  mSharedNotifier(NULL),
+	  mIsClaimed(false),
+	  mImageWaitersLock("Image waiters"),
+	  mImageWaiters(NULL),
+	  mHasImageWaiters(false),
+	  mNumDeliveredFrames(0),
+	  mNumOverwrittenFrames(0),
+	  mNumDroppedFrames(0),
+	  mNumConsumedFrames(0),
+	  mNumSkippedFrames(0),
+	  mLatencyHistograms(),
+	  mIsCaptureThreadNamed(false),
+	  mCaptureThreadSettings(),
+	  mIsCaptureThreadConfigured(false),
+	  mEffectiveCaptureThreadSettingsLock("Capture thread settings"),
+	  mEffectiveCaptureThreadSettings(),
+	  mHasEffectiveCaptureThreadSettings(false),
+	  mLastArrivalTimeInNs(0),
+	  mAverageFrameIntervalInNs(0),
+	  mAverageFrameIntervalDeviationInNs(0),
+	  mWindowStartTimeInNs(0),
+	  mWindowNumFrames(0),
+	  mWindowNumBytes(0),
+	  mFrameRate(0),
+	  mWindowedFrameRate(0),
+	  mBytesPerSecond(0),
+	  mFrameIntervalJitterInNs(0),
+	  mQueueDepth(0)
+{
 }
 
-float DeviceInternals::VideoMediaType::getFrameRate() const
+DeviceInternals::~DeviceInternals()
 {
-	// http://msdn.microsoft.com/en-us/library/windows/desktop/dd387907(v=vs.85).aspx
-	// "The MinFrameInterval and MaxFrameInterval members of VIDEO_STREAM_CONFIG_CAPS are the minimum and maximum length of each video frame, 
-	// which you can translate into frame rates as follows: frames per second = 10,000,000 / frame duration"
-	float frameRate = 10000000.f / static_cast<float>(frameInterval); 
-	return frameRate;
+	// The derived class should have stopped the capture
+	assert( !isCapturing() );
+	assert( !mFrontImage && !mFrameRing );
+	for ( std::size_t i=0; i<mFrameSubscriptions.size(); ++i )
+		delete mFrameSubscriptions[i];
+	mFrameSubscriptions.clear();
 }
 
-std::string DeviceInternals::VideoMediaType::toString() const
+void DeviceInternals::setParentDevice( Device* device )
 {
-	std::stringstream stream;
-	stream.precision(2);
-	stream << std::fixed;
+	mParentDevice = device;
+	mLock.setName( device->getName() + " image exchange" );
+	mImageWaitersLock.setName( device->getName() + " image waiters" );
+	mRealTimeListeners.setName( device->getName() + " real-time listeners" );
+	mImageNotifier.setName( device->getName() + " image notifier" );
+	mEffectiveCaptureThreadSettingsLock.setName( device->getName() + " capture thread settings" );
+}
 
+bool DeviceInternals::setFrameQueueDepth( unsigned int depth )
+{
+	if ( isCapturing() )
+		return false;
+	mFrameQueueDepth = depth;
+	return true;
+}
 
-	stream << "width:" << width << " height:" << height << " needVerticalFlip:" << needVerticalFlip << " frameInterval:" << frameInterval<< " (fps:" << getFrameRate() << ") subType:" << getSubTypeName();
-	return stream.str();
+bool DeviceInternals::setBatchModeEnabled( bool enabled )
+{
+	if ( isCapturing() )
+		return false;
+	mIsBatchMode = enabled;
+	return true;
 }
 
+bool DeviceInternals::setLatestImageSlotEnabled( bool enabled )
+{
+	if ( isCapturing() )
+		return false;
+	mIsLatestImageSlotEnabled = enabled;
+	return true;
+}
 
-/*
-	DeviceInternals::SampleGrabberCallback 
-*/
-class DeviceInternals::SampleGrabberCallback : public ISampleGrabberCB
-{
-public:
-	SampleGrabberCallback( CRITICAL_SECTION* criticalSection )
-		: mCriticalSection( criticalSection ),
-		  mReferenceCounter(1),
-		  mImageBuffer(NULL),
-		  mImageSequenceNumber(0)
-	{
-	}
+bool DeviceInternals::startCapture( std::size_t captureSettingsIndex )
+{
+	if ( isCapturing() )
+		return false;
 
-    STDMETHODIMP_(ULONG) AddRef() 
-	{ 
-		return InterlockedIncrement( &mReferenceCounter );
-	}
+	if ( captureSettingsIndex>=mSupportedCaptureSettingsList.size() )
+		return false;
 
-    STDMETHODIMP_(ULONG) Release() 
+	// The images are created before the backend starts delivering
+	const ImageFormat& imageFormat = mSupportedCaptureSettingsList[captureSettingsIndex].getImageFormat();
+	mImageFormat = imageFormat;
+	assert( !mFrontImage && !mFrameRing );
+	mFrontImage = new CapturedImage( imageFormat );
+	if ( mIsBatchMode )
 	{
-		ULONG counter = InterlockedDecrement(&mReferenceCounter);
-		if ( counter==0 )
-			delete this;
-		return counter;
+		// Twice the depth, as the Device holds on to the previous batch while the next one queues
+		mFrameRing = new FrameRing<CapturedImage>( 2*std::max( mFrameQueueDepth, 1u ), *mFrontImage );
 	}
-		
-	STDMETHODIMP QueryInterface( REFIID /*riid*/, void** /*ppvObject*/ )
-    {
-	return E_NOTIMPL;
-        /*if (NULL == ppvObject) return E_POINTER;
-        if (riid == __uuidof(IUnknown))
-        {
-            *ppvObject = static_cast<IUnknown*>(this);
-			return S_OK;
-        }
-        if (riid == __uuidof(ISampleGrabberCB))
-        {
-            *ppvObject = static_cast<ISampleGrabberCB*>(this);
-			return S_OK;
-        }
-        //return E_NOTIMPL;
-		return E_NOINTERFACE;		// http://social.msdn.microsoft.com/Forums/en-US/windowsdirectshowdevelopment/thread/3d5ada34-13d5-48f4-82fc-04018b6e0dbc/
-		*/
-    }
-
-    STDMETHODIMP SampleCB( double /*Time*/, IMediaSample* /*pSample*/ )
-    {
-        return E_NOTIMPL;
-    }
-
-    STDMETHODIMP BufferCB( double /*Time*/, BYTE *pBuffer, long BufferLen )
-    {
-		CriticalSectionEnterer criticalSectionRAII( *mCriticalSection );
-
-		if ( BufferLen==0 )		// Called with 0 when we stop the capture graph
-			return S_OK;
-		
-	/*	HDC hdc=GetDC(g_hwnd);
-		SetStretchBltMode(hdc, HALFTONE);
-		StretchDIBits(hdc, 0, 0, g_WWidth, g_WHeight, 0, 0,
-						g_pVih->bmiHeader.biWidth, g_pVih->bmiHeader.biHeight,
-						pBuffer, (BITMAPINFO*)&g_pVih->bmiHeader, DIB_RGB_COLORS, SRCCOPY);
-	*/
-		if ( !mImageBuffer )
-			mImageBuffer = new MemoryBuffer( BufferLen );
-		assert( BufferLen==static_cast<long>(mImageBuffer->getSizeInBytes()) );
-
-		unsigned char* destBytes = mImageBuffer->getBytes();
-		memcpy( destBytes, pBuffer, BufferLen ); 
-
-		mImageSequenceNumber++;
-
-        return S_OK;
-    }
-
-	MemoryBuffer* getImageBuffer() const
+	else if ( mFrameQueueDepth==0 )
 	{
-		return mImageBuffer;
+		mBackImage = new CapturedImage( imageFormat );
+		mMiddleImage = new CapturedImage( imageFormat );
 	}
-
-	void deleteImageBuffer()
+	else
 	{
-		delete mImageBuffer;
-		mImageBuffer = NULL;
+		// One more slot than the depth as the Device holds on to the image it's looking at
+		mFrameRing = new FrameRing<CapturedImage>( mFrameQueueDepth+1, *mFrontImage );
 	}
-
-	unsigned int getImageSequenceNumber() const 
+	if ( mIsLatestImageSlotEnabled )
+		mLatestImageSlot = new LatestImageSlot( imageFormat );
+	mCapturedImage = mFrontImage;
+	mHasNewImage = false;
+	mNumHeldRingImages = 0;
+	mImageSequenceNumber = 0;
+	mPublishedSequenceNumber = 0;
+	mConsumedSequenceNumber = 0;
+	mIsCaptureThreadNamed = false;
+	mIsCaptureThreadConfigured = false;
 	{
-		return mImageSequenceNumber;
+		Lock::Scope lockScope( mEffectiveCaptureThreadSettingsLock );
+		mHasEffectiveCaptureThreadSettings = false;
 	}
+	resetStatistics();
+	for ( std::size_t i=0; i<mFrameSubscriptions.size(); ++i )
+		mFrameSubscriptions[i]->open( imageFormat );
 
-	void resetImageSequenceNumber() 
+	if ( !startBackendCapture( captureSettingsIndex ) )
 	{
-		mImageSequenceNumber = 0;
+		for ( std::size_t i=0; i<mFrameSubscriptions.size(); ++i )
+			mFrameSubscriptions[i]->close();
+		deleteImages();
+		return false;
 	}
+	
+	mIsCapturing = true;
+	return true;
+}
 
-private:
-	CRITICAL_SECTION*	mCriticalSection;
-	LONG				mReferenceCounter;
-	MemoryBuffer*		mImageBuffer;
-	unsigned int		mImageSequenceNumber;
-};
-
-DeviceInternals::DeviceInternals( COMObjectSharedPtr<IMoniker> moniker )
-	: mCriticalSection(), 
-	  mSupportedVideoMediaTypes(),
-	  mMoniker(moniker),
-	  mGraphBuilder(),
-	  mCaptureGraphBuilder2(),
-	  mSampleGrabberFilter(),
-	  mSourceFilter(),
-	  mSampleGrabberCallback(NULL),
-//	  mImageBuffer(NULL)
-	  mIsCapturing(false)
+bool DeviceInternals::stopCapture()
 {
-	InitializeCriticalSection( &mCriticalSection );
-
-	mSampleGrabberCallback = new SampleGrabberCallback( &mCriticalSection );
+	if ( !isCapturing() )
+		return true;
 
-	bool ret = initialize();
-	assert( ret );
-}
+	// Closed first, so a capture thread blocked by a subscription lets go of it
+	for ( std::size_t i=0; i<mFrameSubscriptions.size(); ++i )
+		mFrameSubscriptions[i]->close();
 
-DeviceInternals::~DeviceInternals()
-{
-	if ( isCapturing() )
-		stopCapture();
-	
-	mSampleGrabberFilter->SetCallback( NULL, 1 );
-	delete mSampleGrabberCallback;
-	mSampleGrabberCallback = NULL;
+	// Once this returns, the backend doesn't deliver buffers anymore
+	if ( !stopBackendCapture() )
+		return false;
 
-	mSampleGrabberFilter.reset();
-	mGraphBuilder.reset();
-	mCaptureGraphBuilder2.reset();
+	deleteImages();
+	mQueueDepth = 0;
 	
-	DeleteCriticalSection( &mCriticalSection );
+	// Wake up the waiting threads
+	mIsCapturing = false;
+	mImageNotifier.notify();
+	notifyImageWaiters();
+	return true;
 }
 
+void DeviceInternals::deleteImages()
+{
+	delete mBackImage;
+	mBackImage = NULL;
+	delete mMiddleImage;
+	mMiddleImage = NULL;
+	delete mFrontImage;
+	mFrontImage = NULL;
+	mHasNewImage = false;
+	delete mFrameRing;
+	mFrameRing = NULL;
+	mNumHeldRingImages = 0;
+	mCapturedImage = NULL;
+	deleteLatestImageSlot();
+}
 
-// Release the format block for a media type.
-void _FreeMediaType(AM_MEDIA_TYPE& mt)		//	http://msdn.microsoft.com/en-us/library/windows/desktop/dd375432(v=vs.85).aspx
+void DeviceInternals::deleteLatestImageSlot()
 {
-    if (mt.cbFormat != 0)
-    {
-        CoTaskMemFree((PVOID)mt.pbFormat);
-        mt.cbFormat = 0;
-        mt.pbFormat = NULL;
-    }
-    if (mt.pUnk != NULL)
-    {
-        // pUnk should not be used.
-        mt.pUnk->Release();
-        mt.pUnk = NULL;
-    }
+	// Same handshake as ImageNotifier: the readers count themselves in before they look for 
+	// the slot, and the slot is taken away before the readers are counted. Either a reader 
+	// sees no slot, or it's counted and the slot waits for it
+	LatestImageSlot* latestImageSlot = mLatestImageSlot.exchange( NULL );
+	if ( !latestImageSlot )
+		return;
+	while ( mNumLatestImageSlotReaders.load()>0 )
+		std::this_thread::yield();
+	delete latestImageSlot;
 }
-// Delete a media type structure that was allocated on the heap.
-void _DeleteMediaType(AM_MEDIA_TYPE *pmt)
+
+bool DeviceInternals::readLatestImage( CapturedImage& destination, unsigned int lastSequenceNumber ) const
 {
-    if (pmt != NULL)
-    {
-        _FreeMediaType(*pmt); 
-        CoTaskMemFree(pmt);
-    }
+	mNumLatestImageSlotReaders.fetch_add( 1 );
+	const LatestImageSlot* latestImageSlot = mLatestImageSlot.load();
+	bool ret = latestImageSlot && latestImageSlot->read( destination, lastSequenceNumber );
+	mNumLatestImageSlotReaders.fetch_sub( 1 );
+	return ret;
 }
 
-bool DeviceInternals::initialize()
+void DeviceInternals::deliverBuffer( const unsigned char* bytes, unsigned int numBytes, long long timestampInNs )
 {
-	// Graph Builder
-	IGraphBuilder* graphBuilderRaw = NULL;
-	HRESULT hr = CoCreateInstance( CLSID_FilterGraph, NULL, CLSCTX_INPROC, IID_IGraphBuilder, (void**)&graphBuilderRaw );
-	COMObjectSharedPtr<IGraphBuilder> graphBuilder( graphBuilderRaw );
-	if ( FAILED(hr) )
-		return false;
+	// Read the host clock first, as close as possible to the actual arrival
+	long long arrivalTimeInNs = Clock::getTimeInNs();
 
-	// Capture Graph Builder
-	ICaptureGraphBuilder2* captureGraphBuilder2Raw = NULL;
-	hr = CoCreateInstance( CLSID_CaptureGraphBuilder2 , NULL, CLSCTX_INPROC, IID_ICaptureGraphBuilder2, (void**)&captureGraphBuilder2Raw );
-	COMObjectSharedPtr<ICaptureGraphBuilder2> captureGraphBuilder2( captureGraphBuilder2Raw );
-	if ( FAILED(hr) )
-		return false;
-    
-	// Attach the filter graph to the capture graph
-	hr = captureGraphBuilder2->SetFiltergraph( graphBuilder.get() );
-    if ( FAILED(hr) )
-		return false;		
-
-	// Bind the Moniker to a Filter object
-	IBaseFilter* sourceFilterRaw = NULL;
-    hr = mMoniker->BindToObject( 0, 0, IID_IBaseFilter, (void**)&sourceFilterRaw);
-	COMObjectSharedPtr<IBaseFilter> sourceFilter( sourceFilterRaw );
-	if ( FAILED(hr) )
-		return false;
+	// Give the capture thread the name of the device in the trace, outside of the hot path. 
+	// The backend delivers all the images of a capture from the same thread
+	if ( !mIsCaptureThreadNamed && Tracer::isEnabled() && mParentDevice )
+	{
+		Tracer::setCurrentThreadName( mParentDevice->getName() );
+		mIsCaptureThreadNamed = true;
+	}
 
-    // Add Capture filter to the graph
-    hr = graphBuilder->AddFilter( sourceFilter.get(), L"Video Capture" );
-    if ( FAILED(hr) ) 
-        return false;		
-		
-	// Get capture source information
-	IAMStreamConfig* streamConfigRaw = NULL;
-//	hr = captureGraphBuilder2->FindInterface( &PIN_CATEGORY_CAPTURE, 0, sourceFilter.get(), IID_IAMStreamConfig, (void**)&streamConfigRaw );
-	//hr = sourceFilter->QueryInterface( IID_IAMStreamConfig, (void**)&streamConfigRaw );
-	IPin* pinRaw = NULL;
-	hr = captureGraphBuilder2->FindPin( sourceFilter.get(), PINDIR_OUTPUT, &PIN_CATEGORY_CAPTURE, NULL, FALSE, 0, &pinRaw );
-	if ( FAILED(hr) )
-		return false;
+	// Same for its scheduling settings. The backend may not have created the thread (DirectShow 
+	// calls us from its own), so it's configured here rather than when it starts
+	if ( !mIsCaptureThreadConfigured )
+	{
+		Thread::Settings effectiveSettings = mCaptureThreadSettings.isDefault() ? Thread::getCurrentThreadSettings() : Thread::applyToCurrentThread( mCaptureThreadSettings );
+		Lock::Scope lockScope( mEffectiveCaptureThreadSettingsLock );
+		mEffectiveCaptureThreadSettings = effectiveSettings;
+		mHasEffectiveCaptureThreadSettings = true;
+		mIsCaptureThreadConfigured = true;
+	}
 
-	COMObjectSharedPtr<IPin> pin( pinRaw );
-	hr = pin->QueryInterface( IID_IAMStreamConfig, (void**)&streamConfigRaw );
-	if ( FAILED(hr) )
-		return false;
+	AllocationTracker::Scope allocationScope( mImageSequenceNumber+1 );
+	Tracer::Scope traceScope( "DeviceInternals::deliverBuffer", mImageSequenceNumber+1 );
+
+	if ( numBytes==0 )		// DirectShow can deliver empty samples when we stop the capture graph
+		return;
 	
-	COMObjectSharedPtr<IAMStreamConfig> streamConfig( streamConfigRaw );
-	if ( FAILED(hr) )
-		return false;
+	// The sequence number counts the dropped images too, so they show up as gaps
+	mImageSequenceNumber++;
+	incrementCounter( mNumDeliveredFrames );
+	updateArrivalStatistics( arrivalTimeInNs, numBytes );
 
-	int numCaps = 0;
-	int videoCapsSize = 0;
-	hr = streamConfig->GetNumberOfCapabilities( &numCaps, &videoCapsSize );
-	if ( FAILED(hr) )
-		return false;
-	if ( videoCapsSize!=sizeof(VIDEO_STREAM_CONFIG_CAPS) ) 
-		return false;
+	// Hand the buffer to the real-time listeners first, without copy. 
+	// A buffer too small for the image format isn't wrapped
+	{
+		RealTimeListeners::ReadScope realTimeListenersScope( mRealTimeListeners );
+		const RealTimeListeners::Snapshot& realTimeListeners = realTimeListenersScope.getSnapshot();
+		if ( !realTimeListeners.empty() && numBytes>=mImageFormat.getDataSizeInBytes() )
+		{
+			Tracer::Scope realTimeListenersTraceScope( "RealTimeListeners", mImageSequenceNumber );
+			CapturedImage borrowedImage( mImageFormat, bytes );
+			borrowedImage.setSequenceNumber( mImageSequenceNumber );
+			borrowedImage.setTimestampInNs( timestampInNs );
+			borrowedImage.setArrivalTimeInNs( arrivalTimeInNs );
+			for ( RealTimeListeners::Snapshot::const_iterator itr=realTimeListeners.begin(); itr!=realTimeListeners.end(); ++itr )
+				(*itr)->onDeviceCapturedImage( mParentDevice, borrowedImage );
+		}
+	}
 
-	for ( int i=0; i<numCaps; ++i )
+	// Then to the subscriptions, which copy it into their own queues
+	if ( !mFrameSubscriptions.empty() )
 	{
-		VIDEO_STREAM_CONFIG_CAPS videoCaps;	// http://msdn.microsoft.com/en-us/library/windows/desktop/dd407352(v=vs.85).aspx
-		AM_MEDIA_TYPE* mediaType = NULL;	// http://msdn.microsoft.com/en-us/library/windows/desktop/dd373477(v=vs.85).aspx
-		
-		// Get the MediaType and VideoStreamConfigCaps objects.
-		// The VideoStreamConfigCaps is pretty deprecated
-		hr = streamConfig->GetStreamCaps( i, &mediaType, (BYTE*)&videoCaps );
-		if ( FAILED(hr) )
-			continue;
+		Tracer::Scope frameSubscriptionsTraceScope( "FrameSubscriptions", mImageSequenceNumber );
+		for ( FrameSubscriptions::const_iterator itr=mFrameSubscriptions.begin(); itr!=mFrameSubscriptions.end(); ++itr )
+			(*itr)->offerBuffer( bytes, numBytes, mImageSequenceNumber, timestampInNs, arrivalTimeInNs );
+	}
+
+	// And to the latest image slot, whatever happens to the image in the queue
+	LatestImageSlot* latestImageSlot = mLatestImageSlot.load( std::memory_order_relaxed );
+	if ( latestImageSlot )
+	{
+		Tracer::Scope latestImageSlotTraceScope( "LatestImageSlot", mImageSequenceNumber );
+		latestImageSlot->write( bytes, numBytes, mImageSequenceNumber, timestampInNs, arrivalTimeInNs );
+	}
+
+	// The image to fill belongs to the backend until it's published: no need to lock
+	CapturedImage* image = mFrameRing ? mFrameRing->beginWrite() : mBackImage;
+	if ( !image )
+	{
+		incrementCounter( mNumDroppedFrames );		// The queue is full
+		return;
+	}
 	
-		LONG width = 0;
-		LONG height = 0;
-		bool needVerticalFlip = false;
-		LONGLONG frameInterval = 0;
-		GUID subtype;
-
-		// The subtype comes from the MediaType
-		subtype = mediaType->subtype;
-		
-		// We use the "pbFormat" member of the MediaType to identify the resolution
-		if ( mediaType->formattype == FORMAT_VideoInfo )
+	// The driver buffer can be larger than the image, when its lines are padded for example
+	{
+		Tracer::Scope copyTraceScope( "Copy", mImageSequenceNumber );
+		MemoryBuffer& buffer = image->getImage().getBuffer();
+		CopyEngine::copy( buffer.getWritableBytes(), bytes, std::min( numBytes, buffer.getSizeInBytes() ) ); 
+	}
+	image->setSequenceNumber( mImageSequenceNumber );
+	image->setTimestampInNs( timestampInNs );
+	image->setArrivalTimeInNs( arrivalTimeInNs );
+	long long publishTimeInNs = Clock::getTimeInNs();
+	image->setPublishTimeInNs( publishTimeInNs );
+	mLatencyHistograms[Device::DeliveryStage].record( publishTimeInNs - arrivalTimeInNs );
+
+	if ( mFrameRing )
+	{
+		// Counted before it's published, so the Device never sees a negative depth
+		mQueueDepth.fetch_add( 1, std::memory_order_relaxed );
+		mFrameRing->endWrite();
+	}
+	else
+	{
+		// Publish it as the latest image. If the previous one wasn't taken, it gets overwritten
+		Lock::Scope lockScope( mLock );
+		std::swap( mBackImage, mMiddleImage );
+		if ( mHasNewImage )
+			incrementCounter( mNumOverwrittenFrames );
+		else
+			mQueueDepth.fetch_add( 1, std::memory_order_relaxed );
+		mHasNewImage = true;
+	}
+
+	// Wake up the waiting threads
+	mPublishedSequenceNumber = mImageSequenceNumber;
+	mImageNotifier.notify();
+	if ( mSharedNotifier )
+		mSharedNotifier->notify();
+	notifyImageWaiters();
+}
+
+bool DeviceInternals::waitForNextImage( unsigned int lastSequenceNumber, unsigned int timeoutInMs )
+{
+	mImageNotifier.wait( timeoutInMs, 
+		[this, lastSequenceNumber]() { return !mIsCapturing || mPublishedSequenceNumber>lastSequenceNumber; } );
+	return mIsCapturing && mPublishedSequenceNumber>lastSequenceNumber;
+}
+
+bool DeviceInternals::asyncWaitForNextImage( unsigned int lastSequenceNumber, Device::ImageWaiter* waiter )
+{
+	assert( waiter );
+	Lock::Scope lockScope( mImageWaitersLock );
+	assert( !waiter->mIsWaiting );
+
+	// Same handshake as ImageNotifier: the flag is raised before the state is read, and 
+	// notifyImageWaiters() reads it after changing the state. Either we see the new image 
+	// or the stop, or the notification sees the waiter
+	mHasImageWaiters = true;
+	if ( !mIsCapturing || mPublishedSequenceNumber>lastSequenceNumber )
+	{
+		mHasImageWaiters = mImageWaiters!=NULL;
+		return false;
+	}
+	waiter->mLastSequenceNumber = lastSequenceNumber;
+	waiter->mNextWaiter = mImageWaiters;
+	waiter->mIsWaiting = true;
+	mImageWaiters = waiter;
+	return true;
+}
+
+bool DeviceInternals::cancelWaitForNextImage( Device::ImageWaiter* waiter )
+{
+	assert( waiter );
+	Lock::Scope lockScope( mImageWaitersLock );
+	for ( Device::ImageWaiter** link=&mImageWaiters; *link; link=&(*link)->mNextWaiter )
+	{
+		if ( *link==waiter )
 		{
-			assert( mediaType->cbFormat==sizeof(VIDEOINFOHEADER) );	// Something's wrong with the data encapsulated in the MediaType
-			VIDEOINFOHEADER* videoInfoHeader = reinterpret_cast<VIDEOINFOHEADER*>( mediaType->pbFormat );
-		
-			/// Direction of the image (bottom up or to-down...
-			// upside down or not...
-			// http://msdn.microsoft.com/en-us/library/windows/desktop/dd318229(v=vs.85).aspx
-/*
-		biHeight
-Specifies the height of the bitmap, in pixels.
-For uncompressed RGB bitmaps, if biHeight is positive, the bitmap is a bottom-up DIB with the origin at the lower left corner. If biHeight is negative, the bitmap is a top-down DIB with the origin at the upper left corner.
-For YUV bitmaps, the bitmap is always top-down, regardless of the sign of biHeight. Decoders should offer YUV formats with postive biHeight, but for backward compatibility they should accept YUV formats with either positive or negative biHeight.
-For compressed formats, biHeight must be positive, regardless of image orientation.
-*/
+			*link = waiter->mNextWaiter;
+			waiter->mNextWaiter = NULL;
+			waiter->mIsWaiting = false;
+			mHasImageWaiters = mImageWaiters!=NULL;
+			return true;
+		}
+	}
+	return false;
+}
 
-// This guy didn't manage to know when flip is needed
-// http://social.msdn.microsoft.com/Forums/en-US/windowsdirectshowdevelopment/thread/938e0736-34d5-4faf-ad1c-eb150c6c299b/
+void DeviceInternals::notifyImageWaiters()
+{
+	if ( !mHasImageWaiters )
+		return;
 
-			width = videoInfoHeader->bmiHeader.biWidth;
-			height = abs( videoInfoHeader->bmiHeader.biHeight );
-			if ( subtype==MEDIASUBTYPE_YUY2 )
-				needVerticalFlip = false;
+	// Take the waiters whose image arrived out of the list. Pushing them on the ready list 
+	// reverses their order: the oldest ones are called first
+	Device::ImageWaiter* readyWaiters = NULL;
+	unsigned int sequenceNumber = 0;
+	{
+		Lock::Scope lockScope( mImageWaitersLock );
+		if ( mIsCapturing )
+			sequenceNumber = mPublishedSequenceNumber;
+		Device::ImageWaiter** link = &mImageWaiters;
+		while ( *link )
+		{
+			Device::ImageWaiter* waiter = *link;
+			if ( sequenceNumber==0 || waiter->mLastSequenceNumber<sequenceNumber )
+			{
+				*link = waiter->mNextWaiter;
+				waiter->mNextWaiter = readyWaiters;
+				readyWaiters = waiter;
+			}
 			else
-				needVerticalFlip = ( videoInfoHeader->bmiHeader.biHeight > 0 );
+			{
+				link = &waiter->mNextWaiter;
+			}
 		}
-	
-	    // http://msdn.microsoft.com/en-us/library/windows/desktop/dd387907(v=vs.85).aspx
-		//assert( videoCaps.MinCroppingSize==videoCaps.MaxCroppingSize == InputSize == MinOutputSize == MaxOutputSize );
-		//assert( MinFrameInterval==MaxFrameInterval );
-
-		// The resolution information in the VideoStreamConfigCaps should match the MediaType VideoInfoHeader
-		assert( width==videoCaps.MinCroppingSize.cx );
-		assert( height==videoCaps.MinCroppingSize.cy );
-		assert( width==videoCaps.MaxCroppingSize.cx );
-		assert( height==videoCaps.MaxCroppingSize.cy );
-		assert( width==videoCaps.MinOutputSize.cx );
-		assert( height==videoCaps.MinOutputSize.cy );
-		assert( width==videoCaps.MaxOutputSize.cx );
-		assert( height==videoCaps.MaxOutputSize.cy );
-		//assert( width==videoCaps.InputSize.cx );
-		//assert( height==videoCaps.InputSize.cy );
-
-		// We read the frameInterval from the VideoStreamConfigCaps object
-		frameInterval = videoCaps.MinFrameInterval;
-		
-		VideoMediaType supportedMediaType;
-		supportedMediaType.width = width;
-		supportedMediaType.height = height;
-		supportedMediaType.needVerticalFlip = needVerticalFlip;
-		supportedMediaType.frameInterval = frameInterval;
-		supportedMediaType.subType = subtype;
-		
-	//printf("%s\n", supportedMediaType.toString().c_str() );
-		
-		mSupportedVideoMediaTypes.push_back( supportedMediaType );
+		mHasImageWaiters = mImageWaiters!=NULL;
 
-		_DeleteMediaType( mediaType );
-		mediaType = NULL;
+		// Still in the lock, so a concurrent cancel knows it's too late
+		for ( Device::ImageWaiter* waiter=readyWaiters; waiter; waiter=waiter->mNextWaiter )
+			waiter->mIsWaiting = false;
 	}
 
-	// Create the Sample Grabber Filter
-	IBaseFilter* sampleGrabberAsBaseFilterRaw = NULL;
-	hr = CoCreateInstance( CLSID_SampleGrabber, 0, CLSCTX_INPROC_SERVER, IID_IBaseFilter, (void**)&sampleGrabberAsBaseFilterRaw );
-	COMObjectSharedPtr<IBaseFilter> sampleGrabberAsBaseFilter( sampleGrabberAsBaseFilterRaw );
-	if ( FAILED(hr) )
-		return false;		
+	// Called without the lock, so they can wait again right away. A waiter may be gone once called
+	while ( readyWaiters )
+	{
+		Device::ImageWaiter* waiter = readyWaiters;
+		readyWaiters = waiter->mNextWaiter;
+		waiter->mNextWaiter = NULL;
+		waiter->onImageAvailable( mParentDevice, sequenceNumber );
+	}
+}
 
-	hr = graphBuilder->AddFilter( sampleGrabberAsBaseFilter.get(), L"Sample Grabber");
-    if ( FAILED(hr) ) 
-		return false;
+bool DeviceInternals::hasNewImage() const
+{
+	return mIsCapturing && mPublishedSequenceNumber>mConsumedSequenceNumber;
+}
 
-	// Create the Null Renderer Filter
-	IBaseFilter* nullFilterRaw = NULL;
-	hr = CoCreateInstance(CLSID_NullRenderer, NULL, CLSCTX_INPROC_SERVER, IID_IBaseFilter, (void**)&nullFilterRaw );
-	COMObjectSharedPtr<IBaseFilter> nullFilter( nullFilterRaw );
-	if ( FAILED(hr) )
-		return false;
+bool DeviceInternals::tryClaim()
+{
+	bool expected = false;
+	return mIsClaimed.compare_exchange_strong( expected, true, std::memory_order_acquire );
+}
 
-	hr = graphBuilder->AddFilter( nullFilter.get(), L"Null Renderer" );
-    if ( FAILED(hr) ) 
-	    return false;
-    
-	// Configure Sample Grabber
-	ISampleGrabber* sampleGrabberFilterRaw = NULL;
-	hr = sampleGrabberAsBaseFilter->QueryInterface( IID_ISampleGrabber, (void**)&sampleGrabberFilterRaw );
-	COMObjectSharedPtr<ISampleGrabber> sampleGrabberFilter( sampleGrabberFilterRaw );	
-	if ( FAILED(hr) )
-		return false;
+void DeviceInternals::releaseClaim()
+{
+	mIsClaimed.store( false, std::memory_order_release );
+}
 
-	hr = sampleGrabberFilter->SetOneShot( FALSE );
-	if ( FAILED(hr) )
+bool DeviceInternals::updateCapturedImage()
+{
+	if ( !isCapturing() )
 		return false;
 
-	hr = sampleGrabberFilter->SetBufferSamples( FALSE );
-	if ( FAILED(hr) )
-		return false;
-	
-	hr = sampleGrabberFilter->SetCallback( mSampleGrabberCallback, 1 );			// 1 means the callback called is ISampleGrabberCB::BufferCB()
-	if ( FAILED(hr) )
-		return false;
+	if ( mFrameRing )
+	{
+		CapturedImage* image = mFrameRing->beginRead();
+		if ( !image )
+			return false;
+		
+		// Give back the previous image now that we have a new one
+		if ( mNumHeldRingImages>0 )
+			mFrameRing->endRead( mNumHeldRingImages );
+		mCapturedImage = image;
+		onImagesConsumed( *image, *image, 1 );
+		mNumHeldRingImages = 1;
+		return true;
+	}
 
-	// Connect Filters: Source -> SampleGrabber -> Null
-hr = captureGraphBuilder2->RenderStream( &PIN_CATEGORY_CAPTURE, &MEDIATYPE_Video, sourceFilter.get(), sampleGrabberAsBaseFilter.get(), nullFilter.get() );
-//	hr = captureGraphBuilder2->RenderStream( &PIN_CATEGORY_CAPTURE, &MEDIATYPE_Video, sourceFilter.get(), sampleGrabberAsBaseFilter.get(), nullFilter.get() );
-	if ( FAILED(hr) )	// E_FAIL ?
+	Lock::Scope lockScope( mLock );
+	if ( !mHasNewImage )
 		return false;
-
-	// Store objects as members
-	mGraphBuilder = graphBuilder;
-	mCaptureGraphBuilder2 = captureGraphBuilder2;
-	mSampleGrabberFilter = sampleGrabberFilter;
-	mSourceFilter = sourceFilter;
+	std::swap( mFrontImage, mMiddleImage );
+	mCapturedImage = mFrontImage;
+	mHasNewImage = false;
+	onImagesConsumed( *mFrontImage, *mFrontImage, 1 );
 	return true;
 }
 
-bool DeviceInternals::startCapture( std::size_t indexMediaType )
+bool DeviceInternals::takeImages( Device::ImageBatch& batch )
 {
-	if ( isCapturing() )
+	batch = Device::ImageBatch();
+	if ( !isCapturing() || !mIsBatchMode )
 		return false;
 
-	// Get the VideoMediaType corresponding to the index
-	if ( indexMediaType>=mSupportedVideoMediaTypes.size() )
+	assert( mFrameRing );
+	CapturedImage* firstImages = NULL;
+	CapturedImage* secondImages = NULL;
+	std::size_t numFirstImages = 0;
+	std::size_t numSecondImages = 0;
+	std::size_t numImages = mFrameRing->beginReadAll( firstImages, numFirstImages, secondImages, numSecondImages );
+
+	// Give back the previous batch. Without new images, its newest one stays the captured image
+	std::size_t numKeptImages = numImages>0 ? 0 : std::min<std::size_t>( mNumHeldRingImages, 1 );
+	if ( mNumHeldRingImages>numKeptImages )
+		mFrameRing->endRead( mNumHeldRingImages - numKeptImages );
+	mNumHeldRingImages = numKeptImages;
+	if ( numImages==0 )
 		return false;
-	const VideoMediaType& videoMediaType = mSupportedVideoMediaTypes[indexMediaType];
 
+	mNumHeldRingImages = numImages;
+	mCapturedImage = numSecondImages>0 ? &secondImages[numSecondImages-1] : &firstImages[numFirstImages-1];
+	onImagesConsumed( firstImages[0], *mCapturedImage, numImages );
 
-	// Set capture source information
-	IAMStreamConfig* streamConfigRaw = NULL;
-//	hr = captureGraphBuilder2->FindInterface( &PIN_CATEGORY_CAPTURE, 0, sourceFilter.get(), IID_IAMStreamConfig, (void**)&streamConfigRaw );
-	//hr = sourceFilter->QueryInterface( IID_IAMStreamConfig, (void**)&streamConfigRaw );
-	IPin* pinRaw = NULL;
-	HRESULT hr = mCaptureGraphBuilder2->FindPin( mSourceFilter.get(), PINDIR_OUTPUT, &PIN_CATEGORY_CAPTURE, NULL, FALSE, 0, &pinRaw );
-	if ( FAILED(hr) )
-		return false;
-
-	COMObjectSharedPtr<IPin> pin( pinRaw );
-	hr = pin->QueryInterface( IID_IAMStreamConfig, (void**)&streamConfigRaw );
-	if ( FAILED(hr) )
-		return false;
-	
-	COMObjectSharedPtr<IAMStreamConfig> streamConfig( streamConfigRaw );
-	if ( FAILED(hr) )
-		return false;
+	batch.mFirstImages = firstImages;
+	batch.mNumFirstImages = numFirstImages;
+	batch.mSecondImages = secondImages;
+	batch.mNumSecondImages = numSecondImages;
+	return true;
+}
 
-	// Fetch the indexMediaTypeth MediaType and VideoCaps
-	VIDEO_STREAM_CONFIG_CAPS videoCaps;	// http://msdn.microsoft.com/en-us/library/windows/desktop/dd407352(v=vs.85).aspx
-	AM_MEDIA_TYPE* mediaType = NULL;	// http://msdn.microsoft.com/en-us/library/windows/desktop/dd373477(v=vs.85).aspx
-	hr = streamConfig->GetStreamCaps( static_cast<int>(indexMediaType), &mediaType, (BYTE*)&videoCaps );
-	if ( FAILED(hr) )
-		return false;
+// The images are consecutive in the queue. Only the oldest one is timed, so a batch costs the 
+// same whatever its size: it's the one that waited the longest
+void DeviceInternals::onImagesConsumed( const CapturedImage& oldestImage, const CapturedImage& newestImage, std::size_t numImages )
+{
+	mLatencyHistograms[Device::QueueingStage].record( Clock::getTimeInNs() - oldestImage.getPublishTimeInNs() );
+
+	// The sequence numbers restart from 1 at each capture, as does mConsumedSequenceNumber from 0. 
+	// The frames dropped in between the images of a batch are skipped too
+	unsigned int sequenceNumber = newestImage.getSequenceNumber();
+	unsigned int previousSequenceNumber = mConsumedSequenceNumber;
+	assert( oldestImage.getSequenceNumber()>previousSequenceNumber );
+	assert( sequenceNumber - previousSequenceNumber>=numImages );
+	incrementCounter( mNumSkippedFrames, sequenceNumber - previousSequenceNumber - numImages );
+	incrementCounter( mNumConsumedFrames, numImages );
+	mConsumedSequenceNumber = sequenceNumber;
+	mQueueDepth.fetch_sub( static_cast<unsigned int>(numImages), std::memory_order_relaxed );
+}
 
-	// Double check its the same as our internally stored VideoMediaType
-	assert( videoCaps.MinCroppingSize.cx==videoMediaType.width );
-	assert( videoCaps.MinCroppingSize.cy==videoMediaType.height );
-	assert( videoCaps.MinFrameInterval==videoMediaType.frameInterval );
-	assert( mediaType->subtype==videoMediaType.subType );
-
-streamConfig->SetFormat( mediaType );
-
-	// Set the SampleGrabberFilter to use it
-	hr = mSampleGrabberFilter->SetMediaType( mediaType );
-    if ( FAILED(hr) ) 
-		return false; 
-	_DeleteMediaType( mediaType );
-	mediaType = NULL;
-
-/*	::Sleep(100);
-	// Store the media type for later use.
-	AM_MEDIA_TYPE mediaTypeInUse;
-	hr = mSampleGrabberFilter->GetConnectedMediaType( &mediaTypeInUse );		// !!!!!!!!!!!!!!!
-	if ( FAILED(hr) )
-		return false;
-	assert( mediaType->subtype==mediaTypeInUse.subtype );
-*/
+void DeviceInternals::updateArrivalStatistics( long long arrivalTimeInNs, unsigned int numBytes )
+{
+	// The weight of the latest interval in the moving averages
+	const double alpha = 1.0 / 16.0;
+	const long long windowDurationInNs = 1000000000LL;
 
-/*	// Examine the format block.
-	if ( (g_mt.formattype == FORMAT_VideoInfo) && 
-		 (g_mt.cbFormat >= sizeof(VIDEOINFOHEADER)) &&
-		 (g_mt.pbFormat != NULL) ) 
-	{ 
-		g_pVih = (VIDEOINFOHEADER*)g_mt.pbFormat; 
+	if ( mLastArrivalTimeInNs!=0 )
+	{
+		double intervalInNs = static_cast<double>( arrivalTimeInNs - mLastArrivalTimeInNs );
+		if ( mAverageFrameIntervalInNs==0 )
+		{
+			mAverageFrameIntervalInNs = intervalInNs;
+		}
+		else
+		{
+			double deviationInNs = intervalInNs - mAverageFrameIntervalInNs;
+			mAverageFrameIntervalInNs += alpha * deviationInNs;
+			mAverageFrameIntervalDeviationInNs += alpha * ( (deviationInNs<0 ? -deviationInNs : deviationInNs) - mAverageFrameIntervalDeviationInNs );
+		}
+		if ( mAverageFrameIntervalInNs>0 )
+			mFrameRate.store( 1e9 / mAverageFrameIntervalInNs, std::memory_order_relaxed );
+		mFrameIntervalJitterInNs.store( mAverageFrameIntervalDeviationInNs, std::memory_order_relaxed );
 	}
-	else 
-	{ 
-		return false;
-*/
-	// Check that the MemoryBuffer to receive the image data hasn't been created yet
- 	assert( !mSampleGrabberCallback->getImageBuffer() );
+	mLastArrivalTimeInNs = arrivalTimeInNs;
 
-	
-	// Get Media Control interface from GraphBuilder
-	IMediaControl* mediaControlRaw = NULL;
-	hr = mGraphBuilder->QueryInterface( IID_IMediaControl, (LPVOID*)&mediaControlRaw );
-	COMObjectSharedPtr<IMediaControl> mediaControl( mediaControlRaw );
-	if ( FAILED(hr) )
-		return false;
-	
-	// Start the capture graph
-	hr = mediaControl->Run();
-	if ( FAILED(hr) ) 
-		return false; 
+	// The window closes on the first image past its end, which starts the next one
+	if ( mWindowStartTimeInNs==0 )
+		mWindowStartTimeInNs = arrivalTimeInNs;
+	long long windowElapsedTimeInNs = arrivalTimeInNs - mWindowStartTimeInNs;
+	if ( windowElapsedTimeInNs>=windowDurationInNs )
+	{
+		double elapsedTimeInSec = static_cast<double>(windowElapsedTimeInNs) / 1e9;
+		mWindowedFrameRate.store( mWindowNumFrames / elapsedTimeInSec, std::memory_order_relaxed );
+		mBytesPerSecond.store( mWindowNumBytes / elapsedTimeInSec, std::memory_order_relaxed );
+		mWindowStartTimeInNs = arrivalTimeInNs;
+		mWindowNumFrames = 0;
+		mWindowNumBytes = 0;
+	}
+	mWindowNumFrames++;
+	mWindowNumBytes += numBytes;
+}
 
-	mIsCapturing = true;
+void DeviceInternals::resetStatistics()
+{
+	// Only called while not capturing
+	mLastArrivalTimeInNs = 0;
+	mAverageFrameIntervalInNs = 0;
+	mAverageFrameIntervalDeviationInNs = 0;
+	mWindowStartTimeInNs = 0;
+	mWindowNumFrames = 0;
+	mWindowNumBytes = 0;
+	mFrameRate = 0;
+	mWindowedFrameRate = 0;
+	mBytesPerSecond = 0;
+	mFrameIntervalJitterInNs = 0;
+	mQueueDepth = 0;
+}
 
-	return true;
+Device::Statistics DeviceInternals::getStatistics() const
+{
+	Device::Statistics statistics;
+	statistics.frameRate = mFrameRate.load( std::memory_order_relaxed );
+	statistics.windowedFrameRate = mWindowedFrameRate.load( std::memory_order_relaxed );
+	statistics.bytesPerSecond = mBytesPerSecond.load( std::memory_order_relaxed );
+	statistics.frameIntervalJitterInNs = mFrameIntervalJitterInNs.load( std::memory_order_relaxed );
+	statistics.queueDepth = static_cast<unsigned int>( mQueueDepth.load( std::memory_order_relaxed ) );
+
+	const LatencyHistogram& listenerHistogram = mLatencyHistograms[Device::ListenerStage];
+	statistics.numListenerCalls = listenerHistogram.getNumSamples();
+	statistics.totalListenerTimeInNs = listenerHistogram.getTotalInNs();
+	const LatencyHistogram& conversionHistogram = mLatencyHistograms[Device::ConversionStage];
+	statistics.numConversions = conversionHistogram.getNumSamples();
+	statistics.totalConversionTimeInNs = conversionHistogram.getTotalInNs();
+	return statistics;
 }
 
-bool DeviceInternals::stopCapture()
+LatencyHistogram& DeviceInternals::getLatencyHistogram( Device::LatencyStage stage )
 {
-	if ( !isCapturing() )
-		return true;
-		
-	// Get Media Control interface from GraphBuilder
-	IMediaControl* mediaControlRaw = NULL;
-	HRESULT hr = mGraphBuilder->QueryInterface( IID_IMediaControl, (LPVOID*)&mediaControlRaw );
-	COMObjectSharedPtr<IMediaControl> mediaControl( mediaControlRaw );
-	if ( FAILED(hr) )
-		return false;
+	assert( stage>=0 && stage<Device::NumLatencyStages );
+	return mLatencyHistograms[stage];
+}
 
-	// Stop the capture graph
-	hr = mediaControl->Stop();
-	if ( FAILED(hr) ) 
-		return false; 
+const LatencyHistogram& DeviceInternals::getLatencyHistogram( Device::LatencyStage stage ) const
+{
+	assert( stage>=0 && stage<Device::NumLatencyStages );
+	return mLatencyHistograms[stage];
+}
 
-	mSampleGrabberCallback->deleteImageBuffer();
-	mSampleGrabberCallback->resetImageSequenceNumber();
+Device::FrameCounters DeviceInternals::getFrameCounters() const
+{
+	Device::FrameCounters counters;
+	counters.numDeliveredFrames = mNumDeliveredFrames.load( std::memory_order_relaxed );
+	counters.numConsumedFrames = mNumConsumedFrames.load( std::memory_order_relaxed );
+	counters.numOverwrittenFrames = mNumOverwrittenFrames.load( std::memory_order_relaxed );
+	counters.numDroppedFrames = mNumDroppedFrames.load( std::memory_order_relaxed );
+	counters.numSkippedFrames = mNumSkippedFrames.load( std::memory_order_relaxed );
+	return counters;
+}
 
-	mIsCapturing = false;
+bool DeviceInternals::addRealTimeListener( Device::RealTimeListener* listener )
+{
+	assert( listener );
+	mRealTimeListeners.add( listener );
 	return true;
 }
 
-bool DeviceInternals::getCapturedImage( MemoryBuffer& buffer, unsigned int& sequenceNumber, LONGLONG& timestamp ) const
+bool DeviceInternals::removeRealTimeListener( Device::RealTimeListener* listener )
 {
-	CriticalSectionEnterer criticalSectionRAII( mCriticalSection );
+	return mRealTimeListeners.remove( [listener]( Device::RealTimeListener* item ) { return item==listener; } );
+}
 
-	// Check that we're currently capturing and that a first image was already grabbed
-	const MemoryBuffer* capturedImageBuffer = mSampleGrabberCallback->getImageBuffer();
-	if ( !capturedImageBuffer )
+bool DeviceInternals::getEffectiveCaptureThreadSettings( Thread::Settings& settings ) const
+{
+	Lock::Scope lockScope( mEffectiveCaptureThreadSettingsLock );
+	if ( !mHasEffectiveCaptureThreadSettings )
 		return false;
+	settings = mEffectiveCaptureThreadSettings;
+	return true;
+}
 
-	// Initialize output parameters
-	sequenceNumber = mSampleGrabberCallback->getImageSequenceNumber();
-	timestamp = 0;
+FrameSubscription* DeviceInternals::createFrameSubscription( FrameSubscription::Policy policy, unsigned int queueDepth, unsigned int blockTimeoutInMs )
+{
+	if ( isCapturing() )
+		return NULL;
+	std::string name = mParentDevice ? mParentDevice->getName() + " subscription" : "Subscription";
+	FrameSubscription* subscription = new FrameSubscription( name, policy, queueDepth, blockTimeoutInMs );
+	mFrameSubscriptions.push_back( subscription );
+	return subscription;
+}
 
-	// Check that the destination buffer matches the size
-/*	if ( buffer.getSizeInBytes()!=capturedImageBuffer->getSizeInBytes() )
+bool DeviceInternals::deleteFrameSubscription( FrameSubscription* subscription )
+{
+	if ( isCapturing() )
 		return false;
-	// Fill the output parameters
-	bool ret = buffer.copyFrom( *capturedImageBuffer );
-	assert( ret );
-*/
-	unsigned int numBytes = std::min( buffer.getSizeInBytes(), capturedImageBuffer->getSizeInBytes() );
-	memcpy( buffer.getBytes(), (void*)capturedImageBuffer->getBytes(), numBytes );
-
-	
-//	sequenceNumber = mCapturedImageNumber;
-//	timestamp = mCapturedImageTimestamp;
-	
+	FrameSubscriptions::iterator itr = std::find( mFrameSubscriptions.begin(), mFrameSubscriptions.end(), subscription );
+	if ( itr==mFrameSubscriptions.end() )
+		return false;
+	mFrameSubscriptions.erase( itr );
+	delete subscription;
 	return true;
 }
 
-}
\ No newline at end of file
+}
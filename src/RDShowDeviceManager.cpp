@@ -23,28 +23,18 @@
 */
 #include "RDShowDeviceManager.h"
 
-#define WIN32_LEAN_AND_MEAN 
-#define NOMINMAX 
-#include <windows.h>
-#include <dshow.h>
-// See http://social.msdn.microsoft.com/forums/en-US/windowssdk/thread/ed097d2c-3d68-4f48-8448-277eaaf68252/
-#pragma include_alias( "dxtrans.h", "qedit.h" )
-#define __IDxtCompositor_INTERFACE_DEFINED__
-#define __IDxtAlphaSetter_INTERFACE_DEFINED__
-#define __IDxtJpeg_INTERFACE_DEFINED__
-#define __IDxtKey_INTERFACE_DEFINED__
-#include "qedit.h"
-
-#include "RDShowCOMObjectSharedPtr.h"
 #include "RDShowDevice.h"
-#include "RDShowUnicode.h"
+#include "RDShowDeviceBackend.h"
+#include "RDShowDeviceInternals.h"
+#include "RDShowImageNotifier.h"
+#include "RDShowThread.h"
+#ifdef RDSHOW_DIRECTSHOW
+	#include "RDShowDirectShowDeviceBackend.h"
+#endif
 #include <vector>
 #include <assert.h>
 #include <algorithm>
 
-// http://msdn.microsoft.com/en-us/library/windows/desktop/dd407331(v=vs.85).aspx
-// http://www.codeproject.com/Articles/34663/DirectShow-Examples-for-Using-SampleGrabber-for-Gr
-
 namespace RDShow
 {
 
@@ -60,71 +50,69 @@ public:
 	void			update();
 	const Devices&	getDevices() const	{ return mDevices; }
 
+	void			addBackend( DeviceBackend* backend );
+
+	bool			setThreadedMode( bool enabled, bool pinWorkerThreads );
+	bool			isThreadedMode() const	{ return mIsThreadedMode; }
+
+	void			setThreadSettings( Device::ThreadRole role, const Thread::Settings& settings );
+	const Thread::Settings&	getThreadSettings( Device::ThreadRole role ) const	{ return mThreadSettings[role]; }
+
+	bool			waitForAnyImage( const Devices& devices, Devices& readyDevices, unsigned int timeoutInMs );
+
 	void			addListener( Listener* listener );
 	bool			removeListener( Listener* listener );
 
 protected:
-	static void		wideCharStringToMultiByteString( const wchar_t* wideCharString, std::string& multiByteString );
-
-	struct DeviceInfo
+	struct BackendDeviceInfo
 	{
-		std::string friendlyName;		
-		std::string devicePath;		
-		COMObjectSharedPtr<IMoniker> moniker;
+		DeviceBackend*				backend;
+		DeviceBackend::DeviceInfo	info;
 	};
-	typedef std::vector<DeviceInfo>	DeviceInfos;
+	typedef std::vector<BackendDeviceInfo>	BackendDeviceInfos;
 
-	static bool		getDeviceInfo( COMObjectSharedPtr<IMoniker>& moniker, DeviceInfo& deviceInfo );
-	static bool		enumerateDevices( DeviceInfos& deviceInfos );
+	void			enumerateDevices( BackendDeviceInfos& deviceInfos );
 	void			updateDeviceList();
 
-	void			createDevice( DeviceInfo& deviceInfo );
+	void			createDevice( BackendDeviceInfo& deviceInfo );
 	void			deleteDevice( Device* device );
 
-	static LRESULT CALLBACK wndProcHook( int nCode, WPARAM wParam, LPARAM lParam );
+	static bool		claimReadyDevices( const Devices& devices, Devices& readyDevices );
+	bool			applyThreadedMode( Device* device, std::size_t deviceIndex );
+	void			applyThreadSettings( Device* device, std::size_t deviceIndex );
 
 private:
 	DeviceManager*  mParentDeviceManager;
 	bool			mUpdateDeviceListAtNextUpdate;
 	Devices			mDevices;
 
+	typedef std::vector<DeviceBackend*> DeviceBackends;
+	DeviceBackends	mBackends;
+
 	typedef	std::vector<DeviceManager::Listener*> Listeners; 
 	Listeners		mListeners;
 
-	typedef std::vector< DeviceManager::Internals* > InternalObjects;
-	static InternalObjects mInternalObjects;
-	HHOOK			mHookHandle;
-};
+	ImageNotifier	mImageNotifier;		// Notified by all the devices
 
-// The list of all the DeviceManager::Internals instances that exist in the application
-// This is needed because of the static nature of the WindowProc hook
-DeviceManager::Internals::InternalObjects DeviceManager::Internals::mInternalObjects;
+	bool			mIsThreadedMode;
+	bool			mPinWorkerThreads;
+	Thread::Settings	mThreadSettings[Device::NumThreadRoles];
+};
 
 DeviceManager::Internals::Internals( DeviceManager* parentDeviceManager )
 	: mParentDeviceManager( parentDeviceManager ),
 	  mUpdateDeviceListAtNextUpdate(true),
 	  mDevices(),
+	  mBackends(),
 	  mListeners(),
-	  mHookHandle(0)
+	  mImageNotifier("Shared image notifier"),
+	  mIsThreadedMode(false),
+	  mPinWorkerThreads(false),
+	  mThreadSettings()
 {
-	// Initialize the COM library 
-	// We dont check the result on purpose here. See documentation: 
-	// http://msdn.microsoft.com/en-us/library/windows/desktop/ms695279(v=vs.85).aspx
-	CoInitializeEx( NULL, COINIT_APARTMENTTHREADED );
-
-	// Add this instance to the static list
-	mInternalObjects.push_back( this );
-	
-	// Register hook when this is the first instance of DeviceManager::Internals created
-	// See this article for extra information
-	// http://www.codeproject.com/Articles/14500/Detecting-Hardware-Insertion-and-or-Removal
-	if ( mInternalObjects.size()==1 )
-	{
-		DWORD threadID = GetCurrentThreadId();
-		HINSTANCE hInstance = GetModuleHandle(NULL) ;
-		mHookHandle = SetWindowsHookEx( WH_CALLWNDPROC, wndProcHook, hInstance, threadID );
-		assert( mHookHandle );
-	}
+#ifdef RDSHOW_DIRECTSHOW
+	mBackends.push_back( new DirectShowDeviceBackend() );
+#endif
 }
 
 DeviceManager::Internals::~Internals()
@@ -135,147 +123,135 @@ DeviceManager::Internals::~Internals()
 		deleteDevice( devices[i] );
 	assert( mDevices.empty() );
 
-	// Shutdown COM 
-	CoUninitialize();
-
-	// Remove this instance from the static list
-	InternalObjects::iterator itr = std::find( mInternalObjects.begin(), mInternalObjects.end(), this );
-	assert( itr!=mInternalObjects.end() );
-	mInternalObjects.erase(itr);
-
-	// If there's no more instances, remove the hook
-	if ( mInternalObjects.empty() )
-	{
-		BOOL ret = UnhookWindowsHookEx( mHookHandle );
-		assert( ret );
-		mHookHandle = 0;
-	}
+	// Delete the backends once they don't have any device alive
+	for ( std::size_t i=0; i<mBackends.size(); ++i )
+		delete mBackends[i];
+	mBackends.clear();
 }
 
-LRESULT CALLBACK DeviceManager::Internals::wndProcHook( int nCode, WPARAM wParam, LPARAM lParam )
+void DeviceManager::Internals::addBackend( DeviceBackend* backend )
 {
-/*	std::wstringstream stream;
-	stream << std::hex;
-	stream << L"code=" << nCode << L" wparam=" << params.wParam << L" lparam=" << params.lParam << L" message=" << params.message << L" hwnd=" << params.hwnd << L"\n";
-	OutputDebugString(stream.str().c_str());
-*/
-	// Note:
-	// We only process the message if it is sent by the current thread.
-	// By "current" I guess that they mean the same thread as the one called the hook
-	// registration function... but that's a guess :(
-	// See http://msdn.microsoft.com/en-us/library/windows/desktop/ms644975(v=vs.85).aspx
-	// My goal is to use this information to avoid having to handle concurrency with 
-	// a critical section or whatnot.
-	// Because if this hook is called by different thread, there's a micro chance that the
-	// array of InternalObjects I'm using changes while I'm using it
-	if ( wParam!=0 )
-	{
-		const CWPSTRUCT& params = *reinterpret_cast<CWPSTRUCT*>(lParam);
-		if ( params.message==WM_DEVICECHANGE )
-		{
-			for ( std::size_t i=0; i<mInternalObjects.size(); ++i )
-				mInternalObjects[i]->mUpdateDeviceListAtNextUpdate = true;
-		}
-	}
-
-	// Process event
-	return CallNextHookEx( NULL, nCode, wParam, lParam );
+	assert( backend );
+	mBackends.push_back( backend );
+	mUpdateDeviceListAtNextUpdate = true;
 }
 
 void DeviceManager::Internals::update()
 {
+	// Every backend is asked, so none of them keeps a stale change flag
+	for ( std::size_t i=0; i<mBackends.size(); ++i )
+	{
+		if ( mBackends[i]->hasDeviceListChanged() )
+			mUpdateDeviceListAtNextUpdate = true;
+	}
+
 	if ( mUpdateDeviceListAtNextUpdate )
 	{
 		updateDeviceList();
 		mUpdateDeviceListAtNextUpdate = false;
 	}
 
+	// The devices claimed by threads waiting with waitForAnyImage() are updated by them, 
+	// the ones with a worker thread by their worker, and the application takes the images 
+	// of the ones in batch mode
 	for ( Devices::iterator itr=mDevices.begin(); itr!=mDevices.end(); ++itr )
 	{
 		Device* device = *itr;
-		device->update();
+		if ( device->isWorkerThreadEnabled() || device->isBatchModeEnabled() )
+			continue;
+		if ( device->mInternals->tryClaim() )
+			device->update();
 	}
 }
 
-bool DeviceManager::Internals::getDeviceInfo( COMObjectSharedPtr<IMoniker>& moniker, DeviceInfo& deviceInfo )
+bool DeviceManager::Internals::setThreadedMode( bool enabled, bool pinWorkerThreads )
 {
-	IPropertyBag* propertyBagRaw = NULL;
-	HRESULT hr = moniker->BindToStorage( 0, 0, IID_PPV_ARGS(&propertyBagRaw) );
-	COMObjectSharedPtr<IPropertyBag> propertyBag( propertyBagRaw );
-	if ( FAILED(hr) )
-		return false;
+	mIsThreadedMode = enabled;
+	mPinWorkerThreads = pinWorkerThreads;
+	bool ret = true;
+	for ( std::size_t i=0; i<mDevices.size(); ++i )
+	{
+		if ( !applyThreadedMode( mDevices[i], i ) )
+			ret = false;
+	}
+	return ret;
+}
 
-	VARIANT variant;
-	VariantInit( &variant );
-	hr = propertyBag->Read( L"FriendlyName", &variant, 0 );
-	if ( FAILED(hr) )
+bool DeviceManager::Internals::applyThreadedMode( Device* device, std::size_t deviceIndex )
+{
+	if ( !device->setWorkerThreadEnabled( mIsThreadedMode ) )
 		return false;
-	deviceInfo.friendlyName = Unicode::UTF16toUTF8String( variant.bstrVal );
-	VariantClear( &variant ); 
-
-	hr = propertyBag->Read(L"DevicePath", &variant, 0);
-	// PS3 Eye camera fail to return the DevicePath (on purpose?). We continue anyway
-	if ( FAILED(hr) )
-		deviceInfo.devicePath = "NoDevicePath";
-	else
- 		deviceInfo.devicePath = Unicode::UTF16toUTF8String( variant.bstrVal );
-	VariantClear(&variant); 
-	
-	deviceInfo.moniker = moniker;
-
+	applyThreadSettings( device, deviceIndex );
 	return true;
 }
 
-bool DeviceManager::Internals::enumerateDevices( DeviceInfos& deviceInfos )
+void DeviceManager::Internals::setThreadSettings( Device::ThreadRole role, const Thread::Settings& settings )
 {
-	deviceInfos.clear();
-
-	// Selecting a Capture Device
-	// http://msdn.microsoft.com/en-us/library/windows/desktop/dd377566(v=vs.85).aspx
+	assert( role>=0 && role<Device::NumThreadRoles );
+	mThreadSettings[role] = settings;
+	for ( std::size_t i=0; i<mDevices.size(); ++i )
+		applyThreadSettings( mDevices[i], i );
+}
 
-	// Create the system device enumerator
-	ICreateDevEnum* devEnumRaw = NULL;
-	HRESULT hr = CoCreateInstance( CLSID_SystemDeviceEnum, NULL, CLSCTX_INPROC, IID_ICreateDevEnum, (void**)&devEnumRaw );
-    COMObjectSharedPtr<ICreateDevEnum> devEnum( devEnumRaw );
-	if ( FAILED(hr) )
-		return false;
-	
-	// Create an enumerator for the video capture devices
-	IEnumMoniker* enumMonikerRaw = NULL;
-    hr = devEnum->CreateClassEnumerator( CLSID_VideoInputDeviceCategory, &enumMonikerRaw, 0 );
-	COMObjectSharedPtr<IEnumMoniker> enumMoniker( enumMonikerRaw );
-	if ( FAILED(hr) )
-		return false;	
+void DeviceManager::Internals::applyThreadSettings( Device* device, std::size_t deviceIndex )
+{
+	device->setThreadSettings( Device::CaptureThread, mThreadSettings[Device::CaptureThread] );
+	Thread::Settings workerThreadSettings = mThreadSettings[Device::WorkerThread];
+	if ( mIsThreadedMode && mPinWorkerThreads )
+	{
+		unsigned int numCPUs = std::min( Thread::getNumCPUs(), 64u );
+		workerThreadSettings.cpuMask = 1ULL << (deviceIndex % numCPUs);
+	}
+	device->setThreadSettings( Device::WorkerThread, workerThreadSettings );
+}
 
-	// If there are no enumerators for the requested type, then 
-	// CreateClassEnumerator will succeed, but pClassEnum will be NULL.
-	if ( !enumMoniker.get() )
-		return false;
+bool DeviceManager::Internals::waitForAnyImage( const Devices& devices, Devices& readyDevices, unsigned int timeoutInMs )
+{
+	readyDevices.clear();
+	readyDevices.reserve( devices.size() );		// So a reused vector doesn't allocate anymore
+	return mImageNotifier.wait( timeoutInMs, 
+		[&devices, &readyDevices]() { return claimReadyDevices( devices, readyDevices ); } );
+}
 
-	IMoniker* monikerRaw = NULL;
-	while ( enumMoniker->Next( 1, &monikerRaw, NULL)==S_OK )
-    {
-		COMObjectSharedPtr<IMoniker> moniker( monikerRaw );
+bool DeviceManager::Internals::claimReadyDevices( const Devices& devices, Devices& readyDevices )
+{
+	for ( Devices::const_iterator itr=devices.begin(); itr!=devices.end(); ++itr )
+	{
+		DeviceInternals* deviceInternals = (*itr)->mInternals;
+		if ( deviceInternals->hasNewImage() && deviceInternals->tryClaim() )
+			readyDevices.push_back( *itr );
+	}
+	return !readyDevices.empty();
+}
 
-		DeviceInfo deviceInfo;
-		if ( getDeviceInfo( moniker, deviceInfo ) )
+void DeviceManager::Internals::enumerateDevices( BackendDeviceInfos& deviceInfos )
+{
+	deviceInfos.clear();
+	for ( std::size_t i=0; i<mBackends.size(); ++i )
+	{
+		DeviceBackend::DeviceInfos backendDeviceInfos;
+		mBackends[i]->enumerateDevices( backendDeviceInfos );
+		for ( std::size_t j=0; j<backendDeviceInfos.size(); ++j )
+		{
+			BackendDeviceInfo deviceInfo;
+			deviceInfo.backend = mBackends[i];
+			deviceInfo.info = backendDeviceInfos[j];
 			deviceInfos.push_back( deviceInfo );
+		}
 	}
-
-	return true;
 }
 
 void DeviceManager::Internals::updateDeviceList()
 {
 	// Get up-to-date list of Devices
-	DeviceInfos deviceInfos;
-	DeviceManager::Internals::enumerateDevices( deviceInfos );
+	BackendDeviceInfos deviceInfos;
+	enumerateDevices( deviceInfos );
 
 	// Determine freshly added Devices
-	DeviceInfos newDeviceInfos;
+	BackendDeviceInfos newDeviceInfos;
 	for ( std::size_t i=0; i<deviceInfos.size(); ++i )
 	{
-		const std::string& path = deviceInfos[i].devicePath;
+		const std::string& path = deviceInfos[i].info.path;
 		bool found = false;
 		for ( std::size_t j=0; j<mDevices.size(); ++j )
 		{
@@ -299,7 +275,7 @@ void DeviceManager::Internals::updateDeviceList()
 
 		for ( std::size_t j=0; j<deviceInfos.size(); ++j )
 		{	
-			const std::string& path = deviceInfos[j].devicePath;
+			const std::string& path = deviceInfos[j].info.path;
 			if ( device->getPath()==path )
 			{
 				found = true;
@@ -319,15 +295,20 @@ void DeviceManager::Internals::updateDeviceList()
 		deleteDevice( removedDevices[i] );
 }
 
-void DeviceManager::Internals::createDevice( DeviceInfo& deviceInfo )
+void DeviceManager::Internals::createDevice( BackendDeviceInfo& deviceInfo )
 {
+	DeviceInternals* deviceInternals = deviceInfo.backend->createDeviceInternals( deviceInfo.info.path );
+	if ( !deviceInternals )
+		return;
+
 	// Notify 
 	for ( Listeners::const_iterator itr=mListeners.begin(); itr!=mListeners.end(); ++itr )
 		(*itr)->onDeviceAdding( mParentDeviceManager );
 
-	void* monikerSharedPtrAsVoidPtr = reinterpret_cast<void*>(&deviceInfo.moniker);
-	Device* device = new Device( mParentDeviceManager, monikerSharedPtrAsVoidPtr, deviceInfo.friendlyName, deviceInfo.devicePath );
+	deviceInternals->setSharedNotifier( &mImageNotifier );
+	Device* device = new Device( mParentDeviceManager, deviceInternals, deviceInfo.info.name, deviceInfo.info.path );
 	mDevices.push_back( device );
+	applyThreadedMode( device, mDevices.size()-1 );
 
 	// Notify 
 	for ( Listeners::const_iterator itr=mListeners.begin(); itr!=mListeners.end(); ++itr )
@@ -392,6 +373,36 @@ const Devices& DeviceManager::getDevices() const
 	return mInternals->getDevices();
 }
 
+void DeviceManager::addBackend( DeviceBackend* backend )
+{
+	mInternals->addBackend(backend);
+}
+
+bool DeviceManager::setThreadedMode( bool enabled, bool pinWorkerThreads )
+{
+	return mInternals->setThreadedMode( enabled, pinWorkerThreads );
+}
+
+bool DeviceManager::isThreadedMode() const
+{
+	return mInternals->isThreadedMode();
+}
+
+void DeviceManager::setThreadSettings( Device::ThreadRole role, const Thread::Settings& settings )
+{
+	mInternals->setThreadSettings( role, settings );
+}
+
+const Thread::Settings& DeviceManager::getThreadSettings( Device::ThreadRole role ) const
+{
+	return mInternals->getThreadSettings( role );
+}
+
+bool DeviceManager::waitForAnyImage( const Devices& devices, Devices& readyDevices, unsigned int timeoutInMs )
+{
+	return mInternals->waitForAnyImage( devices, readyDevices, timeoutInMs );
+}
+
 void DeviceManager::addListener( Listener* listener )
 {
 	mInternals->addListener(listener);
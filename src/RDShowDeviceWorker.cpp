@@ -0,0 +1,128 @@
+/*
+   The MIT License (MIT) (http://opensource.org/licenses/MIT)
+   
+   Copyright (c) 2015 Jacques Menuet
+   
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+   
+   The above copyright notice and this permission notice shall be included in all
+   copies or substantial portions of the Software.
+   
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+*/
+#include "RDShowDeviceWorker.h"
+
+#include <assert.h>
+#include "RDShowDevice.h"
+#include "RDShowDeviceInternals.h"
+#include "RDShowTracer.h"
+
+namespace RDShow
+{
+
+DeviceWorker::DeviceWorker( Device* device, DeviceInternals* deviceInternals )
+	: mDevice(device),
+	  mDeviceInternals(deviceInternals),
+	  mThreadSettings(),
+	  mThread(),
+	  mStopRequested(false),
+	  mEffectiveThreadSettingsLock("Worker thread settings"),
+	  mEffectiveThreadSettings(),
+	  mHasEffectiveThreadSettings(false)
+{
+	assert( mDevice && mDeviceInternals );
+	mEffectiveThreadSettingsLock.setName( mDevice->getName() + " worker thread settings" );
+}
+
+DeviceWorker::~DeviceWorker()
+{
+	stop();
+	join();
+
+	// Only left joinable when destroyed from its own thread, which then ends on its own
+	if ( mThread.joinable() )
+		mThread.detach();
+}
+
+void DeviceWorker::start()
+{
+	// A worker that stopped itself (see stop()) is joined now
+	join();
+	mStopRequested = false;
+	{
+		Lock::Scope lockScope( mEffectiveThreadSettingsLock );
+		mHasEffectiveThreadSettings = false;
+	}
+	mThread = std::thread( &DeviceWorker::threadMain, this );
+}
+
+void DeviceWorker::stop()
+{
+	// The notifier wakes up the worker as the stop request is part of what it waits for
+	mStopRequested = true;
+	mDeviceInternals->getImageNotifier().notify();
+
+	// A Listener can stop the capture from the worker thread: it can't join itself
+	if ( mThread.joinable() && mThread.get_id()!=std::this_thread::get_id() )
+		join();
+}
+
+bool DeviceWorker::isRunning() const
+{
+	return mThread.joinable() && !mStopRequested;
+}
+
+void DeviceWorker::join()
+{
+	if ( mThread.joinable() && mThread.get_id()!=std::this_thread::get_id() )
+		mThread.join();
+}
+
+bool DeviceWorker::getEffectiveThreadSettings( Thread::Settings& settings ) const
+{
+	Lock::Scope lockScope( mEffectiveThreadSettingsLock );
+	if ( !mHasEffectiveThreadSettings )
+		return false;
+	settings = mEffectiveThreadSettings;
+	return true;
+}
+
+void DeviceWorker::threadMain()
+{
+	{
+		Thread::Settings effectiveThreadSettings = mThreadSettings.isDefault() ? Thread::getCurrentThreadSettings() : Thread::applyToCurrentThread( mThreadSettings );
+		Lock::Scope lockScope( mEffectiveThreadSettingsLock );
+		mEffectiveThreadSettings = effectiveThreadSettings;
+		mHasEffectiveThreadSettings = true;
+	}
+	Tracer::setCurrentThreadName( mDevice->getName() + " worker" );
+
+	ImageNotifier& imageNotifier = mDeviceInternals->getImageNotifier();
+	DeviceInternals* deviceInternals = mDeviceInternals;
+	std::atomic<bool>& stopRequested = mStopRequested;
+	for (;;)
+	{
+		// The timeout is only a safety net: the images and the stop request wake the worker up
+		imageNotifier.wait( 100, 
+			[deviceInternals, &stopRequested]() { return stopRequested || !deviceInternals->isCapturing() || deviceInternals->hasNewImage(); } );
+		if ( mStopRequested || !mDeviceInternals->isCapturing() )
+			break;
+
+		// The update gives the claim back
+		if ( mDeviceInternals->tryClaim() )
+			mDevice->update();
+	}
+}
+
+}
@@ -0,0 +1,225 @@
+/*
+   The MIT License (MIT) (http://opensource.org/licenses/MIT)
+   
+   Copyright (c) 2015 Jacques Menuet
+   
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+   
+   The above copyright notice and this permission notice shall be included in all
+   copies or substantial portions of the Software.
+   
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+*/
+#include "RDShowDirectShowDeviceBackend.h"
+
+// See http://social.msdn.microsoft.com/forums/en-US/windowssdk/thread/ed097d2c-3d68-4f48-8448-277eaaf68252/
+#pragma include_alias( "dxtrans.h", "qedit.h" )
+#define __IDxtCompositor_INTERFACE_DEFINED__
+#define __IDxtAlphaSetter_INTERFACE_DEFINED__
+#define __IDxtJpeg_INTERFACE_DEFINED__
+#define __IDxtKey_INTERFACE_DEFINED__
+#include "qedit.h"
+
+#include "RDShowDirectShowDeviceInternals.h"
+#include "RDShowUnicode.h"
+#include <assert.h>
+#include <algorithm>
+
+// http://msdn.microsoft.com/en-us/library/windows/desktop/dd407331(v=vs.85).aspx
+// http://www.codeproject.com/Articles/34663/DirectShow-Examples-for-Using-SampleGrabber-for-Gr
+
+namespace RDShow
+{
+
+// The list of all the DirectShowDeviceBackend instances that exist in the application
+// This is needed because of the static nature of the WindowProc hook
+DirectShowDeviceBackend::Instances DirectShowDeviceBackend::mInstances;
+HHOOK DirectShowDeviceBackend::mHookHandle = 0;
+
+DirectShowDeviceBackend::DirectShowDeviceBackend()
+	: mMonikerInfos(),
+	  mDeviceListChanged(true)
+{
+	// Initialize the COM library 
+	// We dont check the result on purpose here. See documentation: 
+	// http://msdn.microsoft.com/en-us/library/windows/desktop/ms695279(v=vs.85).aspx
+	CoInitializeEx( NULL, COINIT_APARTMENTTHREADED );
+
+	// Add this instance to the static list
+	mInstances.push_back( this );
+	
+	// Register hook when this is the first instance created
+	// See this article for extra information
+	// http://www.codeproject.com/Articles/14500/Detecting-Hardware-Insertion-and-or-Removal
+	if ( mInstances.size()==1 )
+	{
+		DWORD threadID = GetCurrentThreadId();
+		HINSTANCE hInstance = GetModuleHandle(NULL) ;
+		mHookHandle = SetWindowsHookEx( WH_CALLWNDPROC, wndProcHook, hInstance, threadID );
+		assert( mHookHandle );
+	}
+}
+
+DirectShowDeviceBackend::~DirectShowDeviceBackend()
+{
+	// Release the monikers before shutting down COM 
+	mMonikerInfos.clear();
+	CoUninitialize();
+
+	// Remove this instance from the static list
+	Instances::iterator itr = std::find( mInstances.begin(), mInstances.end(), this );
+	assert( itr!=mInstances.end() );
+	mInstances.erase(itr);
+
+	// If there's no more instances, remove the hook
+	if ( mInstances.empty() )
+	{
+		BOOL ret = UnhookWindowsHookEx( mHookHandle );
+		assert( ret );
+		mHookHandle = 0;
+	}
+}
+
+LRESULT CALLBACK DirectShowDeviceBackend::wndProcHook( int nCode, WPARAM wParam, LPARAM lParam )
+{
+/*	std::wstringstream stream;
+	stream << std::hex;
+	stream << L"code=" << nCode << L" wparam=" << params.wParam << L" lparam=" << params.lParam << L" message=" << params.message << L" hwnd=" << params.hwnd << L"\n";
+	OutputDebugString(stream.str().c_str());
+*/
+	// Note:
+	// We only process the message if it is sent by the current thread.
+	// By "current" I guess that they mean the same thread as the one called the hook
+	// registration function... but that's a guess :(
+	// See http://msdn.microsoft.com/en-us/library/windows/desktop/ms644975(v=vs.85).aspx
+	// My goal is to use this information to avoid having to handle concurrency with 
+	// a critical section or whatnot.
+	// Because if this hook is called by different thread, there's a micro chance that the
+	// array of instances I'm using changes while I'm using it
+	if ( wParam!=0 )
+	{
+		const CWPSTRUCT& params = *reinterpret_cast<CWPSTRUCT*>(lParam);
+		if ( params.message==WM_DEVICECHANGE )
+		{
+			for ( std::size_t i=0; i<mInstances.size(); ++i )
+				mInstances[i]->mDeviceListChanged = true;
+		}
+	}
+
+	// Process event
+	return CallNextHookEx( NULL, nCode, wParam, lParam );
+}
+
+bool DirectShowDeviceBackend::hasDeviceListChanged()
+{
+	bool changed = mDeviceListChanged;
+	mDeviceListChanged = false;
+	return changed;
+}
+
+bool DirectShowDeviceBackend::enumerateDevices( DeviceInfos& deviceInfos )
+{
+	deviceInfos.clear();
+	if ( !enumerateMonikers( mMonikerInfos ) )
+		return false;
+
+	for ( std::size_t i=0; i<mMonikerInfos.size(); ++i )
+	{
+		DeviceInfo deviceInfo;
+		deviceInfo.name = mMonikerInfos[i].friendlyName;
+		deviceInfo.path = mMonikerInfos[i].devicePath;
+		deviceInfos.push_back( deviceInfo );
+	}
+	return true;
+}
+
+DeviceInternals* DirectShowDeviceBackend::createDeviceInternals( const std::string& path )
+{
+	for ( std::size_t i=0; i<mMonikerInfos.size(); ++i )
+	{
+		if ( mMonikerInfos[i].devicePath==path )
+			return new DirectShowDeviceInternals( mMonikerInfos[i].moniker );
+	}
+	return NULL;
+}
+
+bool DirectShowDeviceBackend::getMonikerInfo( COMObjectSharedPtr<IMoniker>& moniker, MonikerInfo& monikerInfo )
+{
+	IPropertyBag* propertyBagRaw = NULL;
+	HRESULT hr = moniker->BindToStorage( 0, 0, IID_PPV_ARGS(&propertyBagRaw) );
+	COMObjectSharedPtr<IPropertyBag> propertyBag( propertyBagRaw );
+	if ( FAILED(hr) )
+		return false;
+
+	VARIANT variant;
+	VariantInit( &variant );
+	hr = propertyBag->Read( L"FriendlyName", &variant, 0 );
+	if ( FAILED(hr) )
+		return false;
+	monikerInfo.friendlyName = Unicode::UTF16toUTF8String( variant.bstrVal );
+	VariantClear( &variant ); 
+
+	hr = propertyBag->Read(L"DevicePath", &variant, 0);
+	// PS3 Eye camera fail to return the DevicePath (on purpose?). We continue anyway
+	if ( FAILED(hr) )
+		monikerInfo.devicePath = "NoDevicePath";
+	else
+ 		monikerInfo.devicePath = Unicode::UTF16toUTF8String( variant.bstrVal );
+	VariantClear(&variant); 
+	
+	monikerInfo.moniker = moniker;
+
+	return true;
+}
+
+bool DirectShowDeviceBackend::enumerateMonikers( MonikerInfos& monikerInfos )
+{
+	monikerInfos.clear();
+
+	// Selecting a Capture Device
+	// http://msdn.microsoft.com/en-us/library/windows/desktop/dd377566(v=vs.85).aspx
+
+	// Create the system device enumerator
+	ICreateDevEnum* devEnumRaw = NULL;
+	HRESULT hr = CoCreateInstance( CLSID_SystemDeviceEnum, NULL, CLSCTX_INPROC, IID_ICreateDevEnum, (void**)&devEnumRaw );
+    COMObjectSharedPtr<ICreateDevEnum> devEnum( devEnumRaw );
+	if ( FAILED(hr) )
+		return false;
+	
+	// Create an enumerator for the video capture devices
+	IEnumMoniker* enumMonikerRaw = NULL;
+    hr = devEnum->CreateClassEnumerator( CLSID_VideoInputDeviceCategory, &enumMonikerRaw, 0 );
+	COMObjectSharedPtr<IEnumMoniker> enumMoniker( enumMonikerRaw );
+	if ( FAILED(hr) )
+		return false;	
+
+	// If there are no enumerators for the requested type, then 
+	// CreateClassEnumerator will succeed, but pClassEnum will be NULL.
+	if ( !enumMoniker.get() )
+		return false;
+
+	IMoniker* monikerRaw = NULL;
+	while ( enumMoniker->Next( 1, &monikerRaw, NULL)==S_OK )
+    {
+		COMObjectSharedPtr<IMoniker> moniker( monikerRaw );
+
+		MonikerInfo monikerInfo;
+		if ( getMonikerInfo( moniker, monikerInfo ) )
+			monikerInfos.push_back( monikerInfo );
+	}
+
+	return true;
+}
+
+}
@@ -0,0 +1,252 @@
+/*
+   The MIT License (MIT) (http://opensource.org/licenses/MIT)
+   
+   Copyright (c) 2015 Jacques Menuet
+   
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+   
+   The above copyright notice and this permission notice shall be included in all
+   copies or substantial portions of the Software.
+   
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+*/
+#include "RDShowFrameSubscription.h"
+
+#include <assert.h>
+#include <algorithm>
+#include <chrono>
+#include "RDShowCopyEngine.h"
+#include "RDShowClock.h"
+
+namespace RDShow
+{
+
+FrameSubscription::FrameSubscription( const std::string& name, Policy policy, unsigned int queueDepth, unsigned int blockTimeoutInMs )
+	: mPolicy(policy),
+	  mQueueDepth( std::max( queueDepth, 1u ) ),
+	  mBlockTimeoutInMs(blockTimeoutInMs),
+	  mImages(),
+	  mFreeImages(),
+	  mQueue(),
+	  mQueueFront(0),
+	  mQueueSize(0),
+	  mConsumerImage(-1),
+	  mOrphanedImage(NULL),
+	  mLock(name),
+	  mImageQueued(),
+	  mImageDequeued(),
+	  mIsOpen(false),
+	  mNumReceivedFrames(0),
+	  mNumConsumedFrames(0),
+	  mNumDroppedFrames(0),
+	  mNumBlockedFrames(0),
+	  mTotalBlockedTimeInNs(0),
+	  mMaxBlockedTimeInNs(0),
+	  mCurrentQueueDepth(0)
+{
+	mQueue.resize( mQueueDepth );
+	mFreeImages.reserve( mQueueDepth+2 );
+}
+
+FrameSubscription::~FrameSubscription()
+{
+	assert( !mIsOpen );
+	deleteImages();
+	delete mOrphanedImage;
+}
+
+void FrameSubscription::deleteImages()
+{
+	for ( std::size_t i=0; i<mImages.size(); ++i )
+		delete mImages[i];
+	mImages.clear();
+}
+
+void FrameSubscription::open( const ImageFormat& imageFormat )
+{
+	Lock::Scope lockScope( mLock );
+	assert( !mIsOpen );
+
+	// Whatever the consumer didn't get from the previous capture is dropped
+	mNumDroppedFrames.store( mNumDroppedFrames.load( std::memory_order_relaxed ) + mQueueSize, std::memory_order_relaxed );
+	
+	// The consumer may still hold an image from the previous capture. It's kept out of the 
+	// free list, or if the format changed, handed over to mOrphanedImage until it's released
+	if ( !mImages.empty() && mImages[0]->getImage().getFormat()!=imageFormat )
+	{
+		if ( mConsumerImage>=0 )
+		{
+			assert( !mOrphanedImage );
+			mOrphanedImage = mImages[mConsumerImage];
+			mImages[mConsumerImage] = NULL;
+			mConsumerImage = -1;
+		}
+		deleteImages();
+	}
+	if ( mImages.empty() )
+	{
+		for ( unsigned int i=0; i<mQueueDepth+2; ++i )
+			mImages.push_back( new CapturedImage( imageFormat ) );
+	}
+	mFreeImages.clear();
+	for ( unsigned int i=0; i<mImages.size(); ++i )
+	{
+		if ( static_cast<int>(i)!=mConsumerImage )
+			mFreeImages.push_back( i );
+	}
+	mQueueFront = 0;
+	mQueueSize = 0;
+	mCurrentQueueDepth = 0;
+	mIsOpen = true;
+}
+
+void FrameSubscription::close()
+{
+	{
+		Lock::Scope lockScope( mLock );
+		mIsOpen = false;
+	}
+	mImageQueued.notify_all();
+	mImageDequeued.notify_all();
+}
+
+void FrameSubscription::offerBuffer( const unsigned char* bytes, unsigned int numBytes, unsigned int sequenceNumber, long long timestampInNs, long long arrivalTimeInNs )
+{
+	int imageIndex = -1;
+	{
+		std::unique_lock<Lock> lock( mLock );
+		if ( !mIsOpen )
+			return;
+		incrementCounter( mNumReceivedFrames );
+
+		if ( mQueueSize==mQueueDepth )
+		{
+			switch ( mPolicy )
+			{
+			case DropOldest:
+				// Recycle the oldest image for the new one
+				imageIndex = mQueue[mQueueFront];
+				mQueueFront = (mQueueFront + 1) % mQueueDepth;
+				mQueueSize--;
+				incrementCounter( mNumDroppedFrames );
+				break;
+
+			case DropNewest:
+				incrementCounter( mNumDroppedFrames );
+				return;
+
+			case Block:
+			{
+				// Only the consumer makes room, and nobody else adds to the queue meanwhile
+				long long blockStartTimeInNs = Clock::getTimeInNs();
+				mImageDequeued.wait_for( lock, std::chrono::milliseconds(mBlockTimeoutInMs), 
+					[this]() { return !mIsOpen || mQueueSize<mQueueDepth; } );
+				long long blockedTimeInNs = Clock::getTimeInNs() - blockStartTimeInNs;
+				incrementCounter( mNumBlockedFrames );
+				mTotalBlockedTimeInNs.store( mTotalBlockedTimeInNs.load( std::memory_order_relaxed ) + blockedTimeInNs, std::memory_order_relaxed );
+				if ( blockedTimeInNs>mMaxBlockedTimeInNs.load( std::memory_order_relaxed ) )
+					mMaxBlockedTimeInNs.store( blockedTimeInNs, std::memory_order_relaxed );
+				if ( mQueueSize==mQueueDepth || !mIsOpen )
+				{
+					incrementCounter( mNumDroppedFrames );
+					return;
+				}
+				break;
+			}
+			}
+		}
+		
+		// Besides the queue, only the consumer can hold an image: there's always a free one
+		if ( imageIndex<0 )
+		{
+			assert( !mFreeImages.empty() );
+			imageIndex = mFreeImages.back();
+			mFreeImages.pop_back();
+		}
+	}
+
+	// The image being written belongs to the capture thread: no need to lock
+	CapturedImage* image = mImages[imageIndex];
+	MemoryBuffer& buffer = image->getImage().getBuffer();
+	CopyEngine::copy( buffer.getWritableBytes(), bytes, std::min( numBytes, buffer.getSizeInBytes() ) ); 
+	image->setSequenceNumber( sequenceNumber );
+	image->setTimestampInNs( timestampInNs );
+	image->setArrivalTimeInNs( arrivalTimeInNs );
+	image->setPublishTimeInNs( Clock::getTimeInNs() );
+
+	{
+		Lock::Scope lockScope( mLock );
+		mQueue[ (mQueueFront + mQueueSize) % mQueueDepth ] = static_cast<unsigned int>(imageIndex);
+		mQueueSize++;
+		mCurrentQueueDepth.store( mQueueSize, std::memory_order_relaxed );
+	}
+	mImageQueued.notify_one();
+}
+
+const CapturedImage* FrameSubscription::acquireImage( unsigned int timeoutInMs )
+{
+	std::unique_lock<Lock> lock( mLock );
+	releaseConsumerImage();
+
+	mImageQueued.wait_for( lock, std::chrono::milliseconds(timeoutInMs), [this]() { return !mIsOpen || mQueueSize>0; } );
+	if ( mQueueSize==0 )
+		return NULL;
+	
+	mConsumerImage = static_cast<int>( mQueue[mQueueFront] );
+	mQueueFront = (mQueueFront + 1) % mQueueDepth;
+	mQueueSize--;
+	mCurrentQueueDepth.store( mQueueSize, std::memory_order_relaxed );
+	incrementCounter( mNumConsumedFrames );
+	lock.unlock();
+
+	if ( mPolicy==Block )
+		mImageDequeued.notify_one();
+	return mImages[mConsumerImage];
+}
+
+void FrameSubscription::releaseImage()
+{
+	Lock::Scope lockScope( mLock );
+	releaseConsumerImage();
+}
+
+// Called with mLock held
+void FrameSubscription::releaseConsumerImage()
+{
+	if ( mConsumerImage>=0 )
+	{
+		mFreeImages.push_back( static_cast<unsigned int>(mConsumerImage) );
+		mConsumerImage = -1;
+	}
+	if ( mOrphanedImage )
+	{
+		delete mOrphanedImage;
+		mOrphanedImage = NULL;
+	}
+}
+
+FrameSubscription::Counters FrameSubscription::getCounters() const
+{
+	Counters counters;
+	counters.numReceivedFrames = mNumReceivedFrames.load( std::memory_order_relaxed );
+	counters.numConsumedFrames = mNumConsumedFrames.load( std::memory_order_relaxed );
+	counters.numDroppedFrames = mNumDroppedFrames.load( std::memory_order_relaxed );
+	counters.numBlockedFrames = mNumBlockedFrames.load( std::memory_order_relaxed );
+	counters.totalBlockedTimeInNs = mTotalBlockedTimeInNs.load( std::memory_order_relaxed );
+	counters.maxBlockedTimeInNs = mMaxBlockedTimeInNs.load( std::memory_order_relaxed );
+	counters.queueDepth = mCurrentQueueDepth.load( std::memory_order_relaxed );
+	return counters;
+}
+
+}
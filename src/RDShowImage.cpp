@@ -39,9 +39,34 @@ Image::Image()
 }
 
 // Construct a blank image of a specific format. The internal image data is allocated and zero-filled
-Image::Image( const ImageFormat& imageFormat )
+// The tag tells the MemoryAccounting what the image is used for
+Image::Image( const ImageFormat& imageFormat, MemoryAccounting::Tag tag )
 	: mFormat( imageFormat), 
-	  mBuffer( imageFormat.getDataSizeInBytes() )
+	  mBuffer( imageFormat.getDataSizeInBytes(), tag )
+{
+}
+
+// Construct an image whose data is a region of a file mapped in memory. The data isn't zero-filled, 
+// it's the current content of the file. If the mapping fails, the image buffer is empty
+Image::Image( const ImageFormat& imageFormat, const std::string& filename, unsigned long long offset, MappedFile::Mode mode )
+	: mFormat( imageFormat ), 
+	  mBuffer( filename, offset, imageFormat.getDataSizeInBytes(), mode )
+{
+}
+
+// Construct a temporary image whose data is allocated from a ScratchArena. The data isn't zero-filled
+// and becomes invalid when the arena is reset
+Image::Image( const ImageFormat& imageFormat, ScratchArena& arena )
+	: mFormat( imageFormat ), 
+	  mBuffer( arena, imageFormat.getDataSizeInBytes() )
+{
+}
+
+// Construct an image that borrows its data, which must be at least as large as the format requires.
+// Nothing is copied and the image is only valid as long as the data is 
+Image::Image( const ImageFormat& imageFormat, const unsigned char* externalBytes )
+	: mFormat( imageFormat ), 
+	  mBuffer( externalBytes, imageFormat.getDataSizeInBytes() )
 {
 }
 
@@ -24,14 +24,32 @@
 #include "RDShowImageConverter.h"
 
 #include <assert.h>
+#include "RDShowClock.h"
+#include "RDShowTracer.h"
+#include "RDShowTaskScheduler.h"
 
 namespace RDShow
 {
 
-ImageConverter::ImageConverter( const ImageFormat& outputImageFormat )
-	: mImage(NULL)	
+namespace
 {
-	mImage = new Image( outputImageFormat );
+
+// Enough rows per task for the work to outweigh the cost of scheduling it
+unsigned int getRowGrainSize( std::size_t numBytesPerRow )
+{
+	const std::size_t minNumBytesPerTask = 64 * 1024;
+	if ( numBytesPerRow==0 || numBytesPerRow>=minNumBytesPerTask )
+		return 1;
+	return static_cast<unsigned int>( minNumBytesPerTask / numBytesPerRow );
+}
+
+}
+
+ImageConverter::ImageConverter( const ImageFormat& outputImageFormat, MemoryAccounting::Tag tag )
+	: mImage(NULL),
+	  mLatencyHistogram(NULL)
+{
+	mImage = new Image( outputImageFormat, tag );
 }
 
 ImageConverter::~ImageConverter()
@@ -40,11 +58,18 @@ ImageConverter::~ImageConverter()
 	mImage = NULL;
 }
 
-bool ImageConverter::update( const Image& sourceImage )
+bool ImageConverter::update( const Image& sourceImage, unsigned int sequenceNumber )
 {
+	Tracer::Scope traceScope( "ImageConverter::update", sequenceNumber );
+	long long startTimeInNs = mLatencyHistogram ? Clock::getTimeInNs() : 0;
+	bool ret = false;
 	if ( sourceImage.getFormat()==mImage->getFormat() )
-		return mImage->getBuffer().copyFrom( sourceImage.getBuffer() );
-	return convertImage( sourceImage, *mImage );
+		ret = mImage->getBuffer().copyFrom( sourceImage.getBuffer() );
+	else
+		ret = convertImage( sourceImage, *mImage, sequenceNumber );
+	if ( mLatencyHistogram )
+		mLatencyHistogram->record( Clock::getTimeInNs() - startTimeInNs );
+	return ret;
 }
 
 bool ImageConverter::convertBGR24ImageToRGB24Image( const Image& sourceImage, Image& destImage )
@@ -59,24 +84,34 @@ bool ImageConverter::convertBGR24ImageToRGB24Image( const Image& sourceImage, Im
 	unsigned int height = sourceImage.getFormat().getHeight();
 	if ( destImage.getFormat().getWidth()!=width || destImage.getFormat().getHeight()!=height )
 		 return false;
+	if ( destImage.getBuffer().isReadOnly() )
+		return false;
 
-	const unsigned char* sourceBytes = sourceImage.getBuffer().getBytes();
-	unsigned char* destBytes = destImage.getBuffer().getBytes();
-	for ( unsigned int y=0; y<height; ++y )
-	{
-		for ( unsigned int x=0; x<width; ++x )
+	// Rows are converted in parallel, each sub-range starting at its own row
+	const unsigned char* sourceImageBytes = sourceImage.getBuffer().getBytes();
+	unsigned char* destImageBytes = destImage.getBuffer().getWritableBytes();
+	std::size_t sourceLineSize = width * 3;
+	std::size_t destLineSize = width * 3;
+	TaskScheduler::parallelFor( 0, height, getRowGrainSize( destLineSize ), [&]( unsigned int firstRow, unsigned int endRow )
 		{
-			unsigned char blue = sourceBytes[0];
-			unsigned char green = sourceBytes[1];
-			unsigned char red = sourceBytes[2];
-			sourceBytes += 3;	
-
-			destBytes[0] = red;
-			destBytes[1] = green;
-			destBytes[2] = blue;
-			destBytes += 3;
-		}
-	}
+			const unsigned char* sourceBytes = sourceImageBytes + firstRow * sourceLineSize;
+			unsigned char* destBytes = destImageBytes + firstRow * destLineSize;
+			for ( unsigned int y=firstRow; y<endRow; ++y )
+			{
+				for ( unsigned int x=0; x<width; ++x )
+				{
+					unsigned char blue = sourceBytes[0];
+					unsigned char green = sourceBytes[1];
+					unsigned char red = sourceBytes[2];
+					sourceBytes += 3;	
+
+					destBytes[0] = red;
+					destBytes[1] = green;
+					destBytes[2] = blue;
+					destBytes += 3;
+				}
+			}
+		} );
 	return true;
 }
 
@@ -92,25 +127,35 @@ bool ImageConverter::convertBGRX32ImageToRGB24Image( const Image& sourceImage, I
 	unsigned int height = sourceImage.getFormat().getHeight();
 	if ( destImage.getFormat().getWidth()!=width || destImage.getFormat().getHeight()!=height )
 		 return false;
+	if ( destImage.getBuffer().isReadOnly() )
+		return false;
 	
-	const unsigned char* sourceBytes = sourceImage.getBuffer().getBytes();
-	unsigned char* destBytes = destImage.getBuffer().getBytes();
-	for ( unsigned int y=0; y<height; ++y )
-	{
-		for ( unsigned int x=0; x<width; ++x )
+	// Rows are converted in parallel, each sub-range starting at its own row
+	const unsigned char* sourceImageBytes = sourceImage.getBuffer().getBytes();
+	unsigned char* destImageBytes = destImage.getBuffer().getWritableBytes();
+	std::size_t sourceLineSize = width * 4;
+	std::size_t destLineSize = width * 3;
+	TaskScheduler::parallelFor( 0, height, getRowGrainSize( destLineSize ), [&]( unsigned int firstRow, unsigned int endRow )
 		{
-			unsigned char blue = sourceBytes[0];
-			unsigned char green = sourceBytes[1];
-			unsigned char red = sourceBytes[2];
-			//unsigned char unused = sourceBytes[3];
-			sourceBytes += 4;	
-
-			destBytes[0] = red;
-			destBytes[1] = green;
-			destBytes[2] = blue;
-			destBytes += 3;
-		}
-	}
+			const unsigned char* sourceBytes = sourceImageBytes + firstRow * sourceLineSize;
+			unsigned char* destBytes = destImageBytes + firstRow * destLineSize;
+			for ( unsigned int y=firstRow; y<endRow; ++y )
+			{
+				for ( unsigned int x=0; x<width; ++x )
+				{
+					unsigned char blue = sourceBytes[0];
+					unsigned char green = sourceBytes[1];
+					unsigned char red = sourceBytes[2];
+					//unsigned char unused = sourceBytes[3];
+					sourceBytes += 4;	
+
+					destBytes[0] = red;
+					destBytes[1] = green;
+					destBytes[2] = blue;
+					destBytes += 3;
+				}
+			}
+		} );
 	return true;
 }
 
@@ -126,25 +171,35 @@ bool ImageConverter::convertBGRX32ImageToBGR24Image( const Image& sourceImage, I
 	unsigned int height = sourceImage.getFormat().getHeight();
 	if ( destImage.getFormat().getWidth()!=width || destImage.getFormat().getHeight()!=height )
 		 return false;
+	if ( destImage.getBuffer().isReadOnly() )
+		return false;
 	
-	const unsigned char* sourceBytes = sourceImage.getBuffer().getBytes();
-	unsigned char* destBytes = destImage.getBuffer().getBytes();
-	for ( unsigned int y=0; y<height; ++y )
-	{
-		for ( unsigned int x=0; x<width; ++x )
+	// Rows are converted in parallel, each sub-range starting at its own row
+	const unsigned char* sourceImageBytes = sourceImage.getBuffer().getBytes();
+	unsigned char* destImageBytes = destImage.getBuffer().getWritableBytes();
+	std::size_t sourceLineSize = width * 4;
+	std::size_t destLineSize = width * 3;
+	TaskScheduler::parallelFor( 0, height, getRowGrainSize( destLineSize ), [&]( unsigned int firstRow, unsigned int endRow )
 		{
-			unsigned char blue = sourceBytes[0];
-			unsigned char green = sourceBytes[1];
-			unsigned char red = sourceBytes[2];
-			//unsigned char unused = sourceBytes[3];
-			sourceBytes += 4;	
-
-			destBytes[0] = blue;
-			destBytes[1] = green;
-			destBytes[2] = red;
-			destBytes += 3;
-		}
-	}
+			const unsigned char* sourceBytes = sourceImageBytes + firstRow * sourceLineSize;
+			unsigned char* destBytes = destImageBytes + firstRow * destLineSize;
+			for ( unsigned int y=firstRow; y<endRow; ++y )
+			{
+				for ( unsigned int x=0; x<width; ++x )
+				{
+					unsigned char blue = sourceBytes[0];
+					unsigned char green = sourceBytes[1];
+					unsigned char red = sourceBytes[2];
+					//unsigned char unused = sourceBytes[3];
+					sourceBytes += 4;	
+
+					destBytes[0] = blue;
+					destBytes[1] = green;
+					destBytes[2] = red;
+					destBytes += 3;
+				}
+			}
+		} );
 	return true;
 }
 
@@ -163,6 +218,8 @@ bool ImageConverter::convertYUYVImageToRGB24Image( const Image& sourceImage, Ima
 	unsigned int height = sourceImage.getFormat().getHeight();
 	if ( destImage.getFormat().getWidth()!=width || destImage.getFormat().getHeight()!=height )
 		 return false;
+	if ( destImage.getBuffer().isReadOnly() )
+		return false;
 
 	// General information about YUV color space can be found here:
 	// http://en.wikipedia.org/wiki/YUV 
@@ -172,32 +229,40 @@ bool ImageConverter::convertYUYVImageToRGB24Image( const Image& sourceImage, Ima
 	// The following conversion code comes from here:
 	// http://stackoverflow.com/questions/4491649/how-to-convert-yuy2-to-a-bitmap-in-c
 	// http://msdn.microsoft.com/en-us/library/aa904813(VS.80).aspx#yuvformats_2
-	const unsigned char* sourceBytes = sourceImage.getBuffer().getBytes();
-	unsigned char* destBytes = destImage.getBuffer().getBytes();
-	for ( unsigned int y=0; y<height; ++y )
-	{
-		for ( unsigned int i=0; i<width/2; ++i )
+	// Rows are converted in parallel, each sub-range starting at its own row
+	const unsigned char* sourceImageBytes = sourceImage.getBuffer().getBytes();
+	unsigned char* destImageBytes = destImage.getBuffer().getWritableBytes();
+	std::size_t sourceLineSize = (width / 2) * 4;
+	std::size_t destLineSize = (width / 2) * 6;
+	TaskScheduler::parallelFor( 0, height, getRowGrainSize( destLineSize ), [&]( unsigned int firstRow, unsigned int endRow )
 		{
-			int y0 = sourceBytes[0];
-			int u0 = sourceBytes[1];
-			int y1 = sourceBytes[2];
-			int v0 = sourceBytes[3];
-			sourceBytes += 4;	
+			const unsigned char* sourceBytes = sourceImageBytes + firstRow * sourceLineSize;
+			unsigned char* destBytes = destImageBytes + firstRow * destLineSize;
+			for ( unsigned int y=firstRow; y<endRow; ++y )
+			{
+				for ( unsigned int i=0; i<width/2; ++i )
+				{
+					int y0 = sourceBytes[0];
+					int u0 = sourceBytes[1];
+					int y1 = sourceBytes[2];
+					int v0 = sourceBytes[3];
+					sourceBytes += 4;	
 			
-			int c = y0 - 16;
-			int d = u0 - 128;
-			int e = v0 - 128;
-			destBytes[0] = CLIP_INT_TO_UCHAR(( 298 * c           + 409 * e + 128) >> 8);		// Red
-			destBytes[1] = CLIP_INT_TO_UCHAR(( 298 * c - 100 * d - 208 * e + 128) >> 8);		// Green
-			destBytes[2] = CLIP_INT_TO_UCHAR(( 298 * c + 516 * d           + 128) >> 8);		// Blue
+					int c = y0 - 16;
+					int d = u0 - 128;
+					int e = v0 - 128;
+					destBytes[0] = CLIP_INT_TO_UCHAR(( 298 * c           + 409 * e + 128) >> 8);		// Red
+					destBytes[1] = CLIP_INT_TO_UCHAR(( 298 * c - 100 * d - 208 * e + 128) >> 8);		// Green
+					destBytes[2] = CLIP_INT_TO_UCHAR(( 298 * c + 516 * d           + 128) >> 8);		// Blue
 			
-			c = y1 - 16;
-			destBytes[3] = CLIP_INT_TO_UCHAR(( 298 * c           + 409 * e + 128) >> 8);		// Red
-			destBytes[4] = CLIP_INT_TO_UCHAR(( 298 * c - 100 * d - 208 * e + 128) >> 8);		// Green
-			destBytes[5] = CLIP_INT_TO_UCHAR(( 298 * c + 516 * d           + 128) >> 8);		// Blue
-			destBytes += 6;
-		}
-	}
+					c = y1 - 16;
+					destBytes[3] = CLIP_INT_TO_UCHAR(( 298 * c           + 409 * e + 128) >> 8);		// Red
+					destBytes[4] = CLIP_INT_TO_UCHAR(( 298 * c - 100 * d - 208 * e + 128) >> 8);		// Green
+					destBytes[5] = CLIP_INT_TO_UCHAR(( 298 * c + 516 * d           + 128) >> 8);		// Blue
+					destBytes += 6;
+				}
+			}
+		} );
 	return true;
 }
 
@@ -214,6 +279,8 @@ bool ImageConverter::convertYUYVImageToBGR24Image( const Image& sourceImage, Ima
 	unsigned int height = sourceImage.getFormat().getHeight();
 	if ( destImage.getFormat().getWidth()!=width || destImage.getFormat().getHeight()!=height )
 		 return false;
+	if ( destImage.getBuffer().isReadOnly() )
+		return false;
 
 	// General information about YUV color space can be found here:
 	// http://en.wikipedia.org/wiki/YUV 
@@ -223,40 +290,49 @@ bool ImageConverter::convertYUYVImageToBGR24Image( const Image& sourceImage, Ima
 	// The following conversion code comes from here:
 	// http://stackoverflow.com/questions/4491649/how-to-convert-yuy2-to-a-bitmap-in-c
 	// http://msdn.microsoft.com/en-us/library/aa904813(VS.80).aspx#yuvformats_2
-	const unsigned char* sourceBytes = sourceImage.getBuffer().getBytes();
-	unsigned char* destBytes = destImage.getBuffer().getBytes();
-	for ( unsigned int y=0; y<height; ++y )
-	{
-		for ( unsigned int i=0; i<width/2; ++i )
+	// Rows are converted in parallel, each sub-range starting at its own row
+	const unsigned char* sourceImageBytes = sourceImage.getBuffer().getBytes();
+	unsigned char* destImageBytes = destImage.getBuffer().getWritableBytes();
+	std::size_t sourceLineSize = (width / 2) * 4;
+	std::size_t destLineSize = (width / 2) * 6;
+	TaskScheduler::parallelFor( 0, height, getRowGrainSize( destLineSize ), [&]( unsigned int firstRow, unsigned int endRow )
 		{
-			int y0 = sourceBytes[0];
-			int u0 = sourceBytes[1];
-			int y1 = sourceBytes[2];
-			int v0 = sourceBytes[3];
-			sourceBytes += 4;	
+			const unsigned char* sourceBytes = sourceImageBytes + firstRow * sourceLineSize;
+			unsigned char* destBytes = destImageBytes + firstRow * destLineSize;
+			for ( unsigned int y=firstRow; y<endRow; ++y )
+			{
+				for ( unsigned int i=0; i<width/2; ++i )
+				{
+					int y0 = sourceBytes[0];
+					int u0 = sourceBytes[1];
+					int y1 = sourceBytes[2];
+					int v0 = sourceBytes[3];
+					sourceBytes += 4;	
 			
-			int c = y0 - 16;
-			int d = u0 - 128;
-			int e = v0 - 128;
-			destBytes[0] = CLIP_INT_TO_UCHAR(( 298 * c + 516 * d           + 128) >> 8);		// Blue
-			destBytes[1] = CLIP_INT_TO_UCHAR(( 298 * c - 100 * d - 208 * e + 128) >> 8);		// Green
-			destBytes[2] = CLIP_INT_TO_UCHAR(( 298 * c           + 409 * e + 128) >> 8);		// Red
+					int c = y0 - 16;
+					int d = u0 - 128;
+					int e = v0 - 128;
+					destBytes[0] = CLIP_INT_TO_UCHAR(( 298 * c + 516 * d           + 128) >> 8);		// Blue
+					destBytes[1] = CLIP_INT_TO_UCHAR(( 298 * c - 100 * d - 208 * e + 128) >> 8);		// Green
+					destBytes[2] = CLIP_INT_TO_UCHAR(( 298 * c           + 409 * e + 128) >> 8);		// Red
 			
-			c = y1 - 16;
-			destBytes[3] = CLIP_INT_TO_UCHAR(( 298 * c + 516 * d           + 128) >> 8);		// Blue
-			destBytes[4] = CLIP_INT_TO_UCHAR(( 298 * c - 100 * d - 208 * e + 128) >> 8);		// Green
-			destBytes[5] = CLIP_INT_TO_UCHAR(( 298 * c           + 409 * e + 128) >> 8);		// Red
-			destBytes += 6;
-		}
-	}
+					c = y1 - 16;
+					destBytes[3] = CLIP_INT_TO_UCHAR(( 298 * c + 516 * d           + 128) >> 8);		// Blue
+					destBytes[4] = CLIP_INT_TO_UCHAR(( 298 * c - 100 * d - 208 * e + 128) >> 8);		// Green
+					destBytes[5] = CLIP_INT_TO_UCHAR(( 298 * c           + 409 * e + 128) >> 8);		// Red
+					destBytes += 6;
+				}
+			}
+		} );
 	return true;
 }
 
-bool ImageConverter::convertImage( const Image& sourceImage, Image& destinationImage )
+bool ImageConverter::convertImage( const Image& sourceImage, Image& destinationImage, unsigned int sequenceNumber )
 {
 	if ( sourceImage.getFormat()==destinationImage.getFormat() )
 		return false;
 
+	Tracer::Scope traceScope( "ImageConverter::convertImage", sequenceNumber );
 	ImageFormat::Encoding sourceEncoding = sourceImage.getFormat().getEncoding();
 	ImageFormat::Encoding destinationEncoding = destinationImage.getFormat().getEncoding();
 
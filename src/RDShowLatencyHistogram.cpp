@@ -0,0 +1,186 @@
+/*
+   The MIT License (MIT) (http://opensource.org/licenses/MIT)
+   
+   Copyright (c) 2015 Jacques Menuet
+   
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+   
+   The above copyright notice and this permission notice shall be included in all
+   copies or substantial portions of the Software.
+   
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+*/
+#include "RDShowLatencyHistogram.h"
+
+#include <assert.h>
+
+namespace RDShow
+{
+
+namespace
+{
+
+const long long MaxValueInNs = (1LL << LatencyHistogram::MaxValueLog2) - 1;
+
+// Index of the most significant bit set. The value must be positive
+unsigned int getHighestBitIndex( unsigned long long value )
+{
+	assert( value>0 );
+	unsigned int index = 0;
+	for ( unsigned int shift=32; shift>0; shift/=2 )
+	{
+		if ( value>>shift )
+		{
+			value >>= shift;
+			index += shift;
+		}
+	}
+	return index;
+}
+
+}
+
+LatencyHistogram::LatencyHistogram()
+	: mNumSamples(0),
+	  mSumInNs(0),
+	  mMinInNs(MaxValueInNs),
+	  mMaxInNs(0)
+{
+	for ( unsigned int i=0; i<NumBuckets; ++i )
+		mCounts[i] = 0;
+}
+
+unsigned int LatencyHistogram::getBucketIndex( long long durationInNs )
+{
+	if ( durationInNs<NumLinearBuckets )
+		return durationInNs>0 ? static_cast<unsigned int>(durationInNs) : 0;
+	if ( durationInNs>MaxValueInNs )
+		durationInNs = MaxValueInNs;
+
+	// The highest bit gives the power of two, the next ones the sub-bucket within it
+	unsigned int highestBitIndex = getHighestBitIndex( static_cast<unsigned long long>(durationInNs) );
+	unsigned int subBucketIndex = static_cast<unsigned int>( durationInNs >> (highestBitIndex - NumSubBucketsLog2) ) & (NumSubBuckets - 1);
+	return NumLinearBuckets + (highestBitIndex - 5) * NumSubBuckets + subBucketIndex;
+}
+
+long long LatencyHistogram::getBucketLowestValue( unsigned int bucketIndex )
+{
+	assert( bucketIndex<NumBuckets );
+	if ( bucketIndex<NumLinearBuckets )
+		return bucketIndex;
+	unsigned int highestBitIndex = (bucketIndex - NumLinearBuckets) / NumSubBuckets + 5;
+	unsigned int subBucketIndex = (bucketIndex - NumLinearBuckets) % NumSubBuckets;
+	return static_cast<long long>( NumSubBuckets + subBucketIndex ) << (highestBitIndex - NumSubBucketsLog2);
+}
+
+long long LatencyHistogram::getBucketWidth( unsigned int bucketIndex )
+{
+	assert( bucketIndex<NumBuckets );
+	if ( bucketIndex<NumLinearBuckets )
+		return 1;
+	unsigned int highestBitIndex = (bucketIndex - NumLinearBuckets) / NumSubBuckets + 5;
+	return 1LL << (highestBitIndex - NumSubBucketsLog2);
+}
+
+void LatencyHistogram::record( long long durationInNs )
+{
+	if ( durationInNs<0 )		// Clocks read on different cores can be slightly off
+		durationInNs = 0;
+	if ( durationInNs>MaxValueInNs )
+		durationInNs = MaxValueInNs;
+
+	mCounts[ getBucketIndex(durationInNs) ].fetch_add( 1, std::memory_order_relaxed );
+	mNumSamples.fetch_add( 1, std::memory_order_relaxed );
+	mSumInNs.fetch_add( durationInNs, std::memory_order_relaxed );
+
+	// The extremes rarely change: most of the time these are plain reads
+	long long minInNs = mMinInNs.load( std::memory_order_relaxed );
+	while ( durationInNs<minInNs && !mMinInNs.compare_exchange_weak( minInNs, durationInNs, std::memory_order_relaxed ) )
+		;
+	long long maxInNs = mMaxInNs.load( std::memory_order_relaxed );
+	while ( durationInNs>maxInNs && !mMaxInNs.compare_exchange_weak( maxInNs, durationInNs, std::memory_order_relaxed ) )
+		;
+}
+
+void LatencyHistogram::reset()
+{
+	for ( unsigned int i=0; i<NumBuckets; ++i )
+		mCounts[i].store( 0, std::memory_order_relaxed );
+	mNumSamples.store( 0, std::memory_order_relaxed );
+	mSumInNs.store( 0, std::memory_order_relaxed );
+	mMinInNs.store( MaxValueInNs, std::memory_order_relaxed );
+	mMaxInNs.store( 0, std::memory_order_relaxed );
+}
+
+LatencyHistogram::Snapshot LatencyHistogram::getSnapshot() const
+{
+	Snapshot snapshot;
+	for ( unsigned int i=0; i<NumBuckets; ++i )
+	{
+		snapshot.mCounts[i] = mCounts[i].load( std::memory_order_relaxed );
+		snapshot.mNumSamples += snapshot.mCounts[i];
+	}
+	snapshot.mSumInNs = mSumInNs.load( std::memory_order_relaxed );
+	snapshot.mMinInNs = mMinInNs.load( std::memory_order_relaxed );
+	snapshot.mMaxInNs = mMaxInNs.load( std::memory_order_relaxed );
+	return snapshot;
+}
+
+LatencyHistogram::Snapshot::Snapshot()
+	: mNumSamples(0),
+	  mSumInNs(0),
+	  mMinInNs(0),
+	  mMaxInNs(0)
+{
+	for ( unsigned int i=0; i<NumBuckets; ++i )
+		mCounts[i] = 0;
+}
+
+double LatencyHistogram::Snapshot::getMeanInNs() const
+{
+	if ( mNumSamples==0 )
+		return 0;
+	return static_cast<double>(mSumInNs) / static_cast<double>(mNumSamples);
+}
+
+long long LatencyHistogram::Snapshot::getPercentileInNs( double percentile ) const
+{
+	if ( mNumSamples==0 )
+		return 0;
+
+	// The rank of the sample we're looking for, starting from 1
+	double rank = percentile / 100.0 * static_cast<double>(mNumSamples);
+	unsigned long long targetCount = rank<1 ? 1 : static_cast<unsigned long long>(rank + 0.999999);
+	if ( targetCount>mNumSamples )
+		targetCount = mNumSamples;
+
+	unsigned long long count = 0;
+	for ( unsigned int i=0; i<NumBuckets; ++i )
+	{
+		count += mCounts[i];
+		if ( count>=targetCount )
+		{
+			// The middle of the bucket, without going past the actual extremes
+			long long value = getBucketLowestValue(i) + getBucketWidth(i) / 2;
+			if ( value>mMaxInNs )
+				value = mMaxInNs;
+			if ( value<mMinInNs )
+				value = mMinInNs;
+			return value;
+		}
+	}
+	return mMaxInNs;
+}
+
+}
@@ -0,0 +1,130 @@
+/*
+   The MIT License (MIT) (http://opensource.org/licenses/MIT)
+   
+   Copyright (c) 2015 Jacques Menuet
+   
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+   
+   The above copyright notice and this permission notice shall be included in all
+   copies or substantial portions of the Software.
+   
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+*/
+#include "RDShowLatestImageSlot.h"
+
+#include <assert.h>
+#include <algorithm>
+#include "RDShowCopyEngine.h"
+#include "RDShowClock.h"
+
+// The readers copy the image while the writer may be writing it, and throw the copy away when 
+// that happened. ThreadSanitizer can't know that, so the reads are hidden from it
+#if defined(__SANITIZE_THREAD__)
+	#define RDSHOW_THREAD_SANITIZER
+#elif defined(__has_feature)
+	#if __has_feature(thread_sanitizer)
+		#define RDSHOW_THREAD_SANITIZER
+	#endif
+#endif
+
+#ifdef RDSHOW_THREAD_SANITIZER
+extern "C" void AnnotateIgnoreReadsBegin( const char* file, int line );
+extern "C" void AnnotateIgnoreReadsEnd( const char* file, int line );
+#define RDSHOW_IGNORE_READS_BEGIN()		AnnotateIgnoreReadsBegin( __FILE__, __LINE__ )
+#define RDSHOW_IGNORE_READS_END()		AnnotateIgnoreReadsEnd( __FILE__, __LINE__ )
+#else
+#define RDSHOW_IGNORE_READS_BEGIN()
+#define RDSHOW_IGNORE_READS_END()
+#endif
+
+namespace RDShow
+{
+
+LatestImageSlot::LatestImageSlot( const ImageFormat& imageFormat )
+	: mImageFormat(imageFormat),
+	  mLatestSlotIndex(0),
+	  mSequenceNumber(0),
+	  mNumRetries(0)
+{
+	mSlots[0] = new Slot( imageFormat );
+	mSlots[1] = new Slot( imageFormat );
+}
+
+LatestImageSlot::~LatestImageSlot()
+{
+	delete mSlots[0];
+	delete mSlots[1];
+}
+
+void LatestImageSlot::write( const unsigned char* bytes, unsigned int numBytes, unsigned int sequenceNumber, long long timestampInNs, long long arrivalTimeInNs )
+{
+	// The readers are on the latest slot, or done with the other one unless they're late
+	unsigned int slotIndex = 1 - mLatestSlotIndex.load( std::memory_order_relaxed );
+	Slot& slot = *mSlots[slotIndex];
+	// Acquire as well, so the image can't be written before the version says so
+	unsigned int version = slot.version.load( std::memory_order_relaxed );
+	slot.version.exchange( version+1, std::memory_order_acq_rel );
+
+	MemoryBuffer& buffer = slot.image.getImage().getBuffer();
+	CopyEngine::copy( buffer.getWritableBytes(), bytes, std::min( numBytes, buffer.getSizeInBytes() ) );
+	slot.image.setSequenceNumber( sequenceNumber );
+	slot.image.setTimestampInNs( timestampInNs );
+	slot.image.setArrivalTimeInNs( arrivalTimeInNs );
+	slot.image.setPublishTimeInNs( Clock::getTimeInNs() );
+
+	slot.version.store( version+2, std::memory_order_release );
+	mLatestSlotIndex.store( slotIndex, std::memory_order_release );
+	mSequenceNumber.store( sequenceNumber, std::memory_order_release );
+}
+
+bool LatestImageSlot::read( CapturedImage& destination, unsigned int lastSequenceNumber ) const
+{
+	if ( destination.getImage().getFormat()!=mImageFormat || destination.getImage().getBuffer().isReadOnly() )
+		return false;
+
+	MemoryBuffer& destinationBuffer = destination.getImage().getBuffer();
+	for ( ;; )
+	{
+		if ( mSequenceNumber.load( std::memory_order_acquire )<=lastSequenceNumber )
+			return false;
+		
+		const Slot& slot = *mSlots[ mLatestSlotIndex.load( std::memory_order_acquire ) ];
+		unsigned int version = slot.version.load( std::memory_order_acquire );
+		if ( (version & 1)==0 )
+		{
+			RDSHOW_IGNORE_READS_BEGIN();
+			const MemoryBuffer& buffer = slot.image.getImage().getBuffer();
+			CopyEngine::copy( destinationBuffer.getWritableBytes(), buffer.getBytes(), buffer.getSizeInBytes() );
+			destination.setSequenceNumber( slot.image.getSequenceNumber() );
+			destination.setTimestampInNs( slot.image.getTimestampInNs() );
+			destination.setArrivalTimeInNs( slot.image.getArrivalTimeInNs() );
+			destination.setPublishTimeInNs( slot.image.getPublishTimeInNs() );
+			RDSHOW_IGNORE_READS_END();
+
+			// The copy must be complete before the version is checked again. ThreadSanitizer 
+			// doesn't support fences, a read-modify-write does the same for it
+#ifdef RDSHOW_THREAD_SANITIZER
+			if ( slot.version.fetch_add( 0, std::memory_order_acq_rel )==version )
+				return true;
+#else
+			std::atomic_thread_fence( std::memory_order_acquire );
+			if ( slot.version.load( std::memory_order_relaxed )==version )
+				return true;
+#endif
+		}
+		mNumRetries.fetch_add( 1, std::memory_order_relaxed );
+	}
+}
+
+}
@@ -0,0 +1,217 @@
+/*
+   The MIT License (MIT) (http://opensource.org/licenses/MIT)
+   
+   Copyright (c) 2015 Jacques Menuet
+   
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+   
+   The above copyright notice and this permission notice shall be included in all
+   copies or substantial portions of the Software.
+   
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+*/
+#include "RDShowLock.h"
+
+#include <assert.h>
+#include <algorithm>
+#include "RDShowClock.h"
+
+namespace RDShow
+{
+
+namespace
+{
+
+std::atomic<bool> gIsStatisticsEnabled( false );
+
+// All the existing Locks, for getAllStatistics()
+struct Registry
+{
+	std::mutex			mutex;
+	std::vector<Lock*>	locks;
+};
+
+// Locks can be namespace-scope statics in any translation unit, so the registry is created 
+// on first use rather than in an unspecified static initialization order. It's never 
+// destroyed, for the same reason at exit
+Registry& getRegistry()
+{
+	static Registry* registry = new Registry();
+	return *registry;
+}
+
+}
+
+Lock::Lock( const std::string& name )
+	: mMutex(),
+	  mName(name),
+	  mAcquireTimeInNs(0),
+	  mNumAcquisitions(0),
+	  mNumContentions(0),
+	  mTotalWaitTimeInNs(0),
+	  mMaxWaitTimeInNs(0),
+	  mTotalHoldTimeInNs(0),
+	  mMaxHoldTimeInNs(0)
+{
+	Registry& registry = getRegistry();
+	std::lock_guard<std::mutex> registryLock( registry.mutex );
+	registry.locks.push_back( this );
+}
+
+Lock::~Lock()
+{
+	Registry& registry = getRegistry();
+	std::lock_guard<std::mutex> registryLock( registry.mutex );
+	std::vector<Lock*>::iterator itr = std::find( registry.locks.begin(), registry.locks.end(), this );
+	assert( itr!=registry.locks.end() );
+	registry.locks.erase( itr );
+}
+
+void Lock::setName( const std::string& name )
+{
+	std::lock_guard<std::mutex> registryLock( getRegistry().mutex );
+	mName = name;
+}
+
+std::string Lock::getName() const
+{
+	std::lock_guard<std::mutex> registryLock( getRegistry().mutex );
+	return mName;
+}
+
+void Lock::lock()
+{
+	if ( !isStatisticsEnabled() )
+	{
+		mMutex.lock();
+		mAcquireTimeInNs = 0;
+		return;
+	}
+
+	// Only read the clock twice when the lock is already taken
+	if ( mMutex.try_lock() )
+	{
+		onAcquired( false, 0 );
+		return;
+	}
+	long long startTimeInNs = Clock::getTimeInNs();
+	mMutex.lock();
+	onAcquired( true, Clock::getTimeInNs() - startTimeInNs );
+}
+
+bool Lock::try_lock()
+{
+	if ( !mMutex.try_lock() )
+		return false;
+	if ( isStatisticsEnabled() )
+		onAcquired( false, 0 );
+	else
+		mAcquireTimeInNs = 0;
+	return true;
+}
+
+void Lock::unlock()
+{
+	if ( mAcquireTimeInNs!=0 )
+	{
+		long long holdTimeInNs = Clock::getTimeInNs() - mAcquireTimeInNs;
+		add( mTotalHoldTimeInNs, holdTimeInNs );
+		max( mMaxHoldTimeInNs, holdTimeInNs );
+	}
+	mMutex.unlock();
+}
+
+void Lock::onAcquired( bool contended, long long waitTimeInNs )
+{
+	add( mNumAcquisitions, 1 );
+	if ( contended )
+	{
+		add( mNumContentions, 1 );
+		add( mTotalWaitTimeInNs, waitTimeInNs );
+		max( mMaxWaitTimeInNs, waitTimeInNs );
+	}
+	mAcquireTimeInNs = Clock::getTimeInNs();
+}
+
+Lock::Statistics Lock::getStatistics() const
+{
+	Statistics statistics = getCounters();
+	statistics.name = getName();
+	return statistics;
+}
+
+Lock::Statistics Lock::getCounters() const
+{
+	Statistics statistics;
+	statistics.numAcquisitions = mNumAcquisitions.load( std::memory_order_relaxed );
+	statistics.numContentions = mNumContentions.load( std::memory_order_relaxed );
+	statistics.totalWaitTimeInNs = mTotalWaitTimeInNs.load( std::memory_order_relaxed );
+	statistics.maxWaitTimeInNs = mMaxWaitTimeInNs.load( std::memory_order_relaxed );
+	statistics.totalHoldTimeInNs = mTotalHoldTimeInNs.load( std::memory_order_relaxed );
+	statistics.maxHoldTimeInNs = mMaxHoldTimeInNs.load( std::memory_order_relaxed );
+	return statistics;
+}
+
+void Lock::resetStatistics()
+{
+	mNumAcquisitions = 0;
+	mNumContentions = 0;
+	mTotalWaitTimeInNs = 0;
+	mMaxWaitTimeInNs = 0;
+	mTotalHoldTimeInNs = 0;
+	mMaxHoldTimeInNs = 0;
+}
+
+void Lock::setStatisticsEnabled( bool enabled )
+{
+	gIsStatisticsEnabled.store( enabled );
+}
+
+bool Lock::isStatisticsEnabled()
+{
+	return gIsStatisticsEnabled.load( std::memory_order_relaxed );
+}
+
+void Lock::getAllStatistics( std::vector<Statistics>& statistics )
+{
+	statistics.clear();
+	Registry& registry = getRegistry();
+	std::lock_guard<std::mutex> registryLock( registry.mutex );
+	for ( std::size_t i=0; i<registry.locks.size(); ++i )
+	{
+		statistics.push_back( registry.locks[i]->getCounters() );
+		statistics.back().name = registry.locks[i]->mName;
+	}
+}
+
+void Lock::resetAllStatistics()
+{
+	Registry& registry = getRegistry();
+	std::lock_guard<std::mutex> registryLock( registry.mutex );
+	for ( std::size_t i=0; i<registry.locks.size(); ++i )
+		registry.locks[i]->resetStatistics();
+}
+
+Lock::Statistics::Statistics()
+	: name(),
+	  numAcquisitions(0),
+	  numContentions(0),
+	  totalWaitTimeInNs(0),
+	  maxWaitTimeInNs(0),
+	  totalHoldTimeInNs(0),
+	  maxHoldTimeInNs(0)
+{
+}
+
+}
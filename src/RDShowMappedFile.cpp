@@ -0,0 +1,263 @@
+/*
+   The MIT License (MIT) (http://opensource.org/licenses/MIT)
+   
+   Copyright (c) 2015 Jacques Menuet
+   
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+   
+   The above copyright notice and this permission notice shall be included in all
+   copies or substantial portions of the Software.
+   
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+*/
+#include "RDShowMappedFile.h"
+
+#include <assert.h>
+
+#ifdef _WIN32
+	#define WIN32_LEAN_AND_MEAN 
+	#define NOMINMAX 
+	#include <windows.h>
+	#include "RDShowUnicode.h"
+#else
+	#include <sys/types.h>
+	#include <sys/stat.h>
+	#include <sys/mman.h>
+	#include <fcntl.h>
+	#include <unistd.h>
+#endif
+
+namespace RDShow
+{
+
+MappedFile::MappedFile( const std::string& filename, unsigned long long offset, unsigned int sizeInBytes, Mode mode )
+	: mFilename(filename),
+	  mOffset(offset),
+	  mSizeInBytes(sizeInBytes),
+	  mMode(mode),
+#ifdef _WIN32
+	  mFileHandle(INVALID_HANDLE_VALUE),
+	  mMappingHandle(NULL),
+#else
+	  mFileDescriptor(-1),
+#endif
+	  mMappingStart(NULL),
+	  mMappingSizeInBytes(0),
+	  mBytes(NULL)
+{
+	if ( !map() )
+		unmap();
+}
+
+MappedFile::~MappedFile()
+{
+	unmap();
+}
+
+#ifdef _WIN32
+
+bool MappedFile::map()
+{
+	if ( mSizeInBytes==0 )
+		return false;
+
+	// Open (or create) the file
+	std::wstring filename = Unicode::UTF8toUTF16String( mFilename );
+	DWORD access = mMode==ReadWrite ? (GENERIC_READ|GENERIC_WRITE) : GENERIC_READ;
+	DWORD creation = mMode==ReadWrite ? OPEN_ALWAYS : OPEN_EXISTING;
+	HANDLE fileHandle = CreateFileW( filename.c_str(), access, FILE_SHARE_READ|FILE_SHARE_WRITE, NULL, creation, FILE_ATTRIBUTE_NORMAL, NULL );
+	if ( fileHandle==INVALID_HANDLE_VALUE )
+		return false;
+	mFileHandle = fileHandle;
+
+	// The view offset must be a multiple of the allocation granularity (usually 64KB)
+	SYSTEM_INFO systemInfo;
+	GetSystemInfo( &systemInfo );
+	unsigned long long granularity = systemInfo.dwAllocationGranularity;
+	unsigned long long alignedOffset = (mOffset / granularity) * granularity;
+	unsigned long long endOffset = mOffset + mSizeInBytes;
+	mMappingSizeInBytes = static_cast<std::size_t>( endOffset - alignedOffset );
+
+	// Create the mapping object. In ReadWrite mode, asking for a maximum size 
+	// larger than the file grows the file accordingly 
+	LARGE_INTEGER fileSize;
+	if ( !GetFileSizeEx( fileHandle, &fileSize ) )
+		return false;
+	if ( mMode==ReadOnly && static_cast<unsigned long long>(fileSize.QuadPart)<endOffset )
+		return false;
+	DWORD protection = mMode==ReadWrite ? PAGE_READWRITE : PAGE_READONLY;
+	HANDLE mappingHandle = CreateFileMappingW( fileHandle, NULL, protection, static_cast<DWORD>(endOffset>>32), static_cast<DWORD>(endOffset & 0xFFFFFFFF), NULL );
+	if ( !mappingHandle )
+		return false;
+	mMappingHandle = mappingHandle;
+
+	// Map the view 
+	DWORD viewAccess = mMode==ReadWrite ? FILE_MAP_WRITE : FILE_MAP_READ;
+	void* view = MapViewOfFile( mappingHandle, viewAccess, static_cast<DWORD>(alignedOffset>>32), static_cast<DWORD>(alignedOffset & 0xFFFFFFFF), mMappingSizeInBytes );
+	if ( !view )
+		return false;
+	mMappingStart = static_cast<unsigned char*>(view);
+	mBytes = mMappingStart + (mOffset - alignedOffset);
+	return true;
+}
+
+void MappedFile::unmap()
+{
+	if ( mMappingStart )
+		UnmapViewOfFile( mMappingStart );
+	mMappingStart = NULL;
+	mMappingSizeInBytes = 0;
+	mBytes = NULL;
+
+	if ( mMappingHandle )
+		CloseHandle( mMappingHandle );
+	mMappingHandle = NULL;
+
+	if ( mFileHandle!=INVALID_HANDLE_VALUE )
+		CloseHandle( mFileHandle );
+	mFileHandle = INVALID_HANDLE_VALUE;
+}
+
+bool MappedFile::advise( Advice advice )
+{
+	if ( !isValid() )
+		return false;
+
+	switch ( advice )
+	{
+		case Normal:
+			return true;
+
+		case Sequential:
+		case WillNeed:
+		{
+			// PrefetchVirtualMemory only exists from Windows 8 onward, so we look it up at runtime
+			// http://msdn.microsoft.com/en-us/library/windows/desktop/hh780543(v=vs.85).aspx
+			struct MemoryRangeEntry { PVOID address; SIZE_T numBytes; };
+			typedef BOOL (WINAPI *PrefetchVirtualMemoryFunction)( HANDLE, ULONG_PTR, MemoryRangeEntry*, ULONG );
+			PrefetchVirtualMemoryFunction prefetchVirtualMemory = reinterpret_cast<PrefetchVirtualMemoryFunction>( GetProcAddress( GetModuleHandleW(L"kernel32.dll"), "PrefetchVirtualMemory" ) );
+			if ( !prefetchVirtualMemory )
+				return false;
+			MemoryRangeEntry range = { mMappingStart, mMappingSizeInBytes };
+			return prefetchVirtualMemory( GetCurrentProcess(), 1, &range, 0 )!=FALSE;
+		}
+
+		case DontNeed:
+			// Unlocking pages that aren't locked removes them from the working set. The call 
+			// "fails" with ERROR_NOT_LOCKED but the pages are trimmed anyway
+			// http://msdn.microsoft.com/en-us/library/windows/desktop/aa366910(v=vs.85).aspx
+			VirtualUnlock( mMappingStart, mMappingSizeInBytes );
+			return true;
+	}
+	return false;
+}
+
+bool MappedFile::flush()
+{
+	if ( !isValid() )
+		return false;
+	if ( mMode==ReadOnly )
+		return true;
+	if ( !FlushViewOfFile( mMappingStart, mMappingSizeInBytes ) )
+		return false;
+	return FlushFileBuffers( mFileHandle )!=FALSE;
+}
+
+#else
+
+bool MappedFile::map()
+{
+	if ( mSizeInBytes==0 )
+		return false;
+
+	// Open (or create) the file
+	int flags = mMode==ReadWrite ? (O_RDWR|O_CREAT) : O_RDONLY;
+	mFileDescriptor = open( mFilename.c_str(), flags, 0644 );
+	if ( mFileDescriptor<0 )
+		return false;
+
+	// Make sure the file is large enough to contain the region
+	unsigned long long endOffset = mOffset + mSizeInBytes;
+	struct stat fileStatus;
+	if ( fstat( mFileDescriptor, &fileStatus )!=0 )
+		return false;
+	if ( static_cast<unsigned long long>(fileStatus.st_size)<endOffset )
+	{
+		if ( mMode==ReadOnly )
+			return false;
+		if ( ftruncate( mFileDescriptor, static_cast<off_t>(endOffset) )!=0 )
+			return false;
+	}
+
+	// The mapping offset must be a multiple of the page size
+	unsigned long long pageSize = static_cast<unsigned long long>( sysconf(_SC_PAGESIZE) );
+	unsigned long long alignedOffset = (mOffset / pageSize) * pageSize;
+	mMappingSizeInBytes = static_cast<std::size_t>( endOffset - alignedOffset );
+
+	int protection = mMode==ReadWrite ? (PROT_READ|PROT_WRITE) : PROT_READ;
+	void* view = mmap( NULL, mMappingSizeInBytes, protection, MAP_SHARED, mFileDescriptor, static_cast<off_t>(alignedOffset) );
+	if ( view==MAP_FAILED )
+		return false;
+	mMappingStart = static_cast<unsigned char*>(view);
+	mBytes = mMappingStart + (mOffset - alignedOffset);
+	return true;
+}
+
+void MappedFile::unmap()
+{
+	if ( mMappingStart )
+		munmap( mMappingStart, mMappingSizeInBytes );
+	mMappingStart = NULL;
+	mMappingSizeInBytes = 0;
+	mBytes = NULL;
+
+	if ( mFileDescriptor>=0 )
+		close( mFileDescriptor );
+	mFileDescriptor = -1;
+}
+
+bool MappedFile::advise( Advice advice )
+{
+	if ( !isValid() )
+		return false;
+
+	// glibc ignores POSIX_MADV_DONTNEED as its semantics differ from madvise()'s. With a 
+	// shared file mapping, MADV_DONTNEED drops the pages from the process without losing 
+	// anything: the modified ones stay in the page cache, to be written back to the file
+	if ( advice==DontNeed )
+		return madvise( mMappingStart, mMappingSizeInBytes, MADV_DONTNEED )==0;
+
+	int posixAdvice = POSIX_MADV_NORMAL;
+	switch ( advice )
+	{
+		case Normal:		posixAdvice = POSIX_MADV_NORMAL; break;
+		case Sequential:	posixAdvice = POSIX_MADV_SEQUENTIAL; break;
+		case WillNeed:		posixAdvice = POSIX_MADV_WILLNEED; break;
+		case DontNeed:		break;
+	}
+	return posix_madvise( mMappingStart, mMappingSizeInBytes, posixAdvice )==0;
+}
+
+bool MappedFile::flush()
+{
+	if ( !isValid() )
+		return false;
+	if ( mMode==ReadOnly )
+		return true;
+	return msync( mMappingStart, mMappingSizeInBytes, MS_SYNC )==0;
+}
+
+#endif
+
+}
@@ -0,0 +1,178 @@
+/*
+   The MIT License (MIT) (http://opensource.org/licenses/MIT)
+   
+   Copyright (c) 2015 Jacques Menuet
+   
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+   
+   The above copyright notice and this permission notice shall be included in all
+   copies or substantial portions of the Software.
+   
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+*/
+#include "RDShowMemoryAccounting.h"
+
+#include <assert.h>
+#include <chrono>
+#include <sstream>
+
+namespace RDShow
+{
+
+const char* MemoryAccounting::mTagNames[TagCount] = 
+{
+	"Untagged",
+	"Capture",
+	"Converter",
+	"Viewer",
+	"Pool",
+	"Scratch"
+};
+
+MemoryAccounting::AtomicCounters MemoryAccounting::mCounters;
+MemoryAccounting::AtomicCounters MemoryAccounting::mTagCounters[TagCount];
+std::atomic<unsigned long long> MemoryAccounting::mBudgetInBytes( 0 );
+
+const char* MemoryAccounting::getTagName( Tag tag )
+{
+	if ( tag>=TagCount )
+		return "Unknown";
+	return mTagNames[tag];
+}
+
+/*
+	MemoryAccounting::Counters
+*/
+MemoryAccounting::Counters::Counters()
+	: liveSizeInBytes(0),
+	  peakSizeInBytes(0),
+	  numAllocations(0),
+	  numDeallocations(0)
+{
+}
+
+/*
+	MemoryAccounting::Snapshot
+*/
+MemoryAccounting::Snapshot::Snapshot()
+	: mTimeInSec(0),
+	  mCounters(),
+	  mBudgetInBytes(0)
+{
+}
+
+bool MemoryAccounting::Snapshot::isOverBudget() const
+{
+	return mBudgetInBytes!=0 && mCounters.liveSizeInBytes>mBudgetInBytes;
+}
+
+double MemoryAccounting::Snapshot::getAllocationRate( const Snapshot& previous ) const
+{
+	double duration = mTimeInSec - previous.mTimeInSec;
+	if ( duration<=0 )
+		return 0;
+	return static_cast<double>( mCounters.numAllocations - previous.mCounters.numAllocations ) / duration;
+}
+
+std::string MemoryAccounting::Snapshot::toString() const
+{
+	std::stringstream stream;
+	stream << "live:" << mCounters.liveSizeInBytes << " peak:" << mCounters.peakSizeInBytes 
+		   << " allocations:" << mCounters.numAllocations << " deallocations:" << mCounters.numDeallocations;
+	if ( mBudgetInBytes!=0 )
+		stream << " budget:" << mBudgetInBytes << (isOverBudget() ? " (exceeded)" : "");
+	for ( int i=0; i<TagCount; ++i )
+	{
+		const Counters& counters = mTagCounters[i];
+		if ( counters.numAllocations==0 )
+			continue;
+		stream << "\n  " << getTagName( static_cast<Tag>(i) ) << " live:" << counters.liveSizeInBytes << " peak:" << counters.peakSizeInBytes 
+			   << " allocations:" << counters.numAllocations;
+	}
+	return stream.str();
+}
+
+/*
+	MemoryAccounting
+*/
+void MemoryAccounting::add( AtomicCounters& counters, unsigned long long sizeInBytes )
+{
+	unsigned long long liveSize = counters.liveSizeInBytes.fetch_add( sizeInBytes, std::memory_order_relaxed ) + sizeInBytes;
+	counters.numAllocations.fetch_add( 1, std::memory_order_relaxed );
+
+	// Raise the peak if needed. Another thread might raise it concurrently, hence the loop
+	unsigned long long peakSize = counters.peakSizeInBytes.load( std::memory_order_relaxed );
+	while ( liveSize>peakSize && !counters.peakSizeInBytes.compare_exchange_weak( peakSize, liveSize, std::memory_order_relaxed ) )
+	{
+	}
+}
+
+void MemoryAccounting::remove( AtomicCounters& counters, unsigned long long sizeInBytes )
+{
+	counters.liveSizeInBytes.fetch_sub( sizeInBytes, std::memory_order_relaxed );
+	counters.numDeallocations.fetch_add( 1, std::memory_order_relaxed );
+}
+
+void MemoryAccounting::read( const AtomicCounters& counters, Counters& values )
+{
+	values.liveSizeInBytes = counters.liveSizeInBytes.load( std::memory_order_relaxed );
+	values.peakSizeInBytes = counters.peakSizeInBytes.load( std::memory_order_relaxed );
+	values.numAllocations = counters.numAllocations.load( std::memory_order_relaxed );
+	values.numDeallocations = counters.numDeallocations.load( std::memory_order_relaxed );
+}
+
+void MemoryAccounting::onAllocation( Tag tag, unsigned long long sizeInBytes )
+{
+	assert( tag<TagCount );
+	add( mCounters, sizeInBytes );
+	add( mTagCounters[tag], sizeInBytes );
+}
+
+void MemoryAccounting::onDeallocation( Tag tag, unsigned long long sizeInBytes )
+{
+	assert( tag<TagCount );
+	remove( mCounters, sizeInBytes );
+	remove( mTagCounters[tag], sizeInBytes );
+}
+
+// Note: the counters are read one by one, so the snapshot isn't an atomic picture 
+// of all the counters when allocations happen concurrently. Each value is exact though
+void MemoryAccounting::getSnapshot( Snapshot& snapshot )
+{
+	snapshot.mTimeInSec = std::chrono::duration<double>( std::chrono::steady_clock::now().time_since_epoch() ).count();
+	read( mCounters, snapshot.mCounters );
+	for ( int i=0; i<TagCount; ++i )
+		read( mTagCounters[i], snapshot.mTagCounters[i] );
+	snapshot.mBudgetInBytes = mBudgetInBytes.load( std::memory_order_relaxed );
+}
+
+// Bring the peaks back to the current live sizes, for example after reconfiguring devices
+void MemoryAccounting::resetPeaks()
+{
+	mCounters.peakSizeInBytes.store( mCounters.liveSizeInBytes.load( std::memory_order_relaxed ), std::memory_order_relaxed );
+	for ( int i=0; i<TagCount; ++i )
+		mTagCounters[i].peakSizeInBytes.store( mTagCounters[i].liveSizeInBytes.load( std::memory_order_relaxed ), std::memory_order_relaxed );
+}
+
+void MemoryAccounting::setBudgetInBytes( unsigned long long budgetInBytes )
+{
+	mBudgetInBytes.store( budgetInBytes, std::memory_order_relaxed );
+}
+
+unsigned long long MemoryAccounting::getBudgetInBytes()
+{
+	return mBudgetInBytes.load( std::memory_order_relaxed );
+}
+
+}
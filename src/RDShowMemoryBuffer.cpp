@@ -22,6 +22,8 @@
    SOFTWARE.
 */
 #include "RDShowMemoryBuffer.h"
+#include "RDShowScratchArena.h"
+#include "RDShowCopyEngine.h"
 
 #include <stddef.h>		// For NULL
 #include <memory.h>
@@ -31,44 +33,133 @@ namespace RDShow
 
 MemoryBuffer::MemoryBuffer()
 	: mBytes(NULL),
-	  mSizeInBytes(0)
+	  mSizeInBytes(0),
+	  mStorage(EmptyStorage),
+	  mTag(MemoryAccounting::Untagged),
+	  mMappedFile(NULL),
+	  mIsReadOnly(false)
 {
 }
 
-MemoryBuffer::MemoryBuffer( unsigned int sizeInBytes )
+MemoryBuffer::MemoryBuffer( unsigned int sizeInBytes, MemoryAccounting::Tag tag )
 	: mBytes(NULL),
-	  mSizeInBytes(sizeInBytes)
+	  mSizeInBytes(sizeInBytes),
+	  mStorage(HeapStorage),
+	  mTag(tag),
+	  mMappedFile(NULL),
+	  mIsReadOnly(false)
 {
 	mBytes = new unsigned char[mSizeInBytes];
+	MemoryAccounting::onAllocation( mTag, mSizeInBytes );
 	fill(0);
 }
 
+// Construct a buffer whose bytes are a region of a file mapped in memory. 
+// The buffer is left empty if the mapping fails
+MemoryBuffer::MemoryBuffer( const std::string& filename, unsigned long long offset, unsigned int sizeInBytes, MappedFile::Mode mode )
+	: mBytes(NULL),
+	  mSizeInBytes(0),
+	  mStorage(EmptyStorage),
+	  mTag(MemoryAccounting::Untagged),
+	  mMappedFile(NULL),
+	  mIsReadOnly(false)
+{
+	MappedFile* mappedFile = new MappedFile( filename, offset, sizeInBytes, mode );
+	if ( !mappedFile->isValid() )
+	{
+		delete mappedFile;
+		return;
+	}
+	mStorage = MappedFileStorage;
+	mMappedFile = mappedFile;
+	mBytes = const_cast<unsigned char*>( static_cast<const MappedFile*>(mMappedFile)->getBytes() );		// Only handed out as const when read-only
+	mSizeInBytes = mMappedFile->getSizeInBytes();
+	mIsReadOnly = mode==MappedFile::ReadOnly;
+}
+
+// Construct a buffer whose bytes are taken from a ScratchArena. The bytes are not zero-filled
+// and they are not freed by the buffer: they become invalid when the arena is reset
+MemoryBuffer::MemoryBuffer( ScratchArena& arena, unsigned int sizeInBytes )
+	: mBytes(NULL),
+	  mSizeInBytes(sizeInBytes),
+	  mStorage(ScratchArenaStorage),
+	  mTag(MemoryAccounting::Untagged),
+	  mMappedFile(NULL),
+	  mIsReadOnly(false)
+{
+	mBytes = arena.allocate( mSizeInBytes );
+}
+
+// Construct a buffer that borrows bytes owned by someone else. They're neither copied nor freed.
+// The bytes are typically a driver buffer: the buffer is read-only
+MemoryBuffer::MemoryBuffer( const unsigned char* externalBytes, unsigned int sizeInBytes )
+	: mBytes( const_cast<unsigned char*>(externalBytes) ),		// Only handed out as const
+	  mSizeInBytes(sizeInBytes),
+	  mStorage(ExternalStorage),
+	  mTag(MemoryAccounting::Untagged),
+	  mMappedFile(NULL),
+	  mIsReadOnly(true)
+{
+}
+
 MemoryBuffer::MemoryBuffer( const MemoryBuffer& other )
 	: mBytes(NULL),
-	  mSizeInBytes( other.getSizeInBytes() )
+	  mSizeInBytes( other.getSizeInBytes() ),
+	  mStorage(HeapStorage),
+	  mTag( other.getTag() ),
+	  mMappedFile(NULL),
+	  mIsReadOnly(false)
 {
 	mBytes = new unsigned char[mSizeInBytes];
-	memcpy( mBytes, other.getBytes(), other.getSizeInBytes() );
+	MemoryAccounting::onAllocation( mTag, mSizeInBytes );
+	CopyEngine::copy( mBytes, other.getBytes(), other.getSizeInBytes() );
 }
 
 MemoryBuffer::~MemoryBuffer()
 {
-	delete[] mBytes;
+	if ( mStorage==MappedFileStorage )
+		delete mMappedFile;
+	else if ( mStorage==HeapStorage )
+	{
+		delete[] mBytes;
+		MemoryAccounting::onDeallocation( mTag, mSizeInBytes );
+	}
+	mMappedFile = NULL;
 	mBytes = NULL;
 	mSizeInBytes = 0;
 }
 
-void MemoryBuffer::fill( char value )
+bool MemoryBuffer::fill( char value )
 {
+	if ( mIsReadOnly )
+		return false;
 	memset( mBytes, value, getSizeInBytes() );
+	return true;
 }
 
 bool MemoryBuffer::copyFrom( const MemoryBuffer& other )
 {
-	if ( other.getSizeInBytes()!=getSizeInBytes() )
+	if ( mIsReadOnly || other.getSizeInBytes()!=getSizeInBytes() )
 		return false;
-	memcpy( mBytes, other.getBytes(), getSizeInBytes() );
+	CopyEngine::copy( mBytes, other.getBytes(), getSizeInBytes() );
 	return true;
 }
 
+// Give the OS a hint about how the bytes are going to be accessed.
+// Only meaningful for a mapped buffer, returns false otherwise
+bool MemoryBuffer::advise( MappedFile::Advice advice )
+{
+	if ( !mMappedFile )
+		return false;
+	return mMappedFile->advise( advice );
+}
+
+// Write the modified bytes back to the file. Nothing to do for a heap buffer
+bool MemoryBuffer::flush()
+{
+	if ( !mMappedFile )
+		return true;
+	return mMappedFile->flush();
+}
+
 }
\ No newline at end of file
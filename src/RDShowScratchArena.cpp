@@ -0,0 +1,138 @@
+/*
+   The MIT License (MIT) (http://opensource.org/licenses/MIT)
+   
+   Copyright (c) 2015 Jacques Menuet
+   
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+   
+   The above copyright notice and this permission notice shall be included in all
+   copies or substantial portions of the Software.
+   
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+*/
+#include "RDShowScratchArena.h"
+#include "RDShowMemoryAccounting.h"
+
+#include <stddef.h>		// For NULL
+#include <assert.h>
+
+namespace RDShow
+{
+
+ScratchArena::ScratchArena()
+	: mBlock(NULL),
+	  mBlockStart(NULL),
+	  mCapacityInBytes(0),
+	  mUsedInBlockInBytes(0),
+	  mUsedSizeInBytes(0),
+	  mPeakUsedSizeInBytes(0),
+	  mOverflowBlocks()
+{
+}
+
+ScratchArena::ScratchArena( unsigned int capacityInBytes )
+	: mBlock(NULL),
+	  mBlockStart(NULL),
+	  mCapacityInBytes(0),
+	  mUsedInBlockInBytes(0),
+	  mUsedSizeInBytes(0),
+	  mPeakUsedSizeInBytes(0),
+	  mOverflowBlocks()
+{
+	allocateBlock( capacityInBytes );
+}
+
+ScratchArena::~ScratchArena()
+{
+	freeOverflowBlocks();
+	allocateBlock( 0 );
+	mBlockStart = NULL;
+	mCapacityInBytes = 0;
+}
+
+unsigned char* ScratchArena::alignPointer( unsigned char* pointer )
+{
+	std::size_t address = reinterpret_cast<std::size_t>(pointer);
+	address = (address + Alignment - 1) & ~static_cast<std::size_t>(Alignment - 1);
+	return reinterpret_cast<unsigned char*>(address);
+}
+
+void ScratchArena::allocateBlock( unsigned int capacityInBytes )
+{
+	if ( mBlock )
+		MemoryAccounting::onDeallocation( MemoryAccounting::Scratch, mCapacityInBytes + Alignment );
+	delete[] mBlock;
+	mBlock = NULL;
+	mBlockStart = NULL;
+	mCapacityInBytes = 0;
+	if ( capacityInBytes==0 )
+		return;
+
+	mCapacityInBytes = alignSize( capacityInBytes );
+	mBlock = new unsigned char[mCapacityInBytes + Alignment];
+	MemoryAccounting::onAllocation( MemoryAccounting::Scratch, mCapacityInBytes + Alignment );
+	mBlockStart = alignPointer( mBlock );
+}
+
+void ScratchArena::freeOverflowBlocks()
+{
+	for ( std::size_t i=0; i<mOverflowBlocks.size(); ++i )
+	{
+		MemoryAccounting::onDeallocation( MemoryAccounting::Scratch, mOverflowBlocks[i].second );
+		delete[] mOverflowBlocks[i].first;
+	}
+	mOverflowBlocks.clear();
+}
+
+// Return a block of sizeInBytes bytes, aligned on a cache line. The bytes are not initialized.
+// The memory remains valid until the next reset()
+unsigned char* ScratchArena::allocate( unsigned int sizeInBytes )
+{
+	unsigned int alignedSize = alignSize( sizeInBytes );
+	mUsedSizeInBytes += alignedSize;
+	if ( mUsedSizeInBytes>mPeakUsedSizeInBytes )
+		mPeakUsedSizeInBytes = mUsedSizeInBytes;
+
+	// Common case: bump the pointer in the main block
+	if ( mUsedInBlockInBytes + alignedSize<=mCapacityInBytes )
+	{
+		unsigned char* bytes = mBlockStart + mUsedInBlockInBytes;
+		mUsedInBlockInBytes += alignedSize;
+		return bytes;
+	}
+
+	// Doesn't fit (typically during the first frame): serve it from a separate block.
+	// The main block will be resized to accommodate the peak usage at the next reset
+	unsigned char* overflowBlock = new unsigned char[alignedSize + Alignment];
+	MemoryAccounting::onAllocation( MemoryAccounting::Scratch, alignedSize + Alignment );
+	mOverflowBlocks.push_back( std::make_pair( overflowBlock, alignedSize + Alignment ) );
+	return alignPointer( overflowBlock );
+}
+
+// Make the whole capacity available again. Everything previously allocated becomes invalid
+void ScratchArena::reset()
+{
+	if ( !mOverflowBlocks.empty() )
+	{
+		freeOverflowBlocks();
+
+		// Grow the main block so the peak usage fits in it from now on
+		if ( mPeakUsedSizeInBytes>mCapacityInBytes )
+			allocateBlock( mPeakUsedSizeInBytes );
+	}
+	mUsedInBlockInBytes = 0;
+	mUsedSizeInBytes = 0;
+}
+
+}
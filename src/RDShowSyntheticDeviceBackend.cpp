@@ -0,0 +1,97 @@
+/*
+   The MIT License (MIT) (http://opensource.org/licenses/MIT)
+   
+   Copyright (c) 2015 Jacques Menuet
+   
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+   
+   The above copyright notice and this permission notice shall be included in all
+   copies or substantial portions of the Software.
+   
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+*/
+#include "RDShowSyntheticDeviceBackend.h"
+
+namespace RDShow
+{
+
+SyntheticDeviceBackend::SyntheticDeviceBackend()
+	: mDevices(),
+	  mDeviceListChanged(false)
+{
+}
+
+SyntheticDeviceBackend::~SyntheticDeviceBackend()
+{
+}
+
+std::string SyntheticDeviceBackend::addDevice( const std::string& name, const CaptureSettingsList& captureSettingsList, SyntheticDeviceInternals::Pattern pattern )
+{
+	std::string path = "synthetic://" + name;
+	for ( std::size_t i=0; i<mDevices.size(); ++i )
+	{
+		if ( mDevices[i].info.path==path )
+			return std::string();
+	}
+
+	SyntheticDevice device;
+	device.info.name = name;
+	device.info.path = path;
+	device.captureSettingsList = captureSettingsList;
+	device.pattern = pattern;
+	mDevices.push_back( device );
+	mDeviceListChanged = true;
+	return path;
+}
+
+bool SyntheticDeviceBackend::removeDevice( const std::string& path )
+{
+	for ( SyntheticDevices::iterator itr=mDevices.begin(); itr!=mDevices.end(); ++itr )
+	{
+		if ( itr->info.path==path )
+		{
+			mDevices.erase( itr );
+			mDeviceListChanged = true;
+			return true;
+		}
+	}
+	return false;
+}
+
+bool SyntheticDeviceBackend::enumerateDevices( DeviceInfos& deviceInfos )
+{
+	deviceInfos.clear();
+	for ( std::size_t i=0; i<mDevices.size(); ++i )
+		deviceInfos.push_back( mDevices[i].info );
+	return true;
+}
+
+DeviceInternals* SyntheticDeviceBackend::createDeviceInternals( const std::string& path )
+{
+	for ( std::size_t i=0; i<mDevices.size(); ++i )
+	{
+		if ( mDevices[i].info.path==path )
+			return new SyntheticDeviceInternals( mDevices[i].captureSettingsList, mDevices[i].pattern );
+	}
+	return NULL;
+}
+
+bool SyntheticDeviceBackend::hasDeviceListChanged()
+{
+	bool changed = mDeviceListChanged;
+	mDeviceListChanged = false;
+	return changed;
+}
+
+}
@@ -0,0 +1,266 @@
+/*
+   The MIT License (MIT) (http://opensource.org/licenses/MIT)
+   
+   Copyright (c) 2015 Jacques Menuet
+   
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+   
+   The above copyright notice and this permission notice shall be included in all
+   copies or substantial portions of the Software.
+   
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+*/
+#include "RDShowSyntheticDeviceInternals.h"
+
+#include <assert.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include "RDShowTracer.h"
+
+namespace RDShow
+{
+
+SyntheticDeviceInternals::SyntheticDeviceInternals( const CaptureSettingsList& captureSettingsList, Pattern pattern )
+	: DeviceInternals(),
+	  mPattern(pattern),
+	  mFrame(NULL),
+	  mRGBRow(),
+	  mThread(),
+	  mStopMutex(),
+	  mStopCondition(),
+	  mStopRequested(false)
+{
+	mSupportedCaptureSettingsList = captureSettingsList;
+}
+
+SyntheticDeviceInternals::~SyntheticDeviceInternals()
+{
+	stopCapture();
+}
+
+bool SyntheticDeviceInternals::startBackendCapture( std::size_t captureSettingsIndex )
+{
+	const CaptureSettings& captureSettings = mSupportedCaptureSettingsList[captureSettingsIndex];
+	if ( captureSettings.getFrameRate()<=0.f )
+		return false;
+
+	// Everything the capture thread needs is allocated here, not on the capture thread
+	const ImageFormat& imageFormat = captureSettings.getImageFormat();
+	assert( !mFrame );
+	mFrame = new Image( imageFormat, MemoryAccounting::Capture );
+	mRGBRow.resize( std::max( imageFormat.getWidth(), mCounterNumBits*mCounterBlockSize ) * 3 );
+
+	mStopRequested = false;
+	mThread = std::thread( &SyntheticDeviceInternals::captureThreadMain, this, captureSettingsIndex );
+	return true;
+}
+
+bool SyntheticDeviceInternals::stopBackendCapture()
+{
+	{
+		std::lock_guard<std::mutex> lock( mStopMutex );
+		mStopRequested = true;
+	}
+	mStopCondition.notify_all();
+	mThread.join();
+
+	delete mFrame;
+	mFrame = NULL;
+	return true;
+}
+
+void SyntheticDeviceInternals::captureThreadMain( std::size_t captureSettingsIndex )
+{
+	typedef std::chrono::steady_clock Clock;
+	const std::chrono::duration<double> framePeriod( 1.0 / mSupportedCaptureSettingsList[captureSettingsIndex].getFrameRate() );
+	const Clock::time_point startTime = Clock::now();
+
+	// The frame counter is the index of the frame period since the start of the capture.
+	// If rendering or delivering falls behind, the missed periods are skipped rather than 
+	// delivered in a burst, the way a real camera drops frames
+	unsigned int frameCounter = 0;
+	for (;;)
+	{
+		// Render before waiting so the frame is delivered as close as possible to its deadline
+		renderFrame( frameCounter );
+
+		Clock::time_point deadline = startTime + std::chrono::duration_cast<Clock::duration>( framePeriod * (frameCounter+1) );
+		{
+			std::unique_lock<std::mutex> lock( mStopMutex );
+			if ( mStopCondition.wait_until( lock, deadline, [this]() { return mStopRequested; } ) )
+				return;
+		}
+		
+		Clock::time_point now = Clock::now();
+		long long timestampInNs = std::chrono::duration_cast<std::chrono::nanoseconds>( now - startTime ).count();
+		const MemoryBuffer& buffer = mFrame->getBuffer();
+		deliverBuffer( buffer.getBytes(), buffer.getSizeInBytes(), timestampInNs );
+
+		unsigned int elapsedPeriods = static_cast<unsigned int>( std::chrono::duration<double>( now - startTime ).count() / framePeriod.count() );
+		frameCounter = std::max( frameCounter+1, elapsedPeriods );
+	}
+}
+
+void SyntheticDeviceInternals::renderFrame( unsigned int frameCounter )
+{
+	Tracer::Scope traceScope( "SyntheticDeviceInternals::renderFrame", 0 );
+	const ImageFormat& imageFormat = mFrame->getFormat();
+	unsigned int height = imageFormat.getHeight();
+	
+	if ( mPattern==ColorBars )
+	{
+		// All the rows are identical: render the first one and replicate it
+		writeRow( 0, frameCounter );
+		unsigned char* bytes = mFrame->getBuffer().getWritableBytes();
+		unsigned int numBytesPerLine = imageFormat.getNumBytesPerLine();
+		for ( unsigned int y=1; y<height; ++y )
+			memcpy( bytes + y*numBytesPerLine, bytes, numBytesPerLine );
+	}
+	else
+	{
+		for ( unsigned int y=0; y<height; ++y )
+			writeRow( y, frameCounter );
+	}
+
+	writeFrameCounter( frameCounter );
+}
+
+void SyntheticDeviceInternals::writeRow( unsigned int y, unsigned int frameCounter )
+{
+	static const unsigned char barColors[8][3] = 
+		{ {255,255,255}, {255,255,0}, {0,255,255}, {0,255,0}, {255,0,255}, {255,0,0}, {0,0,255}, {0,0,0} };
+
+	const ImageFormat& imageFormat = mFrame->getFormat();
+	unsigned int width = imageFormat.getWidth();
+	unsigned int height = imageFormat.getHeight();
+	unsigned char* rgb = &mRGBRow[0];
+	
+	if ( mPattern==ColorBars )
+	{
+		unsigned int offset = (frameCounter * 4) % width;
+		for ( unsigned int x=0; x<width; ++x )
+		{
+			const unsigned char* color = barColors[ ((x+offset)%width) * 8 / width ];
+			rgb[x*3] = color[0];
+			rgb[x*3+1] = color[1];
+			rgb[x*3+2] = color[2];
+		}
+	}
+	else
+	{
+		unsigned char blue = static_cast<unsigned char>( y * 255 / height );
+		for ( unsigned int x=0; x<width; ++x )
+		{
+			unsigned char value = static_cast<unsigned char>( x + y + frameCounter*2 );
+			rgb[x*3] = value;
+			rgb[x*3+1] = 255 - value;
+			rgb[x*3+2] = blue;
+		}
+	}
+
+	unsigned char* destBytes = mFrame->getBuffer().getWritableBytes() + y*imageFormat.getNumBytesPerLine();
+	writePixels( rgb, width, imageFormat.getEncoding(), destBytes );
+}
+
+void SyntheticDeviceInternals::writeFrameCounter( unsigned int frameCounter )
+{
+	const ImageFormat& imageFormat = mFrame->getFormat();
+	unsigned int numPixels = mCounterNumBits*mCounterBlockSize;
+	if ( imageFormat.getWidth()<numPixels || imageFormat.getHeight()<mCounterBlockSize )
+		return;
+
+	unsigned char* rgb = &mRGBRow[0];
+	for ( unsigned int bit=0; bit<mCounterNumBits; ++bit )
+	{
+		unsigned char value = ( frameCounter & (0x80000000u>>bit) ) ? 255 : 0;
+		memset( rgb + bit*mCounterBlockSize*3, value, mCounterBlockSize*3 );
+	}
+
+	unsigned char* bytes = mFrame->getBuffer().getWritableBytes();
+	for ( unsigned int y=0; y<mCounterBlockSize; ++y )
+		writePixels( rgb, numPixels, imageFormat.getEncoding(), bytes + y*imageFormat.getNumBytesPerLine() );
+}
+
+bool SyntheticDeviceInternals::readFrameCounter( const Image& image, unsigned int& frameCounter )
+{
+	const ImageFormat& imageFormat = image.getFormat();
+	if ( imageFormat.getWidth()<mCounterNumBits*mCounterBlockSize || imageFormat.getHeight()<mCounterBlockSize )
+		return false;
+
+	// Sample the center of each block. For RGB24, BGR24 and BGRX32 the green component is 
+	// the second byte of the pixel. For YUYV, the center pixel is even so its first byte is its luma
+	const unsigned char* bytes = image.getBuffer().getBytes();
+	unsigned int numBytesPerPixel = imageFormat.getNumBitsPerPixel() / 8;
+	unsigned int componentOffset = imageFormat.getEncoding()==ImageFormat::YUYV ? 0 : 1;
+	const unsigned char* line = bytes + (mCounterBlockSize/2) * imageFormat.getNumBytesPerLine();
+
+	frameCounter = 0;
+	for ( unsigned int bit=0; bit<mCounterNumBits; ++bit )
+	{
+		unsigned int x = bit*mCounterBlockSize + mCounterBlockSize/2;
+		if ( line[x*numBytesPerPixel + componentOffset]>=128 )
+			frameCounter |= 0x80000000u>>bit;
+	}
+	return true;
+}
+
+void SyntheticDeviceInternals::writePixels( const unsigned char* rgbBytes, unsigned int numPixels, ImageFormat::Encoding encoding, unsigned char* destBytes )
+{
+	switch ( encoding )
+	{
+		case ImageFormat::RGB24:
+			memcpy( destBytes, rgbBytes, numPixels*3 );
+			break;
+
+		case ImageFormat::BGR24:
+			for ( unsigned int i=0; i<numPixels; ++i, rgbBytes+=3, destBytes+=3 )
+			{
+				destBytes[0] = rgbBytes[2];
+				destBytes[1] = rgbBytes[1];
+				destBytes[2] = rgbBytes[0];
+			}
+			break;
+
+		case ImageFormat::BGRX32:
+			for ( unsigned int i=0; i<numPixels; ++i, rgbBytes+=3, destBytes+=4 )
+			{
+				destBytes[0] = rgbBytes[2];
+				destBytes[1] = rgbBytes[1];
+				destBytes[2] = rgbBytes[0];
+				destBytes[3] = 255;
+			}
+			break;
+
+		case ImageFormat::YUYV:
+			// BT.601 studio range, the chroma being averaged over the 2 pixels of the macroblock
+			for ( unsigned int i=0; i+1<numPixels; i+=2, rgbBytes+=6, destBytes+=4 )
+			{
+				int r0 = rgbBytes[0], g0 = rgbBytes[1], b0 = rgbBytes[2];
+				int r1 = rgbBytes[3], g1 = rgbBytes[4], b1 = rgbBytes[5];
+				int r = (r0+r1)/2, g = (g0+g1)/2, b = (b0+b1)/2;
+				destBytes[0] = static_cast<unsigned char>( ((66*r0 + 129*g0 + 25*b0 + 128) >> 8) + 16 );
+				destBytes[1] = static_cast<unsigned char>( ((-38*r - 74*g + 112*b + 128) >> 8) + 128 );
+				destBytes[2] = static_cast<unsigned char>( ((66*r1 + 129*g1 + 25*b1 + 128) >> 8) + 16 );
+				destBytes[3] = static_cast<unsigned char>( ((112*r - 94*g - 18*b + 128) >> 8) + 128 );
+			}
+			break;
+
+		default:
+			assert( false );
+			break;
+	}
+}
+
+}
@@ -0,0 +1,473 @@
+/*
+   The MIT License (MIT) (http://opensource.org/licenses/MIT)
+   
+   Copyright (c) 2015 Jacques Menuet
+   
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+   
+   The above copyright notice and this permission notice shall be included in all
+   copies or substantial portions of the Software.
+   
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+*/
+#include "RDShowTaskScheduler.h"
+
+#include <assert.h>
+#include <limits.h>
+#include <stdio.h>
+#include <algorithm>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <vector>
+#include "RDShowLock.h"
+#include "RDShowTracer.h"
+
+namespace RDShow
+{
+
+namespace
+{
+
+struct Task
+{
+	TaskScheduler::TaskFunction		function;
+	void*							context;
+	unsigned int					begin;
+	unsigned int					end;
+	std::atomic<unsigned int>*		numPendingTasks;	// Of its TaskGroup, NULL for a posted task
+};
+
+void runTask( const Task& task )
+{
+	task.function( task.context, task.begin, task.end );
+	if ( task.numPendingTasks )
+		task.numPendingTasks->fetch_sub( 1, std::memory_order_release );
+}
+
+/*
+	The queue of a worker: a fixed-size ring, so pushing never allocates. The owner pushes 
+	and pops at the back, the thieves take from the front. The critical sections are a few 
+	instructions long
+*/
+class TaskQueue
+{
+public:
+	enum { Capacity = 256 };
+
+	TaskQueue()
+		: mLock("TaskScheduler queue"),
+		  mFront(0),
+		  mSize(0)
+	{
+	}
+
+	bool pushBack( const Task& task )
+	{
+		Lock::Scope lockScope( mLock );
+		if ( mSize==Capacity )
+			return false;
+		mTasks[ (mFront + mSize) % Capacity ] = task;
+		mSize++;
+		return true;
+	}
+
+	bool popBack( Task& task )
+	{
+		Lock::Scope lockScope( mLock );
+		if ( mSize==0 )
+			return false;
+		mSize--;
+		task = mTasks[ (mFront + mSize) % Capacity ];
+		return true;
+	}
+
+	bool popFront( Task& task )
+	{
+		Lock::Scope lockScope( mLock );
+		if ( mSize==0 )
+			return false;
+		task = mTasks[mFront];
+		mFront = (mFront + 1) % Capacity;
+		mSize--;
+		return true;
+	}
+
+private:
+	Lock			mLock;
+	Task			mTasks[Capacity];
+	unsigned int	mFront;
+	unsigned int	mSize;
+};
+
+class Scheduler
+{
+public:
+	Scheduler( unsigned int numWorkerThreads, bool pinned, const Thread::Settings& threadSettings );
+	~Scheduler();
+
+	unsigned int	getNumWorkerThreads() const		{ return static_cast<unsigned int>( mThreads.size() ); }
+	const Thread::Settings&	getEffectiveWorkerThreadSettings( unsigned int workerIndex ) const	{ return mEffectiveThreadSettings[workerIndex]; }
+	
+	void			submit( const Task& task );
+	void			post( const Task& task );
+	bool			runPendingTask();
+
+private:
+	void			workerThreadMain( unsigned int workerIndex, bool pinned, Thread::Settings threadSettings );
+	bool			takeTask( Task& task );
+	void			wakeUpWorker();
+
+	std::vector<TaskQueue*>		mQueues;
+	TaskQueue					mPostedTasks;		// Only taken by the idle workers
+	std::vector<std::thread>	mThreads;
+	std::atomic<unsigned int>	mNextQueueIndex;	// Where the threads that aren't workers submit
+
+	// Written by each worker when it starts, before the constructor returns
+	std::vector<Thread::Settings>	mEffectiveThreadSettings;
+	unsigned int				mNumStartedWorkers;		// Guarded by mSleepLock
+	std::condition_variable_any	mStartCondition;
+
+	// The workers sleep while there's nothing to do
+	std::atomic<unsigned int>	mNumQueuedTasks;
+	std::atomic<unsigned int>	mNumSleepingWorkers;
+	Lock						mSleepLock;
+	std::condition_variable_any	mSleepCondition;
+	std::atomic<bool>			mStopRequested;
+};
+
+// The index of the worker running on the current thread, in the Scheduler it belongs to
+thread_local int tWorkerIndex = -1;
+
+Scheduler::Scheduler( unsigned int numWorkerThreads, bool pinned, const Thread::Settings& threadSettings )
+	: mQueues(),
+	  mPostedTasks(),
+	  mThreads(),
+	  mNextQueueIndex(0),
+	  mEffectiveThreadSettings( numWorkerThreads ),
+	  mNumStartedWorkers(0),
+	  mStartCondition(),
+	  mNumQueuedTasks(0),
+	  mNumSleepingWorkers(0),
+	  mSleepLock("TaskScheduler sleep"),
+	  mSleepCondition(),
+	  mStopRequested(false)
+{
+	for ( unsigned int i=0; i<numWorkerThreads; ++i )
+		mQueues.push_back( new TaskQueue() );
+	for ( unsigned int i=0; i<numWorkerThreads; ++i )
+		mThreads.push_back( std::thread( &Scheduler::workerThreadMain, this, i, pinned, threadSettings ) );
+
+	// So the effective settings are known from the start
+	std::unique_lock<Lock> lock( mSleepLock );
+	mStartCondition.wait( lock, [this, numWorkerThreads]() { return mNumStartedWorkers==numWorkerThreads; } );
+}
+
+Scheduler::~Scheduler()
+{
+	{
+		Lock::Scope lockScope( mSleepLock );
+		mStopRequested = true;
+	}
+	mSleepCondition.notify_all();
+	for ( std::size_t i=0; i<mThreads.size(); ++i )
+		mThreads[i].join();
+	for ( std::size_t i=0; i<mQueues.size(); ++i )
+		delete mQueues[i];
+}
+
+void Scheduler::submit( const Task& task )
+{
+	// A worker queues its own tasks, the other threads spread them
+	unsigned int queueIndex = tWorkerIndex>=0 ? static_cast<unsigned int>(tWorkerIndex) : mNextQueueIndex.fetch_add( 1, std::memory_order_relaxed ) % mQueues.size();
+
+	// Counted before it's queued, so a thief taking it right away can't decrement the count 
+	// below zero. Same handshake as ImageNotifier: either the sleeping worker sees the new 
+	// task count or we see the sleeping worker
+	mNumQueuedTasks++;
+	if ( !mQueues[queueIndex]->pushBack( task ) )
+	{
+		mNumQueuedTasks--;
+		runTask( task );
+		return;
+	}
+	wakeUpWorker();
+}
+
+void Scheduler::post( const Task& task )
+{
+	// Counted before it's queued, as in submit(). The posted tasks run in order
+	mNumQueuedTasks++;
+	if ( !mPostedTasks.pushBack( task ) )
+	{
+		mNumQueuedTasks--;
+		runTask( task );
+		return;
+	}
+	wakeUpWorker();
+}
+
+void Scheduler::wakeUpWorker()
+{
+	if ( mNumSleepingWorkers>0 )
+	{
+		{
+			Lock::Scope lockScope( mSleepLock );
+		}
+		mSleepCondition.notify_one();
+	}
+}
+
+bool Scheduler::takeTask( Task& task )
+{
+	unsigned int numQueues = static_cast<unsigned int>( mQueues.size() );
+	unsigned int firstQueueIndex = 0;
+	if ( tWorkerIndex>=0 )
+	{
+		if ( mQueues[tWorkerIndex]->popBack( task ) )
+		{
+			mNumQueuedTasks--;
+			return true;
+		}
+		firstQueueIndex = static_cast<unsigned int>(tWorkerIndex) + 1;
+	}
+
+	// Steal the oldest task of another queue
+	for ( unsigned int i=0; i<numQueues; ++i )
+	{
+		if ( mQueues[ (firstQueueIndex + i) % numQueues ]->popFront( task ) )
+		{
+			mNumQueuedTasks--;
+			return true;
+		}
+	}
+	return false;
+}
+
+bool Scheduler::runPendingTask()
+{
+	Task task;
+	if ( !takeTask( task ) )
+		return false;
+	runTask( task );
+	return true;
+}
+
+void Scheduler::workerThreadMain( unsigned int workerIndex, bool pinned, Thread::Settings threadSettings )
+{
+	tWorkerIndex = static_cast<int>(workerIndex);
+	if ( pinned )
+		threadSettings.cpuMask = 1ULL << ( (workerIndex + 1) % std::min( Thread::getNumCPUs(), 64u ) );
+	Thread::Settings effectiveThreadSettings = threadSettings.isDefault() ? Thread::getCurrentThreadSettings() : Thread::applyToCurrentThread( threadSettings );
+	{
+		Lock::Scope lockScope( mSleepLock );
+		mEffectiveThreadSettings[workerIndex] = effectiveThreadSettings;
+		mNumStartedWorkers++;
+	}
+	mStartCondition.notify_one();
+
+	char threadName[32];
+	sprintf( threadName, "TaskScheduler worker %u", workerIndex );
+	Tracer::setCurrentThreadName( threadName );
+
+	for (;;)
+	{
+		if ( runPendingTask() )
+			continue;
+		Task postedTask;
+		if ( mPostedTasks.popFront( postedTask ) )
+		{
+			mNumQueuedTasks--;
+			runTask( postedTask );
+			continue;
+		}
+
+		std::unique_lock<Lock> lock( mSleepLock );
+		mNumSleepingWorkers++;
+		mSleepCondition.wait( lock, [this]() { return mStopRequested || mNumQueuedTasks>0; } );
+		mNumSleepingWorkers--;
+		if ( mStopRequested && mNumQueuedTasks==0 )
+			break;
+	}
+	tWorkerIndex = -1;
+}
+
+const unsigned int AutomaticNumWorkerThreads = UINT_MAX;
+std::atomic<unsigned int> gNumWorkerThreads( AutomaticNumWorkerThreads );
+std::atomic<bool> gWorkerThreadsPinned( false );
+Thread::Settings gWorkerThreadSettings;		// Guarded by getSchedulerLock()
+
+// Created on first use, like the Scheduler, so it can be used during static initialization
+Lock& getSchedulerLock()
+{
+	static Lock schedulerLock( "TaskScheduler" );
+	return schedulerLock;
+}
+
+std::atomic<Scheduler*> gScheduler( NULL );
+
+Scheduler* getScheduler()
+{
+	Scheduler* scheduler = gScheduler.load( std::memory_order_acquire );
+	if ( scheduler )
+		return scheduler;
+
+	Lock::Scope lockScope( getSchedulerLock() );
+	scheduler = gScheduler.load( std::memory_order_relaxed );
+	if ( !scheduler )
+	{
+		unsigned int numWorkerThreads = gNumWorkerThreads;
+		if ( numWorkerThreads==AutomaticNumWorkerThreads )
+			numWorkerThreads = Thread::getNumCPUs() - 1;
+		scheduler = new Scheduler( numWorkerThreads, gWorkerThreadsPinned, gWorkerThreadSettings );
+		gScheduler.store( scheduler, std::memory_order_release );
+	}
+	return scheduler;
+}
+
+}
+
+void TaskScheduler::setNumWorkerThreads( unsigned int numThreads )
+{
+	assert( !gScheduler.load() );
+	gNumWorkerThreads = numThreads;
+}
+
+unsigned int TaskScheduler::getNumWorkerThreads()
+{
+	return getScheduler()->getNumWorkerThreads();
+}
+
+void TaskScheduler::setWorkerThreadsPinned( bool pinned )
+{
+	assert( !gScheduler.load() );
+	gWorkerThreadsPinned = pinned;
+}
+
+bool TaskScheduler::areWorkerThreadsPinned()
+{
+	return gWorkerThreadsPinned;
+}
+
+void TaskScheduler::setWorkerThreadSettings( const Thread::Settings& settings )
+{
+	Lock::Scope lockScope( getSchedulerLock() );
+	assert( !gScheduler.load() );
+	gWorkerThreadSettings = settings;
+}
+
+Thread::Settings TaskScheduler::getWorkerThreadSettings()
+{
+	Lock::Scope lockScope( getSchedulerLock() );
+	return gWorkerThreadSettings;
+}
+
+bool TaskScheduler::getEffectiveWorkerThreadSettings( unsigned int workerIndex, Thread::Settings& settings )
+{
+	Scheduler* scheduler = getScheduler();
+	if ( workerIndex>=scheduler->getNumWorkerThreads() )
+		return false;
+	settings = scheduler->getEffectiveWorkerThreadSettings( workerIndex );
+	return true;
+}
+
+void TaskScheduler::shutdown()
+{
+	Lock::Scope lockScope( getSchedulerLock() );
+	delete gScheduler.exchange( NULL );
+}
+
+void TaskScheduler::post( TaskFunction function, void* context )
+{
+	Task task;
+	task.function = function;
+	task.context = context;
+	task.begin = 0;
+	task.end = 0;
+	task.numPendingTasks = NULL;
+
+	Scheduler* scheduler = getScheduler();
+	if ( scheduler->getNumWorkerThreads()==0 )
+		runTask( task );
+	else
+		scheduler->post( task );
+}
+
+void TaskScheduler::parallelFor( unsigned int begin, unsigned int end, unsigned int grainSize, TaskFunction function, void* context )
+{
+	if ( begin>=end )
+		return;
+	if ( grainSize==0 )
+		grainSize = 1;
+
+	// A few chunks per thread, so the threads that finish first can take over some work
+	unsigned int numItems = end - begin;
+	unsigned int numThreads = getScheduler()->getNumWorkerThreads() + 1;
+	unsigned int numChunks = std::min( (numItems + grainSize - 1) / grainSize, numThreads * 4 );
+	if ( numThreads==1 || numChunks<=1 )
+	{
+		function( context, begin, end );
+		return;
+	}
+
+	unsigned int chunkSize = (numItems + numChunks - 1) / numChunks;
+	TaskGroup taskGroup;
+	for ( unsigned int chunkBegin=begin+chunkSize; chunkBegin<end; chunkBegin+=chunkSize )
+		taskGroup.run( function, context, chunkBegin, std::min( chunkBegin + chunkSize, end ) );
+
+	// The calling thread takes the first chunk
+	function( context, begin, begin + chunkSize );
+	taskGroup.wait();
+}
+
+TaskScheduler::TaskGroup::TaskGroup()
+	: mNumPendingTasks(0)
+{
+}
+
+TaskScheduler::TaskGroup::~TaskGroup()
+{
+	wait();
+}
+
+void TaskScheduler::TaskGroup::run( TaskFunction function, void* context, unsigned int begin, unsigned int end )
+{
+	Task task;
+	task.function = function;
+	task.context = context;
+	task.begin = begin;
+	task.end = end;
+	task.numPendingTasks = &mNumPendingTasks;
+	mNumPendingTasks.fetch_add( 1, std::memory_order_relaxed );
+
+	Scheduler* scheduler = getScheduler();
+	if ( scheduler->getNumWorkerThreads()==0 )
+		runTask( task );
+	else
+		scheduler->submit( task );
+}
+
+void TaskScheduler::TaskGroup::wait()
+{
+	// Help rather than block. The tasks of the group are either queued, and we may run 
+	// them ourselves, or already running on other threads
+	while ( mNumPendingTasks.load( std::memory_order_acquire )>0 )
+	{
+		Scheduler* scheduler = getScheduler();
+		if ( !scheduler->runPendingTask() )
+			std::this_thread::yield();
+	}
+}
+
+}
@@ -0,0 +1,222 @@
+/*
+   The MIT License (MIT) (http://opensource.org/licenses/MIT)
+   
+   Copyright (c) 2015 Jacques Menuet
+   
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+   
+   The above copyright notice and this permission notice shall be included in all
+   copies or substantial portions of the Software.
+   
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+*/
+#include "RDShowThread.h"
+
+#include <thread>
+#include <algorithm>
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+
+#ifdef _WIN32
+	#define WIN32_LEAN_AND_MEAN 
+	#define NOMINMAX 
+	#include <windows.h>
+#elif defined(__linux__)
+	#include <pthread.h>
+	#include <sched.h>
+	#include <unistd.h>
+	#include <sys/syscall.h>
+	#include <sys/resource.h>
+#endif
+
+namespace RDShow
+{
+
+unsigned int Thread::getNumCPUs()
+{
+	unsigned int numCPUs = std::thread::hardware_concurrency();
+	return numCPUs>0 ? numCPUs : 1;
+}
+
+bool Thread::setCurrentThreadAffinity( unsigned long long cpuMask )
+{
+	if ( cpuMask==0 )
+		return false;
+
+#ifdef _WIN32
+	return SetThreadAffinityMask( GetCurrentThread(), static_cast<DWORD_PTR>(cpuMask) )!=0;
+#elif defined(__linux__)
+	cpu_set_t cpuSet;
+	CPU_ZERO( &cpuSet );
+	for ( unsigned int cpu=0; cpu<64 && cpu<CPU_SETSIZE; ++cpu )
+	{
+		if ( cpuMask & (1ULL << cpu) )
+			CPU_SET( cpu, &cpuSet );
+	}
+	return pthread_setaffinity_np( pthread_self(), sizeof(cpuSet), &cpuSet )==0;
+#else
+	return false;
+#endif
+}
+
+namespace
+{
+
+const char* gPriorityNames[] = { "Lowest", "BelowNormal", "Normal", "AboveNormal", "Highest", "TimeCritical" };
+
+#ifdef _WIN32
+const int gWindowsPriorities[] = 
+	{ THREAD_PRIORITY_LOWEST, THREAD_PRIORITY_BELOW_NORMAL, THREAD_PRIORITY_NORMAL, 
+	  THREAD_PRIORITY_ABOVE_NORMAL, THREAD_PRIORITY_HIGHEST, THREAD_PRIORITY_TIME_CRITICAL };
+#elif defined(__linux__)
+const int gNiceValues[] = { 10, 5, 0, -5, -10, -20 };
+
+// The nice value of a thread is set through its thread id
+pid_t getCurrentThreadId()
+{
+	return static_cast<pid_t>( syscall( SYS_gettid ) );
+}
+
+Thread::Settings::Priority getPriorityFromNiceValue( int niceValue )
+{
+	// The closest one
+	int priority = Thread::Settings::Lowest;
+	for ( int i=Thread::Settings::Lowest; i<=Thread::Settings::TimeCritical; ++i )
+	{
+		if ( abs( gNiceValues[i] - niceValue )<abs( gNiceValues[priority] - niceValue ) )
+			priority = i;
+	}
+	return static_cast<Thread::Settings::Priority>(priority);
+}
+#endif
+
+}
+
+Thread::Settings::Settings()
+	: priority(Normal),
+	  policy(NormalPolicy),
+	  realTimePriority(0),
+	  cpuMask(0)
+{
+}
+
+bool Thread::Settings::isDefault() const
+{
+	return priority==Normal && policy==NormalPolicy && cpuMask==0;
+}
+
+std::string Thread::Settings::toString() const
+{
+	char text[128];
+	switch ( policy )
+	{
+	case FifoPolicy:		sprintf( text, "FIFO %d", realTimePriority ); break;
+	case RoundRobinPolicy:	sprintf( text, "RR %d", realTimePriority ); break;
+	default:				sprintf( text, "%s", gPriorityNames[priority] ); break;
+	}
+	std::string ret = text;
+	if ( cpuMask!=0 )
+	{
+		sprintf( text, ", CPUs 0x%llx", cpuMask );
+		ret += text;
+	}
+	return ret;
+}
+
+Thread::Settings Thread::applyToCurrentThread( const Settings& settings )
+{
+	unsigned long long appliedCpuMask = 0;
+	if ( settings.cpuMask!=0 && setCurrentThreadAffinity( settings.cpuMask ) )
+		appliedCpuMask = settings.cpuMask;
+
+#ifdef _WIN32
+	int priority = settings.policy==Settings::NormalPolicy ? gWindowsPriorities[settings.priority] : THREAD_PRIORITY_TIME_CRITICAL;
+	SetThreadPriority( GetCurrentThread(), priority );
+#elif defined(__linux__)
+	bool isRealTime = false;
+	if ( settings.policy!=Settings::NormalPolicy )
+	{
+		int policy = settings.policy==Settings::FifoPolicy ? SCHED_FIFO : SCHED_RR;
+		sched_param param;
+		param.sched_priority = std::min( std::max( settings.realTimePriority, sched_get_priority_min(policy) ), sched_get_priority_max(policy) );
+		isRealTime = pthread_setschedparam( pthread_self(), policy, &param )==0;
+	}
+	if ( !isRealTime )
+	{
+		// Back to the normal policy, in case the thread had a real-time one
+		sched_param param;
+		param.sched_priority = 0;
+		pthread_setschedparam( pthread_self(), SCHED_OTHER, &param );
+		setpriority( PRIO_PROCESS, static_cast<id_t>( getCurrentThreadId() ), gNiceValues[settings.priority] );
+	}
+#endif
+
+	Settings effectiveSettings = getCurrentThreadSettings();
+#ifdef _WIN32
+	effectiveSettings.cpuMask = appliedCpuMask;		// Windows can't tell
+#else
+	(void)appliedCpuMask;
+#endif
+	return effectiveSettings;
+}
+
+Thread::Settings Thread::getCurrentThreadSettings()
+{
+	Settings settings;
+#ifdef _WIN32
+	int priority = GetThreadPriority( GetCurrentThread() );
+	settings.priority = Settings::Lowest;
+	for ( int i=Settings::Lowest; i<=Settings::TimeCritical; ++i )
+	{
+		if ( gWindowsPriorities[i]<=priority )
+			settings.priority = static_cast<Settings::Priority>(i);
+	}
+#elif defined(__linux__)
+	int policy = SCHED_OTHER;
+	sched_param param;
+	if ( pthread_getschedparam( pthread_self(), &policy, &param )==0 && ( policy==SCHED_FIFO || policy==SCHED_RR ) )
+	{
+		settings.policy = policy==SCHED_FIFO ? Settings::FifoPolicy : Settings::RoundRobinPolicy;
+		settings.realTimePriority = param.sched_priority;
+	}
+	
+	// -1 is a valid nice value, errno tells the errors apart
+	errno = 0;
+	int niceValue = getpriority( PRIO_PROCESS, static_cast<id_t>( getCurrentThreadId() ) );
+	if ( errno==0 )
+		settings.priority = getPriorityFromNiceValue( niceValue );
+	
+	cpu_set_t cpuSet;
+	CPU_ZERO( &cpuSet );
+	if ( pthread_getaffinity_np( pthread_self(), sizeof(cpuSet), &cpuSet )==0 )
+	{
+		unsigned int numCPUs = getNumCPUs();
+		unsigned int numAllowedCPUs = 0;
+		for ( unsigned int cpu=0; cpu<CPU_SETSIZE; ++cpu )
+		{
+			if ( !CPU_ISSET( cpu, &cpuSet ) )
+				continue;
+			numAllowedCPUs++;
+			if ( cpu<64 )
+				settings.cpuMask |= 1ULL << cpu;
+		}
+		if ( numAllowedCPUs>=numCPUs )
+			settings.cpuMask = 0;
+	}
+#endif
+	return settings;
+}
+
+}
@@ -0,0 +1,228 @@
+/*
+   The MIT License (MIT) (http://opensource.org/licenses/MIT)
+   
+   Copyright (c) 2015 Jacques Menuet
+   
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+   
+   The above copyright notice and this permission notice shall be included in all
+   copies or substantial portions of the Software.
+   
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+*/
+#include "RDShowTracer.h"
+
+#include <stdio.h>
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include "RDShowClock.h"
+
+#ifdef _WIN32
+	#include "RDShowUnicode.h"
+#endif
+
+namespace RDShow
+{
+
+namespace
+{
+
+struct Event
+{
+	const char*		name;
+	unsigned int	sequenceNumber;
+	long long		startTimeInNs;
+	long long		durationInNs;
+};
+
+// The events of one thread. Only that thread writes them
+struct ThreadBuffer
+{
+	ThreadBuffer( unsigned int numEvents, unsigned int index )
+		: events(numEvents),
+		  numRecordedEvents(0),
+		  threadIndex(index),
+		  threadName()
+	{
+	}
+
+	std::vector<Event>						events;
+	std::atomic<unsigned long long>			numRecordedEvents;	// Since the last clear, the overwritten ones included
+	unsigned int							threadIndex;
+	std::string								threadName;			// Guarded by gMutex
+};
+
+std::atomic<bool> gIsEnabled( false );
+std::atomic<unsigned int> gNumEventsPerThread( 65536 );
+
+// The buffers of all the threads that recorded something. They're kept until the end of the 
+// process as the threads that created them can still be running or, if they've ended, 
+// their events are still worth writing
+std::mutex gMutex;
+std::vector<ThreadBuffer*> gThreadBuffers;
+
+thread_local ThreadBuffer* tThreadBuffer = NULL;
+thread_local std::string tThreadName;		// Until the thread has a buffer
+
+ThreadBuffer* getCurrentThreadBuffer()
+{
+	if ( !tThreadBuffer )
+	{
+		std::lock_guard<std::mutex> lock( gMutex );
+		tThreadBuffer = new ThreadBuffer( gNumEventsPerThread.load(), static_cast<unsigned int>(gThreadBuffers.size()) + 1 );
+		gThreadBuffers.push_back( tThreadBuffer );
+		tThreadBuffer->threadName.swap( tThreadName );
+	}
+	return tThreadBuffer;
+}
+
+void writeJSONString( FILE* file, const std::string& text )
+{
+	fputc( '"', file );
+	for ( std::size_t i=0; i<text.size(); ++i )
+	{
+		char c = text[i];
+		if ( c=='"' || c=='\\' )
+			fputc( '\\', file );
+		if ( static_cast<unsigned char>(c)>=0x20 )
+			fputc( c, file );
+	}
+	fputc( '"', file );
+}
+
+FILE* openFileForWriting( const std::string& filename )
+{
+#ifdef _WIN32
+	return _wfopen( Unicode::UTF8toUTF16String( filename ).c_str(), L"wb" );
+#else
+	return fopen( filename.c_str(), "wb" );
+#endif
+}
+
+}
+
+bool Tracer::isAvailable()
+{
+#ifdef RDSHOW_ENABLE_TRACING
+	return true;
+#else
+	return false;
+#endif
+}
+
+void Tracer::setEnabled( bool enabled )
+{
+	gIsEnabled.store( enabled );
+}
+
+bool Tracer::isEnabled()
+{
+	return gIsEnabled.load( std::memory_order_relaxed );
+}
+
+void Tracer::setNumEventsPerThread( unsigned int numEvents )
+{
+	gNumEventsPerThread.store( numEvents>0 ? numEvents : 1 );
+}
+
+unsigned int Tracer::getNumEventsPerThread()
+{
+	return gNumEventsPerThread.load();
+}
+
+void Tracer::setCurrentThreadName( const std::string& name )
+{
+	// The buffer of the thread is only created when it records something
+	if ( !tThreadBuffer )
+	{
+		tThreadName = name;
+		return;
+	}
+	std::lock_guard<std::mutex> lock( gMutex );
+	tThreadBuffer->threadName = name;
+}
+
+void Tracer::clear()
+{
+	std::lock_guard<std::mutex> lock( gMutex );
+	for ( std::size_t i=0; i<gThreadBuffers.size(); ++i )
+		gThreadBuffers[i]->numRecordedEvents.store( 0 );
+}
+
+long long Tracer::getTimeInNs()
+{
+	return Clock::getTimeInNs();
+}
+
+void Tracer::recordEvent( const char* name, unsigned int sequenceNumber, long long startTimeInNs )
+{
+	long long endTimeInNs = Clock::getTimeInNs();
+	ThreadBuffer* threadBuffer = getCurrentThreadBuffer();
+	
+	// Only this thread changes the number of events (clear() aside)
+	unsigned long long numRecordedEvents = threadBuffer->numRecordedEvents.load( std::memory_order_relaxed );
+	Event& event = threadBuffer->events[ numRecordedEvents % threadBuffer->events.size() ];
+	event.name = name;
+	event.sequenceNumber = sequenceNumber;
+	event.startTimeInNs = startTimeInNs;
+	event.durationInNs = endTimeInNs - startTimeInNs;
+	threadBuffer->numRecordedEvents.store( numRecordedEvents + 1, std::memory_order_release );
+}
+
+bool Tracer::writeChromeTraceFile( const std::string& filename )
+{
+	FILE* file = openFileForWriting( filename );
+	if ( !file )
+		return false;
+
+	fprintf( file, "{\"traceEvents\":[\n" );
+	bool isFirstEvent = true;
+	{
+		std::lock_guard<std::mutex> lock( gMutex );
+		for ( std::size_t i=0; i<gThreadBuffers.size(); ++i )
+		{
+			const ThreadBuffer* threadBuffer = gThreadBuffers[i];
+			if ( !threadBuffer->threadName.empty() )
+			{
+				fprintf( file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":", 
+						 isFirstEvent ? "" : ",\n", threadBuffer->threadIndex );
+				writeJSONString( file, threadBuffer->threadName );
+				fprintf( file, "}}" );
+				isFirstEvent = false;
+			}
+
+			// Only the latest events are still in the ring buffer
+			unsigned long long numRecordedEvents = threadBuffer->numRecordedEvents.load( std::memory_order_acquire );
+			unsigned long long numEvents = threadBuffer->events.size();
+			unsigned long long firstEvent = numRecordedEvents>numEvents ? numRecordedEvents - numEvents : 0;
+			for ( unsigned long long j=firstEvent; j<numRecordedEvents; ++j )
+			{
+				const Event& event = threadBuffer->events[ j % numEvents ];
+				fprintf( file, "%s{\"name\":\"%s\",\"cat\":\"RDShow\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"seq\":%u}}",
+						 isFirstEvent ? "" : ",\n", event.name, threadBuffer->threadIndex, 
+						 event.startTimeInNs / 1e3, event.durationInNs / 1e3, event.sequenceNumber );
+				isFirstEvent = false;
+			}
+		}
+	}
+	fprintf( file, "\n],\"displayTimeUnit\":\"ms\"}\n" );
+
+	bool ret = ferror( file )==0;
+	if ( fclose( file )!=0 )
+		ret = false;
+	return ret;
+}
+
+}